@@ -468,6 +468,449 @@ static void Blit_Expand_8_To_32(uint8 * dest, const uint8 * p, uint32 length)
 		*q++ = ExpandMap[*p++];
 }
 
+/* -------------------------------------------------------------------------- */
+/* --- SIMD variants, picked at run-time by Screen_blitter_init()         --- */
+/* -------------------------------------------------------------------------- */
+
+#if !defined(WORDS_BIGENDIAN) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VIDEO_BLIT_X86 1
+#include <immintrin.h>
+#elif !defined(WORDS_BIGENDIAN) && defined(__aarch64__)
+#define VIDEO_BLIT_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef void (*Screen_blit_simd_func)(uint8 * dest, const uint8 * source, uint32 length);
+
+enum {
+	BLIT_ISA_SSSE3,
+	BLIT_ISA_AVX2,
+	BLIT_ISA_NEON
+};
+
+// 1-bit pixels expand to all ones or all zeros, without ExpandMap
+static const uint32 Blit_Mono_Map[16] = { 0, 0xffffffff };
+
+// Palette expansion with a 16-entry table lookup only matches the scalar
+// code because ExpandMap[] repeats its first 2^depth entries (see video_x.cpp)
+static void build_expand_planes(const uint32 *map, uint8 planes[4][16])
+{
+	for (int i = 0; i < 16; i++)
+		for (int k = 0; k < 4; k++)
+			planes[k][i] = map[i] >> (8 * k);
+}
+
+#if VIDEO_BLIT_X86
+#define BLIT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define BLIT_TARGET_AVX2 __attribute__((target("avx2")))
+
+// Byte shuffle within each pixel, length in bytes
+static BLIT_TARGET_SSSE3 inline void blit_shuffle_ssse3(uint8 * dest, const uint8 * source, uint32 length,
+														const uint8 pattern[16], Screen_blit_simd_func tail)
+{
+	const __m128i mask = _mm_loadu_si128((const __m128i *)pattern);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16)
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(source + i)), mask));
+	if (length & 15)
+		tail(dest + n, source + n, length & 15);
+}
+
+static BLIT_TARGET_AVX2 inline void blit_shuffle_avx2(uint8 * dest, const uint8 * source, uint32 length,
+													  const uint8 pattern[16], Screen_blit_simd_func tail)
+{
+	const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)pattern));
+	const uint32 n = length & ~31;
+	for (uint32 i = 0; i < n; i += 32)
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(source + i)), mask));
+	if (length & 31)
+		tail(dest + n, source + n, length & 31);
+}
+
+static const uint8 Blit_Swap16_Pattern[16] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const uint8 Blit_Swap32_Pattern[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+static const uint8 Blit_BGR888_Pattern[16] = { 0, 0x80, 2, 1, 4, 0x80, 6, 5, 8, 0x80, 10, 9, 12, 0x80, 14, 13 };
+
+static BLIT_TARGET_SSSE3 void Blit_RGB555_NBO_SSSE3(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_ssse3(dest, source, length, Blit_Swap16_Pattern, Blit_RGB555_NBO);
+}
+
+static BLIT_TARGET_SSSE3 void Blit_RGB888_NBO_SSSE3(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_ssse3(dest, source, length, Blit_Swap32_Pattern, Blit_RGB888_NBO);
+}
+
+static BLIT_TARGET_SSSE3 void Blit_BGR888_NBO_SSSE3(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_ssse3(dest, source, length, Blit_BGR888_Pattern, Blit_BGR888_NBO);
+}
+
+static BLIT_TARGET_AVX2 void Blit_RGB555_NBO_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_avx2(dest, source, length, Blit_Swap16_Pattern, Blit_RGB555_NBO);
+}
+
+static BLIT_TARGET_AVX2 void Blit_RGB888_NBO_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_avx2(dest, source, length, Blit_Swap32_Pattern, Blit_RGB888_NBO);
+}
+
+static BLIT_TARGET_AVX2 void Blit_BGR888_NBO_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_avx2(dest, source, length, Blit_BGR888_Pattern, Blit_BGR888_NBO);
+}
+
+static BLIT_TARGET_SSSE3 void Blit_RGB565_NBO_SSSE3(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const __m128i m1 = _mm_set1_epi16(0x001f), m2 = _mm_set1_epi16((short)0xfe00), m3 = _mm_set1_epi16(0x01c0);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(source + i));
+		v = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 8), m1),
+									  _mm_and_si128(_mm_slli_epi16(v, 9), m2)),
+						 _mm_and_si128(_mm_srli_epi16(v, 7), m3));
+		_mm_storeu_si128((__m128i *)(dest + i), v);
+	}
+	if (length & 15)
+		Blit_RGB565_NBO(dest + n, source + n, length & 15);
+}
+
+static BLIT_TARGET_AVX2 void Blit_RGB565_NBO_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const __m256i m1 = _mm256_set1_epi16(0x001f), m2 = _mm256_set1_epi16((short)0xfe00), m3 = _mm256_set1_epi16(0x01c0);
+	const uint32 n = length & ~31;
+	for (uint32 i = 0; i < n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(source + i));
+		v = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 8), m1),
+											_mm256_and_si256(_mm256_slli_epi16(v, 9), m2)),
+							_mm256_and_si256(_mm256_srli_epi16(v, 7), m3));
+		_mm256_storeu_si256((__m256i *)(dest + i), v);
+	}
+	if (length & 31)
+		Blit_RGB565_NBO(dest + n, source + n, length & 31);
+}
+
+// Split 16 packed source bytes into 8/BITS vectors of pixel indices, leftmost pixel first
+template< int BITS >
+static BLIT_TARGET_SSSE3 inline void split_indices_ssse3(__m128i v, __m128i * idx)
+{
+	int n = 1;
+	idx[0] = v;
+	for (int width = 8; width > BITS; width /= 2) {
+		const __m128i count = _mm_cvtsi32_si128(width / 2);
+		const __m128i mask = _mm_set1_epi8((1 << (width / 2)) - 1);
+		for (int i = n - 1; i >= 0; i--) {
+			__m128i hi = _mm_and_si128(_mm_srl_epi16(idx[i], count), mask);
+			__m128i lo = _mm_and_si128(idx[i], mask);
+			idx[2 * i] = _mm_unpacklo_epi8(hi, lo);
+			idx[2 * i + 1] = _mm_unpackhi_epi8(hi, lo);
+		}
+		n *= 2;
+	}
+}
+
+// Look up 16 pixel indices in the byte planes of the map and store BYTES bytes per pixel
+template< int BYTES >
+static BLIT_TARGET_SSSE3 inline uint8 *store_pixels_ssse3(uint8 * dest, __m128i idx, const __m128i * planes)
+{
+	if (BYTES == 1) {
+		_mm_storeu_si128((__m128i *)dest, idx);
+		return dest + 16;
+	}
+	__m128i b0 = _mm_shuffle_epi8(planes[0], idx);
+	__m128i b1 = _mm_shuffle_epi8(planes[1], idx);
+	__m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+	__m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+	if (BYTES == 2) {
+		_mm_storeu_si128((__m128i *)dest, lo01);
+		_mm_storeu_si128((__m128i *)(dest + 16), hi01);
+		return dest + 32;
+	}
+	__m128i b2 = _mm_shuffle_epi8(planes[2], idx);
+	__m128i b3 = _mm_shuffle_epi8(planes[3], idx);
+	__m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+	__m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+	_mm_storeu_si128((__m128i *)dest, _mm_unpacklo_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dest + 16), _mm_unpackhi_epi16(lo01, lo23));
+	_mm_storeu_si128((__m128i *)(dest + 32), _mm_unpacklo_epi16(hi01, hi23));
+	_mm_storeu_si128((__m128i *)(dest + 48), _mm_unpackhi_epi16(hi01, hi23));
+	return dest + 64;
+}
+
+template< int BITS, int BYTES >
+static BLIT_TARGET_SSSE3 inline void blit_expand_ssse3(uint8 * dest, const uint8 * source, uint32 length,
+													   const uint32 * map, Screen_blit_simd_func tail)
+{
+	__m128i planes[4];
+	if (BYTES > 1) {
+		uint8 plane_bytes[4][16];
+		build_expand_planes(map, plane_bytes);
+		for (int k = 0; k < BYTES; k++)
+			planes[k] = _mm_loadu_si128((const __m128i *)plane_bytes[k]);
+	}
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i idx[8 / BITS];
+		split_indices_ssse3<BITS>(_mm_loadu_si128((const __m128i *)(source + i)), idx);
+		for (int k = 0; k < 8 / BITS; k++)
+			dest = store_pixels_ssse3<BYTES>(dest, idx[k], planes);
+	}
+	if (length & 15)
+		tail(dest, source + n, length & 15);
+}
+
+#define DEFINE_BLIT_EXPAND_SSSE3(BITS, DEPTH, MAP) \
+static BLIT_TARGET_SSSE3 void Blit_Expand_##BITS##_To_##DEPTH##_SSSE3(uint8 * dest, const uint8 * source, uint32 length) \
+{ \
+	blit_expand_ssse3<BITS, DEPTH / 8>(dest, source, length, MAP, Blit_Expand_##BITS##_To_##DEPTH); \
+}
+
+DEFINE_BLIT_EXPAND_SSSE3(1, 8, NULL)
+DEFINE_BLIT_EXPAND_SSSE3(2, 8, NULL)
+DEFINE_BLIT_EXPAND_SSSE3(4, 8, NULL)
+DEFINE_BLIT_EXPAND_SSSE3(1, 16, Blit_Mono_Map)
+DEFINE_BLIT_EXPAND_SSSE3(2, 16, ExpandMap)
+DEFINE_BLIT_EXPAND_SSSE3(4, 16, ExpandMap)
+DEFINE_BLIT_EXPAND_SSSE3(1, 32, Blit_Mono_Map)
+DEFINE_BLIT_EXPAND_SSSE3(2, 32, ExpandMap)
+DEFINE_BLIT_EXPAND_SSSE3(4, 32, ExpandMap)
+
+#undef DEFINE_BLIT_EXPAND_SSSE3
+
+// 8-bit palette lookups need a gather, SSSE3 has none
+static BLIT_TARGET_AVX2 void Blit_Expand_8_To_32_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(source + i)));
+		_mm256_storeu_si256((__m256i *)(dest + i * 4), _mm256_i32gather_epi32((const int *)ExpandMap, idx, 4));
+	}
+	if (length & 7)
+		Blit_Expand_8_To_32(dest + n * 4, source + n, length & 7);
+}
+
+static BLIT_TARGET_AVX2 void Blit_Expand_8_To_16_AVX2(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const __m256i low_words = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1,
+												0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(source + i)));
+		__m256i v = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int *)ExpandMap, idx, 4), low_words);
+		v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_si128((__m128i *)(dest + i * 2), _mm256_castsi256_si128(v));
+	}
+	if (length & 7)
+		Blit_Expand_8_To_16(dest + n * 2, source + n, length & 7);
+}
+
+static bool blit_isa_supported(int isa)
+{
+	switch (isa) {
+	case BLIT_ISA_SSSE3: return __builtin_cpu_supports("ssse3");
+	case BLIT_ISA_AVX2:	 return __builtin_cpu_supports("avx2");
+	}
+	return false;
+}
+#endif
+
+#if VIDEO_BLIT_NEON
+static inline void blit_shuffle_neon(uint8 * dest, const uint8 * source, uint32 length,
+									 const uint8 pattern[16], Screen_blit_simd_func tail)
+{
+	const uint8x16_t mask = vld1q_u8(pattern);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16)
+		vst1q_u8(dest + i, vqtbl1q_u8(vld1q_u8(source + i), mask));
+	if (length & 15)
+		tail(dest + n, source + n, length & 15);
+}
+
+// Out of range TBL indices give zero
+static const uint8 Blit_Swap16_Pattern[16] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const uint8 Blit_Swap32_Pattern[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+static const uint8 Blit_BGR888_Pattern[16] = { 0, 0xff, 2, 1, 4, 0xff, 6, 5, 8, 0xff, 10, 9, 12, 0xff, 14, 13 };
+
+static void Blit_RGB555_NBO_NEON(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_neon(dest, source, length, Blit_Swap16_Pattern, Blit_RGB555_NBO);
+}
+
+static void Blit_RGB888_NBO_NEON(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_neon(dest, source, length, Blit_Swap32_Pattern, Blit_RGB888_NBO);
+}
+
+static void Blit_BGR888_NBO_NEON(uint8 * dest, const uint8 * source, uint32 length)
+{
+	blit_shuffle_neon(dest, source, length, Blit_BGR888_Pattern, Blit_BGR888_NBO);
+}
+
+static void Blit_RGB565_NBO_NEON(uint8 * dest, const uint8 * source, uint32 length)
+{
+	const uint16x8_t m1 = vdupq_n_u16(0x001f), m2 = vdupq_n_u16(0xfe00), m3 = vdupq_n_u16(0x01c0);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(source + i));
+		v = vorrq_u16(vorrq_u16(vandq_u16(vshrq_n_u16(v, 8), m1), vandq_u16(vshlq_n_u16(v, 9), m2)),
+					  vandq_u16(vshrq_n_u16(v, 7), m3));
+		vst1q_u8(dest + i, vreinterpretq_u8_u16(v));
+	}
+	if (length & 15)
+		Blit_RGB565_NBO(dest + n, source + n, length & 15);
+}
+
+// Split 16 packed source bytes into 8/BITS vectors of pixel indices, leftmost pixel first
+template< int BITS >
+static inline void split_indices_neon(uint8x16_t v, uint8x16_t * idx)
+{
+	int n = 1;
+	idx[0] = v;
+	for (int width = 8; width > BITS; width /= 2) {
+		const int8x16_t count = vdupq_n_s8(-(width / 2));
+		const uint8x16_t mask = vdupq_n_u8((1 << (width / 2)) - 1);
+		for (int i = n - 1; i >= 0; i--) {
+			uint8x16_t hi = vshlq_u8(idx[i], count);
+			uint8x16_t lo = vandq_u8(idx[i], mask);
+			idx[2 * i] = vzip1q_u8(hi, lo);
+			idx[2 * i + 1] = vzip2q_u8(hi, lo);
+		}
+		n *= 2;
+	}
+}
+
+template< int BYTES >
+static inline uint8 *store_pixels_neon(uint8 * dest, uint8x16_t idx, const uint8x16_t * planes)
+{
+	if (BYTES == 1) {
+		vst1q_u8(dest, idx);
+		return dest + 16;
+	}
+	uint8x16_t b0 = vqtbl1q_u8(planes[0], idx);
+	uint8x16_t b1 = vqtbl1q_u8(planes[1], idx);
+	uint8x16_t lo01 = vzip1q_u8(b0, b1);
+	uint8x16_t hi01 = vzip2q_u8(b0, b1);
+	if (BYTES == 2) {
+		vst1q_u8(dest, lo01);
+		vst1q_u8(dest + 16, hi01);
+		return dest + 32;
+	}
+	uint16x8_t lo23 = vreinterpretq_u16_u8(vzip1q_u8(vqtbl1q_u8(planes[2], idx), vqtbl1q_u8(planes[3], idx)));
+	uint16x8_t hi23 = vreinterpretq_u16_u8(vzip2q_u8(vqtbl1q_u8(planes[2], idx), vqtbl1q_u8(planes[3], idx)));
+	vst1q_u8(dest, vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(lo01), lo23)));
+	vst1q_u8(dest + 16, vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(lo01), lo23)));
+	vst1q_u8(dest + 32, vreinterpretq_u8_u16(vzip1q_u16(vreinterpretq_u16_u8(hi01), hi23)));
+	vst1q_u8(dest + 48, vreinterpretq_u8_u16(vzip2q_u16(vreinterpretq_u16_u8(hi01), hi23)));
+	return dest + 64;
+}
+
+template< int BITS, int BYTES >
+static inline void blit_expand_neon(uint8 * dest, const uint8 * source, uint32 length,
+									const uint32 * map, Screen_blit_simd_func tail)
+{
+	uint8x16_t planes[4];
+	if (BYTES > 1) {
+		uint8 plane_bytes[4][16];
+		build_expand_planes(map, plane_bytes);
+		for (int k = 0; k < BYTES; k++)
+			planes[k] = vld1q_u8(plane_bytes[k]);
+	}
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		uint8x16_t idx[8 / BITS];
+		split_indices_neon<BITS>(vld1q_u8(source + i), idx);
+		for (int k = 0; k < 8 / BITS; k++)
+			dest = store_pixels_neon<BYTES>(dest, idx[k], planes);
+	}
+	if (length & 15)
+		tail(dest, source + n, length & 15);
+}
+
+#define DEFINE_BLIT_EXPAND_NEON(BITS, DEPTH, MAP) \
+static void Blit_Expand_##BITS##_To_##DEPTH##_NEON(uint8 * dest, const uint8 * source, uint32 length) \
+{ \
+	blit_expand_neon<BITS, DEPTH / 8>(dest, source, length, MAP, Blit_Expand_##BITS##_To_##DEPTH); \
+}
+
+DEFINE_BLIT_EXPAND_NEON(1, 8, NULL)
+DEFINE_BLIT_EXPAND_NEON(2, 8, NULL)
+DEFINE_BLIT_EXPAND_NEON(4, 8, NULL)
+DEFINE_BLIT_EXPAND_NEON(1, 16, Blit_Mono_Map)
+DEFINE_BLIT_EXPAND_NEON(2, 16, ExpandMap)
+DEFINE_BLIT_EXPAND_NEON(4, 16, ExpandMap)
+DEFINE_BLIT_EXPAND_NEON(1, 32, Blit_Mono_Map)
+DEFINE_BLIT_EXPAND_NEON(2, 32, ExpandMap)
+DEFINE_BLIT_EXPAND_NEON(4, 32, ExpandMap)
+
+#undef DEFINE_BLIT_EXPAND_NEON
+
+static bool blit_isa_supported(int isa)
+{
+	return isa == BLIT_ISA_NEON;	// Part of the ARMv8-A base architecture
+}
+#endif
+
+// SIMD replacements of the scalar blitters, best instruction set first
+struct Screen_blit_simd_info {
+	Screen_blit_simd_func	scalar;		// Reference implementation
+	Screen_blit_simd_func	simd;		// Replacement
+	int						isa;		// Required instruction set
+	int						index_bits;	// Bits per ExpandMap index (0 = no ExpandMap)
+	const char *			name;
+};
+
+static const Screen_blit_simd_info Screen_blitters_simd[] = {
+#if VIDEO_BLIT_X86
+	{ Blit_RGB555_NBO, Blit_RGB555_NBO_AVX2, BLIT_ISA_AVX2, 0, "RGB555_NBO/AVX2" },
+	{ Blit_RGB565_NBO, Blit_RGB565_NBO_AVX2, BLIT_ISA_AVX2, 0, "RGB565_NBO/AVX2" },
+	{ Blit_RGB888_NBO, Blit_RGB888_NBO_AVX2, BLIT_ISA_AVX2, 0, "RGB888_NBO/AVX2" },
+	{ Blit_BGR888_NBO, Blit_BGR888_NBO_AVX2, BLIT_ISA_AVX2, 0, "BGR888_NBO/AVX2" },
+	{ Blit_Expand_8_To_16, Blit_Expand_8_To_16_AVX2, BLIT_ISA_AVX2, 8, "Expand_8_To_16/AVX2" },
+	{ Blit_Expand_8_To_32, Blit_Expand_8_To_32_AVX2, BLIT_ISA_AVX2, 8, "Expand_8_To_32/AVX2" },
+	{ Blit_RGB555_NBO, Blit_RGB555_NBO_SSSE3, BLIT_ISA_SSSE3, 0, "RGB555_NBO/SSSE3" },
+	{ Blit_RGB565_NBO, Blit_RGB565_NBO_SSSE3, BLIT_ISA_SSSE3, 0, "RGB565_NBO/SSSE3" },
+	{ Blit_RGB888_NBO, Blit_RGB888_NBO_SSSE3, BLIT_ISA_SSSE3, 0, "RGB888_NBO/SSSE3" },
+	{ Blit_BGR888_NBO, Blit_BGR888_NBO_SSSE3, BLIT_ISA_SSSE3, 0, "BGR888_NBO/SSSE3" },
+	{ Blit_Expand_1_To_8, Blit_Expand_1_To_8_SSSE3, BLIT_ISA_SSSE3, 1, "Expand_1_To_8/SSSE3" },
+	{ Blit_Expand_2_To_8, Blit_Expand_2_To_8_SSSE3, BLIT_ISA_SSSE3, 2, "Expand_2_To_8/SSSE3" },
+	{ Blit_Expand_4_To_8, Blit_Expand_4_To_8_SSSE3, BLIT_ISA_SSSE3, 4, "Expand_4_To_8/SSSE3" },
+	{ Blit_Expand_1_To_16, Blit_Expand_1_To_16_SSSE3, BLIT_ISA_SSSE3, 1, "Expand_1_To_16/SSSE3" },
+	{ Blit_Expand_2_To_16, Blit_Expand_2_To_16_SSSE3, BLIT_ISA_SSSE3, 2, "Expand_2_To_16/SSSE3" },
+	{ Blit_Expand_4_To_16, Blit_Expand_4_To_16_SSSE3, BLIT_ISA_SSSE3, 4, "Expand_4_To_16/SSSE3" },
+	{ Blit_Expand_1_To_32, Blit_Expand_1_To_32_SSSE3, BLIT_ISA_SSSE3, 1, "Expand_1_To_32/SSSE3" },
+	{ Blit_Expand_2_To_32, Blit_Expand_2_To_32_SSSE3, BLIT_ISA_SSSE3, 2, "Expand_2_To_32/SSSE3" },
+	{ Blit_Expand_4_To_32, Blit_Expand_4_To_32_SSSE3, BLIT_ISA_SSSE3, 4, "Expand_4_To_32/SSSE3" },
+#endif
+#if VIDEO_BLIT_NEON
+	{ Blit_RGB555_NBO, Blit_RGB555_NBO_NEON, BLIT_ISA_NEON, 0, "RGB555_NBO/NEON" },
+	{ Blit_RGB565_NBO, Blit_RGB565_NBO_NEON, BLIT_ISA_NEON, 0, "RGB565_NBO/NEON" },
+	{ Blit_RGB888_NBO, Blit_RGB888_NBO_NEON, BLIT_ISA_NEON, 0, "RGB888_NBO/NEON" },
+	{ Blit_BGR888_NBO, Blit_BGR888_NBO_NEON, BLIT_ISA_NEON, 0, "BGR888_NBO/NEON" },
+	{ Blit_Expand_1_To_8, Blit_Expand_1_To_8_NEON, BLIT_ISA_NEON, 1, "Expand_1_To_8/NEON" },
+	{ Blit_Expand_2_To_8, Blit_Expand_2_To_8_NEON, BLIT_ISA_NEON, 2, "Expand_2_To_8/NEON" },
+	{ Blit_Expand_4_To_8, Blit_Expand_4_To_8_NEON, BLIT_ISA_NEON, 4, "Expand_4_To_8/NEON" },
+	{ Blit_Expand_1_To_16, Blit_Expand_1_To_16_NEON, BLIT_ISA_NEON, 1, "Expand_1_To_16/NEON" },
+	{ Blit_Expand_2_To_16, Blit_Expand_2_To_16_NEON, BLIT_ISA_NEON, 2, "Expand_2_To_16/NEON" },
+	{ Blit_Expand_4_To_16, Blit_Expand_4_To_16_NEON, BLIT_ISA_NEON, 4, "Expand_4_To_16/NEON" },
+	{ Blit_Expand_1_To_32, Blit_Expand_1_To_32_NEON, BLIT_ISA_NEON, 1, "Expand_1_To_32/NEON" },
+	{ Blit_Expand_2_To_32, Blit_Expand_2_To_32_NEON, BLIT_ISA_NEON, 2, "Expand_2_To_32/NEON" },
+	{ Blit_Expand_4_To_32, Blit_Expand_4_To_32_NEON, BLIT_ISA_NEON, 4, "Expand_4_To_32/NEON" },
+#endif
+	{ NULL, NULL, 0, 0, NULL }
+};
+
+// Return the fastest supported replacement for a scalar blitter
+static Screen_blit_simd_func Screen_blit_simd(Screen_blit_simd_func scalar)
+{
+#if VIDEO_BLIT_X86 || VIDEO_BLIT_NEON
+	for (const Screen_blit_simd_info *p = Screen_blitters_simd; p->scalar; p++)
+		if (p->scalar == scalar && blit_isa_supported(p->isa))
+			return p->simd;
+#endif
+	return scalar;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- Blitters to the host frame buffer, or XImage buffer                --- */
 /* -------------------------------------------------------------------------- */
@@ -609,6 +1052,9 @@ bool Screen_blitter_init(VisualFormat const & visual_format, bool native_byte_or
 				visualFormat.Rshift, visualFormat.Gshift, visualFormat.Bshift);
 			abort();
 		}
+
+		// Use a SIMD version if the CPU has one
+		Screen_blit = Screen_blit_simd(Screen_blit);
 	}
 #else
 	if (use_sdl_video && 1 == mac_depth && 8 == visual_format.depth) {
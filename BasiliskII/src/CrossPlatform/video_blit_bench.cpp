@@ -0,0 +1,120 @@
+/*
+ *  video_blit_bench.cpp - Blitter microbenchmark, compares SIMD blitters
+ *                         against their scalar reference
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+// The blitters are static, so pull in the whole implementation
+#include "video_blit.cpp"
+
+#include <string.h>
+#include <sys/time.h>
+
+const uint32 MAX_LENGTH = 4096;		// Source bytes per call, about one 8-bit scanline
+const uint32 MAX_EXPAND = 32;		// 1-bit to 32-bit expansion
+const uint32 SLACK = 64;			// Guard bytes to catch overruns
+
+static uint8 src_buf[MAX_LENGTH + 16];
+static uint8 ref_buf[MAX_LENGTH * MAX_EXPAND + SLACK];
+static uint8 simd_buf[MAX_LENGTH * MAX_EXPAND + SLACK];
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Fill ExpandMap[] the way the video drivers' set_palette() does, repeating the first 2^bits entries
+static void fill_expand_map(int index_bits)
+{
+	uint32 colors[256];
+	for (int i = 0; i < 256; i++)
+		colors[i] = rand() ^ (rand() << 16);
+	int mask = index_bits ? (1 << index_bits) - 1 : 255;
+	for (int i = 0; i < 256; i++)
+		ExpandMap[i] = colors[i & mask];
+}
+
+// Fill ExpandMap[] with the gray ramp the video drivers load on a mode switch, before the first palette
+static void fill_gray_ramp(int index_bits)
+{
+	int num_in = 1 << (index_bits ? index_bits : 8);
+	for (int i = 0; i < 256; i++) {
+		uint32 c = ((i & (num_in-1)) * 255) / (num_in-1);
+		ExpandMap[i] = c * 0x01010101;
+	}
+}
+
+// Compare SIMD against scalar output for all short lengths, source alignments and some long runs
+static bool check_exact(const Screen_blit_simd_info *p, const char *map_name)
+{
+	for (uint32 length = 0; length < MAX_LENGTH; length += (length < 256 ? 1 : 509)) {
+		for (uint32 ofs = 0; ofs < 8; ofs++) {
+			memset(ref_buf, 0x55, sizeof(ref_buf));
+			memset(simd_buf, 0x55, sizeof(simd_buf));
+			p->scalar(ref_buf, src_buf + ofs, length);
+			p->simd(simd_buf, src_buf + ofs, length);
+			if (memcmp(ref_buf, simd_buf, sizeof(ref_buf)) != 0) {
+				printf("%-24s MISMATCH with %s at length %u, source offset %u\n", p->name, map_name, length, ofs);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static double time_blit(Screen_blit_simd_func func, uint32 iterations)
+{
+	double start = now();
+	for (uint32 i = 0; i < iterations; i++)
+		func(ref_buf, src_buf, MAX_LENGTH);
+	return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+	uint32 iterations = argc > 1 ? atoi(argv[1]) : 20000;
+	int failures = 0;
+
+	for (uint32 i = 0; i < sizeof(src_buf); i++)
+		src_buf[i] = rand();
+
+	printf("%-24s %8s %12s %12s %8s\n", "blitter", "exact", "scalar MB/s", "simd MB/s", "speedup");
+	for (const Screen_blit_simd_info *p = Screen_blitters_simd; p->scalar; p++) {
+		if (!blit_isa_supported(p->isa)) {
+			printf("%-24s not supported by this CPU\n", p->name);
+			continue;
+		}
+		// Bit-exactness with the gray ramp and with a palette
+		fill_gray_ramp(p->index_bits);
+		bool exact = check_exact(p, "gray ramp");
+		fill_expand_map(p->index_bits);
+		if (!check_exact(p, "palette") || !exact) {
+			failures++;
+			continue;
+		}
+
+		double t_scalar = time_blit(p->scalar, iterations);
+		double t_simd = time_blit(p->simd, iterations);
+		double mb = (double)MAX_LENGTH * iterations / (1024 * 1024);
+		printf("%-24s %8s %12.0f %12.0f %7.2fx\n", p->name, "yes", mb / t_scalar, mb / t_simd, t_scalar / t_simd);
+	}
+
+	return failures ? 1 : 0;
+}
@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #ifdef HAVE_WIN32_VM
 #define WIN32_LEAN_AND_MEAN /* avoid including junk */
 #include <windows.h>
@@ -362,6 +366,120 @@ int vm_acquire_fixed(void * addr, size_t size, int options)
 	return 0;
 }
 
+/* Map SIZE bytes of file FD starting at OFFSET copy-on-write at exactly
+   ADDR. Returns 0 if successful, -1 on errors.  */
+
+int vm_map_file_fixed(void * addr, size_t size, int fd, off_t offset)
+{
+	errno = 0;
+
+#if defined(HAVE_MMAP_VM) || (defined(HAVE_MACH_VM) && defined(HAVE_SYS_MMAN_H))
+	if (mmap((caddr_t)addr, size, VM_PAGE_DEFAULT, MAP_PRIVATE | MAP_FIXED, fd, offset) == (void *)MAP_FAILED)
+		return -1;
+	return 0;
+#else
+	// Unsupported, callers read the data instead
+	return -1;
+#endif
+}
+
+/* Replace SIZE bytes at ADDR by a copy-on-write mapping of a shared
+   memory object named after PREFIX and a hash of the contents.  */
+
+int vm_share_fixed(void * addr, size_t size, const char * prefix)
+{
+#if defined(HAVE_MMAP_VM) && defined(HAVE_SHM_OPEN)
+	// FNV-1a hash of the contents
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned char *p = (const unsigned char *)addr;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	char name[256];
+	snprintf(name, sizeof(name), "/%s-%lx-%016llx", prefix, (unsigned long)size, hash);
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		// First user, publish the contents
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd < 0 && errno == EEXIST)
+			fd = shm_open(name, O_RDONLY, 0);	// Lost the race against another instance
+		else if (fd >= 0) {
+			size_t done = 0;
+			if (ftruncate(fd, size) == 0) {
+				while (done < size) {
+					ssize_t actual = write(fd, p + done, size - done);
+					if (actual <= 0)
+						break;
+					done += actual;
+				}
+			}
+			if (done < size) {
+				shm_unlink(name);
+				close(fd);
+				return -1;
+			}
+		}
+		if (fd < 0)
+			return -1;
+	}
+
+	// Another process may still be writing the object, so compare before using it
+	bool same = false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+		void *shared = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (shared != MAP_FAILED) {
+			same = memcmp(shared, addr, size) == 0;
+			munmap(shared, size);
+		}
+	}
+	int ret = same ? vm_map_file_fixed(addr, size, fd, 0) : -1;
+	close(fd);
+	return ret;
+#else
+	// Unsupported
+	return -1;
+#endif
+}
+
+/* Allow the host to merge identical pages in the region starting at
+   ADDR and extending SIZE bytes.  */
+
+int vm_set_mergeable(void * addr, size_t size)
+{
+#if defined(HAVE_MADVISE) && defined(MADV_MERGEABLE)
+	return madvise(addr, size, MADV_MERGEABLE);
+#else
+	// Unsupported
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* Get the resident and proportional set size of the process in KB.  */
+
+int vm_get_rss(unsigned long * rss_kb, unsigned long * pss_kb)
+{
+#ifdef __linux__
+	FILE *f = fopen("/proc/self/smaps_rollup", "r");
+	if (f == NULL)
+		return -1;
+	int found = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "Rss: %lu", rss_kb) == 1)
+			found |= 1;
+		else if (sscanf(line, "Pss: %lu", pss_kb) == 1)
+			found |= 2;
+	}
+	fclose(f);
+	return found == 3 ? 0 : -1;
+#else
+	// Unsupported
+	return -1;
+#endif
+}
+
 /* Deallocate any mapping for the region starting at ADDR and extending
    LEN bytes. Returns 0 if successful, -1 on errors.  */
 
@@ -108,6 +108,33 @@ extern int vm_init_reserved(void * host_address);
 
 extern int vm_acquire_fixed(void * addr, size_t size, int options = VM_MAP_DEFAULT);
 
+/* Map SIZE bytes of file FD starting at OFFSET copy-on-write at exactly
+   ADDR (ADDR and OFFSET must be page-aligned). Pages are faulted in from
+   the file on first access, writes are never carried back to the file.
+   Returns 0 if successful, -1 on errors or if the host can't do it.  */
+
+extern int vm_map_file_fixed(void * addr, size_t size, int fd, off_t offset);
+
+/* Replace the SIZE bytes at ADDR (which must be page-aligned) by a
+   copy-on-write mapping of a shared memory object named after PREFIX and
+   a hash of the current contents. The first process creates the object,
+   later ones with identical contents share its pages. Returns 0 if
+   successful, -1 on errors (the memory is left unchanged).  */
+
+extern int vm_share_fixed(void * addr, size_t size, const char * prefix);
+
+/* Allow the host to merge pages with identical contents in the region
+   starting at ADDR and extending SIZE bytes (Linux KSM). Returns 0 if
+   successful, -1 on errors or if the host can't do it.  */
+
+extern int vm_set_mergeable(void * addr, size_t size);
+
+/* Get the resident set size of the process and its proportional set size,
+   which divides shared pages by the number of processes using them, in
+   KB. Returns 0 if successful, -1 if the host can't tell.  */
+
+extern int vm_get_rss(unsigned long * rss_kb, unsigned long * pss_kb);
+
 /* Deallocate any mapping for the region starting at ADDR and extending
    LEN bytes. Returns 0 if successful, -1 on errors.  */
 
@@ -114,6 +114,25 @@ void extfs_exit(void)
 }
 
 
+/*
+ *  Write back cached data
+ */
+
+void extfs_flush(void)
+{
+}
+
+
+/*
+ *  Get file/directory status
+ */
+
+int extfs_stat(const char *path, struct stat *st)
+{
+	return stat(path, st);
+}
+
+
 /*
  *  Add component to path name
  */
@@ -65,6 +65,7 @@
 #include "video_defs.h"
 #include "video_blit.h"
 #include "vm_alloc.h"
+#include "profiler.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -731,10 +732,14 @@ void driver_base::adapt_to_video_mode() {
 	visualFormat.Bmask = f->Bmask;
 	Screen_blitter_init(visualFormat, true, mac_depth_of_video_depth(VIDEO_MODE_DEPTH));
 
-	// Load gray ramp to 8->16/32 expand map
-	if (!IsDirectMode(mode))
-		for (int i=0; i<256; i++)
-			ExpandMap[i] = SDL_MapRGB(f, i, i, i);
+	// Load gray ramp to 8->16/32 expand map (like the palette, it repeats the first 2^depth entries)
+	if (!IsDirectMode(mode)) {
+		int num_in = 1 << mac_depth_of_video_depth(VIDEO_MODE_DEPTH);
+		for (int i=0; i<256; i++) {
+			int c = ((i & (num_in-1)) * 255) / (num_in-1);
+			ExpandMap[i] = SDL_MapRGB(f, c, c, c);
+		}
+	}
 
 
 	bool hardware_cursor = false;
@@ -1339,7 +1344,11 @@ void VideoVBL(void)
 void VideoInterrupt(void)
 {
 	// We must fill in the events queue in the same thread that did call SDL_SetVideoMode()
+	// (does nothing if SDL was initialized with SDL_INIT_EVENTTHREAD)
+	const uint64 profiler_start = ProfilerActive ? ProfilerClock() : 0;
 	SDL_PumpEvents();
+	if (profiler_start && ProfilerActive)
+		ProfilerHandler(PROFILER_HOST | PROFILER_HOST_EVENTS, profiler_start);
 
 	// Emergency quit requested? Then quit
 	if (emerg_quit)
@@ -9,8 +9,10 @@
 
 #include "sysdeps.h"
 #include "spcflags.h"
+#include "profiler.h"
 extern int quit_program;
-extern uint32_t ROMBaseMac;
+extern uint32_t ROMBaseMac, ROMSize;
+extern uint32_t ATrapOSReturn;
 int m68k_do_specialties(void);
 void m68k_execute(void);
 void m68k_emulop(uint32_t);
@@ -407,6 +409,10 @@ template<int RW, int M, int S, typename F> Tiny68020::u32 Tiny68020::ea(int reg,
 	return adr;
 }
 
+// not inline: ea<> is only defined in this file
+void Tiny68020::addqa(u16 op) { ea<3, 1, 2>(op, [&](u32 v) { return v + ((op >> 9) - 1 & 7) + 1; }); }
+void Tiny68020::subq_a(u16 op) { ea<3, 1, 2>(op, [&](u32 v) { return v - ((op >> 9) - 1 & 7) - 1; }); }
+
 template<int M, int S> void Tiny68020::movem_rm(u16 op) {
 	const u32 ofs = S << 1, list = fetch2();
 	u32 i, adr = ea<0, M, S>(op, []{});
@@ -684,12 +690,14 @@ void Tiny68020::Trap(u32 vector, u32 param) {
 }
 
 void Tiny68020::Execute() {
+	extern void ICountService(); // BasiliskII
 	do {
 #if TINY68020_TRACE
 		tracep->pc = pc;
 		tracep->index = 0;
 #endif
 		Insn::exec1(this, fetch2());
+		if (++insn_count >= insn_deadline) { insn_deadline = ~0ULL; ICountService(); } // BasiliskII
 #if TINY68020_TRACE
 		tracep->ccr = sr;
 #if TINY68020_TRACE > 1
@@ -827,7 +835,7 @@ void Tiny68020::undef(u16 op) {
 void Tiny68020::importRegs(M68kRegisters &r) {
 	memcpy(d, r.d, sizeof(d));
 	memcpy(a, r.a, sizeof(a));
-	SetSR(r.sr);
+	if (r.sr != sr || r.sr & MT) SetSR(r.sr);
 }
 
 void Tiny68020::exportRegs(M68kRegisters &r) {
@@ -836,13 +844,68 @@ void Tiny68020::exportRegs(M68kRegisters &r) {
 	r.sr = sr;
 }
 
+void Tiny68020::GetState(State &s) const {
+	memcpy(s.a, a, sizeof(a));
+	memcpy(s.d, d, sizeof(d));
+	memcpy(s.cr, cr, sizeof(cr));
+	s.pc = pc;
+	s.trace_pc = trace_pc;
+	s.sr = sr;
+}
+
+void Tiny68020::SetState(const State &s) {
+	memcpy(a, s.a, sizeof(a));
+	memcpy(d, s.d, sizeof(d));
+	memcpy(cr, s.cr, sizeof(cr));
+	pc = s.pc;
+	trace_pc = s.trace_pc;
+	sr = s.sr;
+}
+
+void Tiny68020::a_line(u16 op) {
+	if (ProfilerActive) ProfilerTrap(op);
+	if (ATrapOSReturn && a_line_native(op)) return;
+	pc -= 2;
+	Trap(10);
+}
+
+// Dispatch a trap through the OS/Toolbox trap tables like the ROM's A-line
+// handler, without the exception frame. Returns false to take the ROM path
+// in user or trace mode, when the A-line vector doesn't point into ROM
+// (debugger installed), or for an empty table entry.
+bool Tiny68020::a_line_native(u16 op) {
+	if ((sr & (MS | MM | MT)) != MS || get4(cr[CR_VBR] + (10 << 2)) - ROMBaseMac >= ROMSize) return false;
+	if (op & 0x800) { // Toolbox trap: routine returns to the caller, or to the caller's caller (auto-pop)
+		u32 adr = get4(0xe00 + ((op & 0x3ff) << 2));
+		if (!adr || adr & 1) return false;
+		if (!(op & 0x400)) push4(pc);
+		pc = adr;
+	}
+	else { // OS trap: save D1-D2/A1 (and A0 unless bit 8 set), trap word in D1.W
+		u32 adr = get4(0x400 + ((op & 0xff) << 2));
+		if (!adr || adr & 1) return false;
+		push4(pc);
+		push4(a[1]);
+		if (!(op & 0x100)) push4(a[0]);
+		push4(d[2]);
+		push4(d[1]);
+		push4(op & 0x100 ? ATrapOSReturn + 8 : ATrapOSReturn);
+		d[1] = (d[1] & 0xffff0000) | op;
+		pc = adr;
+	}
+	return true;
+}
+
 void Tiny68020::emulop(u16 op) {
 	if (op & 0xff) m68k_emulop(op);
 	else m68k_emulop_return();
 }
 
 void Tiny68020::execsub(u32 v, M68kRegisters &r, bool isTrap) {
-	u32 oldpc = pc;
+	// the caller may be an EMUL_OP handler working on RegsView()
+	u32 oldpc = pc, oldd[8], olda[7];
+	memcpy(oldd, d, sizeof(oldd));
+	memcpy(olda, a, sizeof(olda));
 	memcpy(d, r.d, sizeof(d));
 	memcpy(a, r.a, sizeof(a) - sizeof(a[0]));
 	push2(0x7100);
@@ -855,6 +918,8 @@ void Tiny68020::execsub(u32 v, M68kRegisters &r, bool isTrap) {
 	pc = oldpc;
 	memcpy(r.d, d, sizeof(d));
 	memcpy(r.a, a, sizeof(a) - sizeof(a[0]));
+	memcpy(d, oldd, sizeof(oldd));
+	memcpy(a, olda, sizeof(olda));
 	quit_program = 0;
 }
 
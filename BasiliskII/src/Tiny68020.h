@@ -58,6 +58,8 @@ public:
 	void Execute();
 	u32 GetPC() const { return pc; }
 	void SetPC(u32 v) { pc = v; }
+	u64 GetInsnCount() const { return insn_count; } // BasiliskII
+	void SetInsnDeadline(u64 n) { insn_deadline = n; } // BasiliskII
 	void Trace() { Trap(9, trace_pc); }
 	void IRQ(int level) {
 		if ((level &= 7) < 7 && level <= (sr >> LI & 7)) return;
@@ -69,7 +71,22 @@ public:
 #endif
 	void importRegs(M68kRegisters &r);
 	void exportRegs(M68kRegisters &r);
+	// d, a and sr are laid out like M68kRegisters without UPDATE_UAE
+	M68kRegisters *RegsView() { return reinterpret_cast<M68kRegisters *>(d); }
+	u16 GetSR() const { return sr; }
+	void UpdateSR(u16 old) {
+		if (sr == old && !(sr & MT)) return;
+		u16 t = sr;
+		sr = old;
+		SetSR(t);
+	}
 	void execsub(u32 v, M68kRegisters &r, bool isTrap);
+	struct State {
+		u32 a[8], d[8], cr[16], pc, trace_pc;
+		u16 sr;
+	};
+	void GetState(State &s) const;
+	void SetState(const State &s);
 private:
 	template<int S> void stD(u32 n, u32 data) {
 		if constexpr (S == 0) d[n] = (d[n] & 0xffffff00) | (data & 0xff);
@@ -145,10 +162,12 @@ private:
 	template<int C> int cond();
 	int X() const { return (sr & MX) != 0; }
 	u8 *m;
-	u32 a[8], d[8];
+	u32 d[8], a[8];
 	u16 sr;
 	u32 cr[16];
 	u32 pc, trace_pc;
+	u64 insn_count = 0; // BasiliskII
+	u64 insn_deadline = 0; // BasiliskII: ICountService() is called when insn_count reaches it
 #if TINY68020_TRACE
 	static constexpr int TRACEMAX = 10000;
 	static constexpr int ACSMAX = 32;
@@ -228,7 +247,7 @@ private:
 	template<int M, int S> void addq(u16 op) { // addq #<data>,<ea>
 		ea<3, M, S>(op, [&](u32 v) { u32 t = ((op >> 9) - 1 & 7) + 1; return fadd<S>(v + t, t, v); });
 	}
-	void addqa(u16 op) { ea<3, 1, 2>(op, [&](u32 v) { return v + ((op >> 9) - 1 & 7) + 1; }); } // addq #<data>,An
+	void addqa(u16 op); // addq #<data>,An
 	template<int S> void addx_m(u16 op) { // addx -(Ay),-(Ax)
 		u32 s = ld<S>(a[R0] -= 1 << S), v = ld<S>(a[R9] -= 1 << S); st<S>(a[R9], faddx<S>(v + s + X(), s, v));
 	}
@@ -247,7 +266,7 @@ private:
 	template<int M, int S> void subq(u16 op) { // subq #<data>,<ea>
 		ea<3, M, S>(op, [&](u32 v) { u32 t = ((op >> 9) - 1 & 7) + 1; return fsub<S>(v - t, t, v); });
 	}
-	void subq_a(u16 op) { ea<3, 1, 2>(op, [&](u32 v) { return v - ((op >> 9) - 1 & 7) - 1; }); } // subq #<data>,An
+	void subq_a(u16 op); // subq #<data>,An
 	template<int S> void subx_m(u16 op) { // subx -(Ay),-(Ax)
 		u32 s = ld<S>(a[R0] -= 1 << S), v = ld<S>(a[R9] -= 1 << S); st<S>(a[R9], fsubx<S>(v - s - X(), s, v));
 	}
@@ -386,7 +405,8 @@ private:
 	}
 	void undef(u16);
 	void reset(u16) { fprintf(stderr, "RESET instruction\n"); }
-	void a_line(u16) { pc -= 2; Trap(10); }
+	void a_line(u16); // BasiliskII
+	bool a_line_native(u16); // BasiliskII
 	void f_line(u16 op) { pc -= 2; Trap(11); fprintf(stderr, "F-line trap: %04x\n", op); } // CINV,cp*,CPUSH,FPinst,MOVE16
 	void nop(u16) {}
 	template <int M, int S> void cas(u16 op);
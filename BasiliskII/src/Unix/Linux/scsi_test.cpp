@@ -0,0 +1,275 @@
+/*
+ *  scsi_test.cpp - SCSI Manager test against a file-backed fake SG device
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The Linux SG driver and the SCSI Manager are built in, with read(),
+ *  write() and ioctl() of the driver redirected to a fake SG v2 device that
+ *  serves READ(10)/WRITE(10) from a plain file with a fixed delay per
+ *  command. The test issues commands the way the Mac does and checks the
+ *  data, that SCSIComplete() returns SCSI_COMPLETE_PENDING while the
+ *  device is busy, and that SCSIReset() waits for a running command.
+ *
+ *  Usage: scsi_test [delay ms]
+ */
+
+#include "sysdeps.h"
+#include <sys/ioctl.h>
+#include <linux/../scsi/sg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+#include <algorithm>
+
+// Redirect the driver's device access
+static ssize_t fake_read(int fd, void *buf, size_t len);
+static ssize_t fake_write(int fd, const void *buf, size_t len);
+static int fake_ioctl(int fd, unsigned long req, ...);
+#define read fake_read
+#define write fake_write
+#define ioctl fake_ioctl
+
+// Pull in the SCSI Manager and the Linux driver
+#include "../../scsi.cpp"
+#undef DEBUG
+#include "scsi_linux.cpp"
+
+#undef read
+#undef write
+#undef ioctl
+
+// Glue
+uintptr MEMBaseDiff;
+static char device_path[256];
+const char *PrefsFindString(const char *name, int index) { return strcmp(name, "scsi2") == 0 ? device_path : NULL; }
+const char *GetString(int num) { return "SCSI driver message"; }
+void ErrorAlert(const char *text) { printf("ERROR: %s\n", text); }
+void WarningAlert(const char *text) { printf("WARNING: %s\n", text); }
+
+// Mac memory layout
+const uint32 MEM_SIZE = 0x100000;
+const uint32 TIB = 0x1000;
+const uint32 MESSAGE = 0x1100;
+const uint32 STATUS = 0x1102;
+const uint32 BUFFER = 0x10000;			// Data buffer, two halves for S/G
+
+static uint8 *mem;
+static int device_fd = -1;				// Backing file, as opened by SCSIInit()
+static int delay_ms = 20;				// Time the fake device takes per command
+
+
+/*
+ *  Fake SG v2 device
+ */
+
+static uint8 reply[sizeof(sg_header) + 0x20000];
+static size_t reply_len;
+
+static ssize_t fake_write(int fd, const void *buf, size_t len)
+{
+	device_fd = fd;
+	const sg_header *h = (const sg_header *)buf;
+	const uint8 *cmd = (const uint8 *)buf + sizeof(sg_header);
+	int cmd_len = h->twelve_byte ? 12 : cmd[0] < 0x20 ? 6 : 10;
+	const uint8 *data = cmd + cmd_len;
+
+	sg_header *r = (sg_header *)reply;
+	memcpy(r, h, sizeof(sg_header));
+	r->result = 0;
+	r->target_status = 0;
+	reply_len = sizeof(sg_header);
+
+	usleep(delay_ms * 1000);
+	uint32 lba = cmd[2] << 24 | cmd[3] << 16 | cmd[4] << 8 | cmd[5];
+	uint32 bytes = (cmd[7] << 8 | cmd[8]) * 512;
+	switch (cmd[0]) {
+		case 0x00:		// TEST UNIT READY
+			break;
+		case 0x28:		// READ(10)
+			if (bytes > sizeof(reply) - sizeof(sg_header) || pread(fd, reply + sizeof(sg_header), bytes, lba * 512) != (ssize_t)bytes)
+				r->result = EIO;
+			reply_len += bytes;
+			break;
+		case 0x2a:		// WRITE(10)
+			if (pwrite(fd, data, bytes, lba * 512) != (ssize_t)bytes)
+				r->result = EIO;
+			break;
+		default:
+			r->target_status = 1;		// CHECK CONDITION
+			break;
+	}
+	return len;
+}
+
+static ssize_t fake_read(int fd, void *buf, size_t len)
+{
+	if (reply_len == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+	len = std::min(len, reply_len);
+	memcpy(buf, reply, len);
+	reply_len = 0;
+	return len;
+}
+
+static int fake_ioctl(int fd, unsigned long req, ...)
+{
+	return 0;		// SG_GET_TIMEOUT, SG_SET_TIMEOUT, SG_NEXT_CMD_LEN
+}
+
+
+/*
+ *  Test
+ */
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static int errors = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%-52s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		errors++;
+}
+
+// Build a TIB moving len bytes to/from BUFFER in two S/G pieces
+static void build_tib(uint32 len)
+{
+	uint32 t = TIB;
+	WriteMacInt16(t, scNoInc); WriteMacInt32(t + 2, BUFFER); WriteMacInt32(t + 6, len / 2); t += 10;
+	WriteMacInt16(t, scNoInc); WriteMacInt32(t + 2, BUFFER + 0x40000); WriteMacInt32(t + 6, len / 2); t += 10;
+	WriteMacInt16(t, scStop); WriteMacInt32(t + 2, 0); WriteMacInt32(t + 6, 0);
+}
+
+// Start a READ(10)/WRITE(10) of blocks at lba, up to the first SCSIComplete() call
+static int16 start_cmd(bool write, uint32 lba, uint16 blocks, int16 &err)
+{
+	uint8 cmd[10] = {uint8(write ? 0x2a : 0x28), 0, uint8(lba >> 24), uint8(lba >> 16), uint8(lba >> 8), uint8(lba), 0, uint8(blocks >> 8), uint8(blocks), 0};
+	if ((err = SCSIGet()) != 0 || (err = SCSISelect(2)) != 0 || (err = SCSICmd(10, cmd)) != 0)
+		return err;
+	build_tib(blocks * 512);
+	if ((err = write ? SCSIWrite(TIB) : SCSIRead(TIB)) != 0)
+		return err;
+	return err = SCSIComplete(60, MESSAGE, STATUS);
+}
+
+// Run a command to completion, counting the times the Mac gets to run meanwhile
+static int16 run_cmd(bool write, uint32 lba, uint16 blocks, int &polls)
+{
+	int16 err;
+	polls = 0;
+	start_cmd(write, lba, blocks, err);
+	while (err == SCSI_COMPLETE_PENDING) {
+		polls++;		// Interrupts would be handled here
+		err = SCSIComplete(60, MESSAGE, STATUS);
+	}
+	return err;
+}
+
+static void fill(uint32 lba, uint16 blocks, uint8 seed)
+{
+	uint8 *p1 = Mac2HostAddr(BUFFER), *p2 = Mac2HostAddr(BUFFER + 0x40000);
+	uint32 half = blocks * 256;
+	for (uint32 i = 0; i < blocks * 512; i++)
+		(i < half ? p1[i] : p2[i - half]) = (lba * 512 + i) * 7 + seed;
+}
+
+static bool compare(uint32 lba, uint16 blocks, uint8 seed)
+{
+	uint8 *p1 = Mac2HostAddr(BUFFER), *p2 = Mac2HostAddr(BUFFER + 0x40000);
+	uint32 half = blocks * 256;
+	for (uint32 i = 0; i < blocks * 512; i++)
+		if ((i < half ? p1[i] : p2[i - half]) != uint8((lba * 512 + i) * 7 + seed))
+			return false;
+	return true;
+}
+
+static bool file_matches(uint32 lba, uint16 blocks, uint8 seed)
+{
+	std::vector<uint8> b(blocks * 512);
+	if (pread(device_fd, &b[0], b.size(), lba * 512) != (ssize_t)b.size())
+		return false;
+	for (uint32 i = 0; i < b.size(); i++)
+		if (b[i] != uint8((lba * 512 + i) * 7 + seed))
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		delay_ms = atoi(argv[1]);
+	mem = new uint8[MEM_SIZE];
+	memset(mem, 0, MEM_SIZE);
+	MEMBaseDiff = (uintptr)mem;
+
+	// Backing file of the fake device
+	strcpy(device_path, "/tmp/scsi_test.XXXXXX");
+	int fd = mkstemp(device_path);
+	if (fd < 0 || ftruncate(fd, 1024 * 1024) < 0) {
+		perror(device_path);
+		return 1;
+	}
+	close(fd);
+	SCSIInit();
+
+	int polls;
+	double start = now();
+	fill(100, 64, 1);
+	int16 err = run_cmd(true, 100, 64, polls);
+	double t = now() - start;
+	char msg[256];
+	sprintf(msg, "WRITE(10) 64 blocks, %d polls in %.1f ms", polls, t * 1e3);
+	check(err == 0 && ReadMacInt16(STATUS) == 0 && file_matches(100, 64, 1), msg);
+#ifdef USE_SCSI_THREAD
+	check(delay_ms < 10 || polls >= delay_ms / 4, "Mac runs while the device is busy");
+#endif
+
+	Mac_memset(BUFFER, 0, 0x80000);
+	err = run_cmd(false, 100, 64, polls);
+	check(err == 0 && ReadMacInt16(STATUS) == 0 && compare(100, 64, 1), "READ(10) into two S/G pieces");
+
+	check(SCSIMgrBusy() == 0 && SCSIGet() == 0 && SCSISelect(3) == scCommErr, "Absent target");
+
+	// Reset while a command is running
+	fill(300, 128, 2);
+	start_cmd(true, 300, 128, err);
+	bool pending = err == SCSI_COMPLETE_PENDING;
+	SCSIReset();
+	check((!pending || SCSIMgrBusy() == 0) && file_matches(300, 128, 2), "SCSIReset() waits for the running command");
+
+	// Nothing may be left running
+	err = run_cmd(false, 300, 128, polls);
+	check(err == 0 && compare(300, 128, 2), "Command after reset");
+
+	SCSIExit();
+	unlink(device_path);
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
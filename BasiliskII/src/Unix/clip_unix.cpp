@@ -273,6 +273,10 @@ void ClipInit(void)
 {
 	no_clip_conversion = PrefsFindBool("noclipconversion");
 
+	// No clipboard without a display
+	if (x_display == NULL)
+		return;
+
 	// Find screen and root window
 	screen = XDefaultScreen(x_display);
 	rootwin = XRootWindow(x_display, screen);
@@ -312,7 +316,7 @@ void PutScrap(uint32 type, void *scrap, int32 length)
 		we_put_this_data = false;
 		return;
 	}
-	if (length <= 0)
+	if (length <= 0 || !clip_win)
 		return;
 
 	XDisplayLock();
@@ -390,6 +394,8 @@ void ZeroScrap()
 void GetScrap(void **handle, uint32 type, int32 offset)
 {
 	D(bug("GetScrap handle %p, type %08x, offset %d\n", handle, type, offset));
+	if (!clip_win)
+		return;
 
 	XDisplayLock();
 	do_getscrap(handle, type, offset);
@@ -0,0 +1,186 @@
+/*
+ *  cow_test.cpp - Copy-on-write overlay test against a reference buffer
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Random writes go to an overlay and to an in-memory copy of the disk,
+ *  every read is compared against the copy. This is repeated through a
+ *  second, chained overlay, which is then committed into the first one,
+ *  which is finally discarded. The base image must not change until the
+ *  commit. Damaged headers and cluster maps must be refused.
+ *
+ *  Usage: cow_test [directory]
+ */
+
+#include "disk_cow.cpp"
+
+static int errors = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%-52s %s\n", what, ok ? "ok" : "FAILED");
+	if (!ok)
+		errors++;
+}
+
+static disk_generic *open_disk(const std::string &path, bool read_only = false)
+{
+	disk_generic *disk = NULL;
+	if (disk_cow_factory(path.c_str(), read_only, &disk) != disk_generic::DISK_VALID)
+		return NULL;
+	return disk;
+}
+
+static bool read_file(const std::string &path, std::vector<uint8> &data)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+	fseek(f, 0, SEEK_END);
+	data.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	bool ok = fread(&data[0], 1, data.size(), f) == data.size();
+	fclose(f);
+	return ok;
+}
+
+static bool write_file(const std::string &path, const std::vector<uint8> &data)
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+	return fclose(f) == 0 && ok;
+}
+
+// Random writes and reads, some crossing clusters and the end of the disk
+static bool random_io(disk_generic *disk, std::vector<uint8> &ref, int ops)
+{
+	bool ok = disk->size() == (loff_t)ref.size();
+	std::vector<uint8> buf(200000);
+	for (int i = 0; ok && i < ops; i++) {
+		size_t len = 1 + rand() % (rand() & 1 ? 512 : buf.size());
+		loff_t ofs = rand() % (ref.size() + 1000);
+		size_t expected = ofs >= (loff_t)ref.size() ? 0 : std::min(len, (size_t)(ref.size() - ofs));
+		if (rand() % 3) {
+			for (size_t j = 0; j < len; j++)
+				buf[j] = rand();
+			ok = disk->write(&buf[0], ofs, len) == expected;
+			if (expected)
+				memcpy(&ref[ofs], &buf[0], expected);
+		} else
+			ok = disk->read(&buf[0], ofs, len) == expected && memcmp(&buf[0], &ref[ofs], expected) == 0;
+	}
+	return ok;
+}
+
+static bool matches(disk_generic *disk, const std::vector<uint8> &ref)
+{
+	std::vector<uint8> buf(ref.size());
+	return disk && disk->read(&buf[0], 0, buf.size()) == buf.size() && buf == ref;
+}
+
+// Overwrite 8 bytes of a file
+static void patch64(const std::string &path, loff_t offset, uint64 v)
+{
+	uint8 b[8];
+	put_be64(b, v);
+	int fd = open(path.c_str(), O_WRONLY);
+	pwrite_all(fd, b, 8, offset);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	std::string dir = argc > 1 ? argv[1] : "/tmp";
+	char name[64];
+	snprintf(name, sizeof(name), "/cow_test.%d", (int)getpid());
+	std::string base = dir + name + ".base", top = dir + name + ".top", top2 = dir + name + ".top2";
+	srand(1);
+
+	// Base image whose size is not a multiple of the cluster size
+	std::vector<uint8> orig(3 * 1024 * 1024 + 1000);
+	for (size_t i = 0; i < orig.size(); i++)
+		orig[i] = rand();
+	check(write_file(base, orig), "Create base image");
+	const char *base_name = strrchr(base.c_str(), '/') + 1;
+	std::vector<uint8> ref = orig, data;
+
+	// One overlay
+	check(disk_cow_create(top.c_str(), base_name, 64 * 1024), "Create overlay with relative base path");
+	disk_generic *disk = open_disk(top);
+	check(disk && random_io(disk, ref, 3000), "Random I/O through overlay");
+	delete disk;
+	disk = open_disk(top);
+	check(matches(disk, ref), "Contents after reopening");
+	delete disk;
+	check(read_file(base, data) && data == orig, "Base image unchanged");
+
+	// Chained overlay, committed into the first one
+	std::vector<uint8> ref1 = ref;
+	check(disk_cow_create(top2.c_str(), strrchr(top.c_str(), '/') + 1, 4096), "Create chained overlay");
+	disk = open_disk(top2);
+	check(disk && random_io(disk, ref, 3000), "Random I/O through chained overlay");
+	delete disk;
+	disk = open_disk(top);
+	check(matches(disk, ref1), "First overlay unchanged");
+	delete disk;
+	check(disk_cow_commit(top2.c_str()), "Commit chained overlay");
+	disk = open_disk(top);
+	check(matches(disk, ref), "First overlay has the committed data");
+	delete disk;
+	disk = open_disk(top2);
+	check(matches(disk, ref), "Chained overlay empty after commit");
+	delete disk;
+
+	// Discard
+	check(disk_cow_discard(top.c_str()), "Discard first overlay");
+	disk = open_disk(top);
+	check(matches(disk, orig), "Discarded overlay reads the base image");
+	delete disk;
+	check(read_file(base, data) && data == orig, "Base image unchanged");
+
+	// Damaged overlays, open must fail instead of trusting the header
+	disk = open_disk(top);
+	std::vector<uint8> buf(65536, 0x55);
+	disk->write(&buf[0], 0, buf.size());
+	delete disk;
+	check(read_file(top, data), "Save overlay");
+	patch64(top, 16, 1ULL << 60);
+	check(open_disk(top) == NULL, "Refuse huge disk size");
+	write_file(top, data);
+	patch64(top, 24, data.size() + 4096);
+	check(open_disk(top) == NULL, "Refuse cluster map beyond end of file");
+	write_file(top, data);
+	patch64(top, COW_HEADER_SIZE, data.size() + 65536);
+	check(open_disk(top) == NULL, "Refuse map entry beyond end of file");
+	write_file(top, data);
+	patch64(top, COW_HEADER_SIZE, 512);
+	check(open_disk(top) == NULL, "Refuse map entry inside the header");
+	write_file(top, data);
+	disk = open_disk(top);
+	check(disk && disk->read(&buf[0], 0, buf.size()) == buf.size() && buf[0] == 0x55, "Intact overlay still opens");
+	delete disk;
+
+	unlink(base.c_str());
+	unlink(top.c_str());
+	unlink(top2.c_str());
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
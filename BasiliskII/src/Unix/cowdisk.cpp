@@ -0,0 +1,53 @@
+/*
+ *  cowdisk.cpp - Create, commit and discard copy-on-write overlay disks
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "sysdeps.h"
+#include "disk_unix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(const char *prg)
+{
+	fprintf(stderr, "Usage: %s create OVERLAY BASE [CLUSTER_KB]\n", prg);
+	fprintf(stderr, "       %s commit OVERLAY\n", prg);
+	fprintf(stderr, "       %s discard OVERLAY\n", prg);
+	fprintf(stderr, "BASE is a raw image or another overlay, a relative path is relative to OVERLAY.\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+		usage(argv[0]);
+
+	bool ok;
+	if (strcmp(argv[1], "create") == 0 && (argc == 4 || argc == 5)) {
+		uint32 cluster_kb = argc == 5 ? atoi(argv[4]) : 64;
+		ok = disk_cow_create(argv[2], argv[3], cluster_kb * 1024);
+	} else if (strcmp(argv[1], "commit") == 0 && argc == 3)
+		ok = disk_cow_commit(argv[2]);
+	else if (strcmp(argv[1], "discard") == 0 && argc == 3)
+		ok = disk_cow_discard(argv[2]);
+	else
+		usage(argv[0]);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,540 @@
+/*
+ *  disk_cow.cpp - Copy-on-write overlay over a read-only base image
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  An overlay file holds the clusters of a disk that were written since
+ *  it was created, everything else is read from the base image. The base
+ *  is a raw image or another overlay, so overlays can be chained; it is
+ *  never written, except by disk_cow_commit().
+ *
+ *  Layout of the overlay file (all numbers big-endian):
+ *       0     8  magic "B2COWDSK"
+ *       8     4  version (1)
+ *      12     4  cluster size in bytes (power of two, at least 512)
+ *      16     8  disk size in bytes
+ *      24     8  file offset of cluster map (COW_HEADER_SIZE)
+ *      32  1024  path of base image, relative to the overlay's directory
+ *                unless absolute, NUL-terminated
+ *  The map has one 64-bit entry per cluster, the file offset of the
+ *  cluster's data or 0 if it's still in the base image. Cluster data
+ *  starts at the first cluster boundary after the map, new clusters are
+ *  appended to the file.
+ */
+
+#include "sysdeps.h"
+#include "disk_unix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define DEBUG 0
+#include "debug.h"
+
+static const char COW_MAGIC[8] = {'B', '2', 'C', 'O', 'W', 'D', 'S', 'K'};
+static const uint32 COW_VERSION = 1;
+static const uint32 COW_HEADER_SIZE = 4096;
+static const uint32 COW_PATH_OFFSET = 32;
+static const uint32 COW_PATH_SIZE = 1024;
+static const int COW_MAX_CHAIN = 16;		// Maximum number of chained overlays
+
+static uint32 get_be32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64 get_be64(const uint8 *p)
+{
+	return ((uint64)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+static void put_be32(uint8 *p, uint32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put_be64(uint8 *p, uint64 v)
+{
+	put_be32(p, v >> 32);
+	put_be32(p + 4, v);
+}
+
+// Read/write exactly len bytes at offset
+static bool pread_all(int fd, void *buf, size_t len, loff_t offset)
+{
+	uint8 *b = (uint8 *)buf;
+	while (len) {
+		ssize_t actual = pread(fd, b, len, offset);
+		if (actual < 0 && errno == EINTR)
+			continue;
+		if (actual <= 0)
+			return false;
+		b += actual;
+		offset += actual;
+		len -= actual;
+	}
+	return true;
+}
+
+static bool pwrite_all(int fd, const void *buf, size_t len, loff_t offset)
+{
+	const uint8 *b = (const uint8 *)buf;
+	while (len) {
+		ssize_t actual = pwrite(fd, b, len, offset);
+		if (actual < 0 && errno == EINTR)
+			continue;
+		if (actual <= 0)
+			return false;
+		b += actual;
+		offset += actual;
+		len -= actual;
+	}
+	return true;
+}
+
+
+/*
+ *  Layer of an overlay chain
+ */
+
+struct disk_cow_layer : disk_generic {
+	// Write everything to stable storage
+	virtual bool sync() = 0;
+};
+
+
+/*
+ *  Raw base image
+ */
+
+struct disk_cow_raw : disk_cow_layer {
+	disk_cow_raw(int fd, bool read_only, loff_t size)
+	: fd(fd), read_only(read_only), file_size(size) { }
+
+	virtual ~disk_cow_raw() { close(fd); }
+	virtual bool is_read_only() { return read_only; }
+	virtual loff_t size() { return file_size; }
+
+	virtual size_t read(void *buf, loff_t offset, size_t length) {
+		return pread_all(fd, buf, length, offset) ? length : 0;
+	}
+
+	virtual size_t write(void *buf, loff_t offset, size_t length) {
+		if (read_only)
+			return 0;
+		return pwrite_all(fd, buf, length, offset) ? length : 0;
+	}
+
+	virtual bool sync() { return fsync(fd) == 0; }
+
+protected:
+	int fd;
+	bool read_only;
+	loff_t file_size;
+};
+
+
+/*
+ *  Overlay
+ */
+
+struct disk_cow : disk_cow_layer {
+	disk_cow(int fd, bool read_only, disk_cow_layer *base, loff_t size,
+		uint32 cluster_size, loff_t map_offset, std::vector<uint64> &map, loff_t alloc)
+	: fd(fd), read_only(read_only), base(base), disk_size(size),
+		cluster_size(cluster_size), map_offset(map_offset), alloc(alloc) {
+		this->map.swap(map);
+	}
+
+	virtual ~disk_cow() {
+		close(fd);
+		delete base;
+	}
+
+	virtual bool is_read_only() { return read_only; }
+	virtual loff_t size() { return disk_size; }
+	virtual bool sync() { return fsync(fd) == 0; }
+
+	virtual size_t read(void *buf, loff_t offset, size_t length) {
+		uint8 *b = (uint8 *)buf;
+		size_t done = 0;
+		while (done < length && offset < disk_size) {
+			uint64 cluster = offset / cluster_size;
+			uint32 start = offset % cluster_size;
+			size_t segment = std::min((size_t)(cluster_size - start), length - done);
+			if ((loff_t)segment > disk_size - offset)	// Last cluster may extend beyond the disk
+				segment = disk_size - offset;
+			if (map[cluster]) {
+				if (!pread_all(fd, b, segment, map[cluster] + start))
+					break;
+			} else if (!read_base(b, offset, segment))
+				break;
+			b += segment;
+			offset += segment;
+			done += segment;
+		}
+		return done;
+	}
+
+	virtual size_t write(void *buf, loff_t offset, size_t length) {
+		if (read_only)
+			return 0;
+		uint8 *b = (uint8 *)buf;
+		size_t done = 0;
+		while (done < length && offset < disk_size) {
+			uint64 cluster = offset / cluster_size;
+			uint32 start = offset % cluster_size;
+			size_t segment = std::min((size_t)(cluster_size - start), length - done);
+			if ((loff_t)segment > disk_size - offset)	// Last cluster may extend beyond the disk
+				segment = disk_size - offset;
+			if (map[cluster] == 0) {
+				if (!alloc_cluster(cluster, b, start, segment))
+					break;
+			} else if (!pwrite_all(fd, b, segment, map[cluster] + start))
+				break;
+			b += segment;
+			offset += segment;
+			done += segment;
+		}
+		return done;
+	}
+
+	// Number of clusters
+	uint64 num_clusters() { return map.size(); }
+
+	// File offset of cluster data, 0 = in base image
+	uint64 cluster_offset(uint64 cluster) { return map[cluster]; }
+
+	uint32 get_cluster_size() { return cluster_size; }
+	int get_fd() { return fd; }
+
+protected:
+	int fd;
+	bool read_only;
+	disk_cow_layer *base;
+	loff_t disk_size;
+	uint32 cluster_size;
+	loff_t map_offset;
+	std::vector<uint64> map;	// In-memory copy of the cluster map
+	loff_t alloc;				// File offset of next new cluster
+
+	// Read from base image, the part beyond its end reads as zeroes
+	bool read_base(uint8 *buf, loff_t offset, size_t length) {
+		loff_t base_size = base->size();
+		size_t avail = offset >= base_size ? 0 : (size_t)std::min((loff_t)length, base_size - offset);
+		if (avail && base->read(buf, offset, avail) != avail)
+			return false;
+		memset(buf + avail, 0, length - avail);
+		return true;
+	}
+
+	// Copy cluster into the overlay with new data merged in, data first, map entry last
+	bool alloc_cluster(uint64 cluster, const uint8 *data, uint32 start, size_t length) {
+		std::vector<uint8> tmp(cluster_size);
+		loff_t pos = (loff_t)cluster * cluster_size;
+		if (length < cluster_size && !read_base(&tmp[0], pos, std::min((loff_t)cluster_size, disk_size - pos)))
+			return false;
+		memcpy(&tmp[start], data, length);
+		if (!pwrite_all(fd, &tmp[0], cluster_size, alloc))
+			return false;
+
+		// The data must be on disk before the map points to it, otherwise a crash
+		// could leave the map entry pointing at garbage
+		if (fdatasync(fd) < 0)
+			return false;
+
+		uint8 entry[8];
+		put_be64(entry, alloc);
+		if (!pwrite_all(fd, entry, 8, map_offset + cluster * 8))
+			return false;
+		D(bug("cow: cluster %lld at %lld\n", (long long)cluster, (long long)alloc));
+		map[cluster] = alloc;
+		alloc += cluster_size;
+		return true;
+	}
+};
+
+
+/*
+ *  Open overlay or raw image, depth counts overlays below the first one
+ */
+
+static disk_cow_layer *open_image(const char *path, bool read_only, int depth);
+
+static bool is_overlay(const char *path)
+{
+	char magic[8];
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	bool ok = (::read(fd, magic, 8) == 8 && memcmp(magic, COW_MAGIC, 8) == 0);
+	close(fd);
+	return ok;
+}
+
+// Base path as stored in the header, relative to the overlay's directory
+static std::string base_path(const char *overlay, const char *base)
+{
+	if (base[0] == '/')
+		return base;
+	std::string dir = overlay;
+	std::string::size_type pos = dir.find_last_of('/');
+	if (pos == std::string::npos)
+		return base;
+	return dir.substr(0, pos + 1) + base;
+}
+
+static disk_cow *open_overlay(const char *path, bool read_only, int depth)
+{
+	if (depth >= COW_MAX_CHAIN) {
+		fprintf(stderr, "cow: Too many chained overlays at %s\n", path);
+		return NULL;
+	}
+
+	int fd = open(path, read_only ? O_RDONLY : O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "cow: Can't open %s (%s)\n", path, strerror(errno));
+		return NULL;
+	}
+
+	// Check header
+	uint8 hdr[COW_HEADER_SIZE];
+	if (!pread_all(fd, hdr, sizeof(hdr), 0) || memcmp(hdr, COW_MAGIC, 8) != 0) {
+		fprintf(stderr, "cow: %s is not an overlay\n", path);
+		close(fd);
+		return NULL;
+	}
+	uint32 version = get_be32(hdr + 8);
+	uint32 cluster_size = get_be32(hdr + 12);
+	loff_t size = get_be64(hdr + 16);
+	loff_t map_offset = get_be64(hdr + 24);
+	hdr[COW_PATH_OFFSET + COW_PATH_SIZE - 1] = 0;
+	const char *base_name = (const char *)hdr + COW_PATH_OFFSET;
+	if (version != COW_VERSION || cluster_size < 512 || (cluster_size & (cluster_size - 1)) || size <= 0 || map_offset < COW_HEADER_SIZE) {
+		fprintf(stderr, "cow: Unsupported overlay %s\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	// The map must lie within the file, check before allocating memory for it
+	uint64 num_clusters = (size + cluster_size - 1) / cluster_size;
+	loff_t file_size = lseek(fd, 0, SEEK_END);
+	if (map_offset > file_size || num_clusters > (uint64)(file_size - map_offset) / 8) {
+		fprintf(stderr, "cow: Cluster map of %s lies beyond the end of the file\n", path);
+		close(fd);
+		return NULL;
+	}
+	loff_t data_start = (map_offset + num_clusters * 8 + cluster_size - 1) & ~(loff_t)(cluster_size - 1);
+
+	// Read cluster map, entries must point to whole clusters behind the map
+	std::vector<uint8> raw_map(num_clusters * 8);
+	if (!pread_all(fd, &raw_map[0], raw_map.size(), map_offset)) {
+		fprintf(stderr, "cow: Can't read cluster map of %s\n", path);
+		close(fd);
+		return NULL;
+	}
+	std::vector<uint64> map(num_clusters);
+	for (uint64 i = 0; i < num_clusters; i++) {
+		map[i] = get_be64(&raw_map[i * 8]);
+		if (map[i] && (map[i] < (uint64)data_start || (map[i] & (cluster_size - 1))
+		 || (uint64)file_size < cluster_size || map[i] > (uint64)file_size - cluster_size)) {
+			fprintf(stderr, "cow: Bad cluster map entry %llu in %s\n", (unsigned long long)i, path);
+			close(fd);
+			return NULL;
+		}
+	}
+
+	// New clusters go to the end of the file, but not into the map
+	loff_t alloc = std::max(data_start, (file_size + cluster_size - 1) & ~(loff_t)(cluster_size - 1));
+
+	// Open base image
+	std::string base = base_path(path, base_name);
+	disk_cow_layer *base_disk = open_image(base.c_str(), true, depth + 1);
+	if (base_disk == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	D(bug("cow: %s over %s, %lld bytes, %d byte clusters\n", path, base.c_str(), (long long)size, cluster_size));
+	return new disk_cow(fd, read_only, base_disk, size, cluster_size, map_offset, map, alloc);
+}
+
+static disk_cow_layer *open_image(const char *path, bool read_only, int depth)
+{
+	if (is_overlay(path))
+		return open_overlay(path, read_only, depth);
+
+	int fd = open(path, read_only ? O_RDONLY : O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr, "cow: Can't open base image %s (%s)\n", path, strerror(errno));
+		return NULL;
+	}
+	loff_t size = lseek(fd, 0, SEEK_END);
+	return new disk_cow_raw(fd, read_only, size);
+}
+
+
+/*
+ *  Disk factory
+ */
+
+disk_generic::status disk_cow_factory(const char *path,
+		bool read_only, disk_generic **disk) {
+	if (!is_overlay(path))
+		return disk_generic::DISK_UNKNOWN;
+
+	disk_cow *cow = open_overlay(path, read_only, 0);
+	if (cow == NULL)
+		return disk_generic::DISK_INVALID;
+	*disk = cow;
+	return disk_generic::DISK_VALID;
+}
+
+
+/*
+ *  Create empty overlay
+ */
+
+bool disk_cow_create(const char *path, const char *base, uint32 cluster_size)
+{
+	if (cluster_size < 512 || (cluster_size & (cluster_size - 1))) {
+		fprintf(stderr, "cow: Cluster size must be a power of two of at least 512 bytes\n");
+		return false;
+	}
+	if (strlen(base) >= COW_PATH_SIZE) {
+		fprintf(stderr, "cow: Base path too long\n");
+		return false;
+	}
+
+	// Get size of base image
+	std::string base_full = base_path(path, base);
+	disk_cow_layer *base_disk = open_image(base_full.c_str(), true, 0);
+	if (base_disk == NULL)
+		return false;
+	loff_t size = base_disk->size();
+	delete base_disk;
+
+	// Write header and empty map
+	uint8 hdr[COW_HEADER_SIZE];
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, COW_MAGIC, 8);
+	put_be32(hdr + 8, COW_VERSION);
+	put_be32(hdr + 12, cluster_size);
+	put_be64(hdr + 16, size);
+	put_be64(hdr + 24, COW_HEADER_SIZE);
+	strcpy((char *)hdr + COW_PATH_OFFSET, base);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "cow: Can't create %s (%s)\n", path, strerror(errno));
+		return false;
+	}
+	uint64 num_clusters = (size + cluster_size - 1) / cluster_size;
+	bool ok = pwrite_all(fd, hdr, sizeof(hdr), 0) && ftruncate(fd, COW_HEADER_SIZE + num_clusters * 8) == 0;
+	close(fd);
+	if (!ok) {
+		fprintf(stderr, "cow: Can't write %s (%s)\n", path, strerror(errno));
+		unlink(path);
+	}
+	return ok;
+}
+
+
+/*
+ *  Throw away all changes
+ */
+
+bool disk_cow_discard(const char *path)
+{
+	disk_cow *cow = open_overlay(path, false, 0);
+	if (cow == NULL)
+		return false;
+
+	uint8 hdr[32];
+	bool ok = pread_all(cow->get_fd(), hdr, sizeof(hdr), 0);
+	if (ok) {
+		loff_t map_offset = get_be64(hdr + 24);
+		std::vector<uint8> empty(cow->num_clusters() * 8, 0);
+		ok = pwrite_all(cow->get_fd(), &empty[0], empty.size(), map_offset)
+			&& fsync(cow->get_fd()) == 0
+			&& ftruncate(cow->get_fd(), map_offset + empty.size()) == 0;
+	}
+	if (!ok)
+		fprintf(stderr, "cow: Can't discard %s (%s)\n", path, strerror(errno));
+	delete cow;
+	return ok;
+}
+
+
+/*
+ *  Write all changes into the base image (which may be an overlay itself), then discard them
+ */
+
+bool disk_cow_commit(const char *path)
+{
+	disk_cow *cow = open_overlay(path, true, 0);
+	if (cow == NULL)
+		return false;
+
+	// Reopen base for writing
+	uint8 hdr[COW_HEADER_SIZE];
+	bool ok = pread_all(cow->get_fd(), hdr, sizeof(hdr), 0);
+	hdr[COW_PATH_OFFSET + COW_PATH_SIZE - 1] = 0;
+	disk_cow_layer *base = NULL;
+	if (ok) {
+		std::string base_name = base_path(path, (const char *)hdr + COW_PATH_OFFSET);
+		base = open_image(base_name.c_str(), false, 1);
+		ok = (base != NULL);
+	}
+
+	// Copy clusters
+	uint32 cluster_size = cow->get_cluster_size();
+	std::vector<uint8> buf(cluster_size);
+	uint64 num_committed = 0;
+	for (uint64 i = 0; ok && i < cow->num_clusters(); i++) {
+		if (cow->cluster_offset(i) == 0)
+			continue;
+		loff_t pos = (loff_t)i * cluster_size;
+		size_t len = (size_t)std::min((loff_t)cluster_size, cow->size() - pos);
+		ok = cow->read(&buf[0], pos, len) == len && base->write(&buf[0], pos, len) == len;
+		num_committed++;
+	}
+
+	// The base must be safe on disk before the overlay is emptied
+	if (ok)
+		ok = base->sync();
+	if (!ok)
+		fprintf(stderr, "cow: Committing %s failed, overlay kept\n", path);
+	delete base;
+	delete cow;
+	if (!ok)
+		return false;
+	printf("%s: %llu clusters committed\n", path, (unsigned long long)num_committed);
+	return disk_cow_discard(path);
+}
@@ -37,6 +37,9 @@ struct disk_generic {
 	virtual size_t read(void *buf, loff_t offset, size_t length) = 0;
 	virtual size_t write(void *buf, loff_t offset, size_t length) = 0;
 	virtual loff_t size() = 0;
+
+	// Write back data that is only held in memory, called periodically
+	virtual bool flush() { return true; }
 };
 
 typedef disk_generic::status (disk_factory)(const char *path, bool read_only,
@@ -44,5 +47,11 @@ typedef disk_generic::status (disk_factory)(const char *path, bool read_only,
 
 extern disk_factory disk_sparsebundle_factory;
 extern disk_factory disk_vhd_factory;
+extern disk_factory disk_cow_factory;
+
+// Copy-on-write overlays (disk_cow.cpp)
+extern bool disk_cow_create(const char *path, const char *base, uint32 cluster_size);
+extern bool disk_cow_commit(const char *path);
+extern bool disk_cow_discard(const char *path);
 
 #endif
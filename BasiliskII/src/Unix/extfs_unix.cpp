@@ -26,8 +26,14 @@
 #include <dirent.h>
 #include <errno.h>
 #include <utime.h>
+#include <string>
+#include <map>
 
 #include "sysdeps.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 #include "extfs.h"
 #include "extfs_defs.h"
 
@@ -38,6 +44,234 @@
 // Default Finder flags
 const uint16 DEFAULT_FINDER_FLAGS = kHasBeenInited;
 
+static int open_finf(const char *path, int flag);
+static int open_rsrc(const char *path, int flag);
+
+
+/*
+ *  Metadata cache
+ *
+ *  stat() results, Finder info and resource fork sizes are cached per path.
+ *  Every directory that has cached entries (and its .finf/.rsrc helper
+ *  directories) is watched with inotify, pending events are processed
+ *  before each lookup and drop the affected entries. Finder info written
+ *  by MacOS is kept in the cache and written back to the helper files
+ *  about once per second. Without inotify, nothing is cached.
+ */
+
+#ifdef HAVE_SYS_INOTIFY_H
+#define USE_META_CACHE 1
+#endif
+
+#if USE_META_CACHE
+const int META_CACHE_MAX = 16384;	// Maximum number of cached paths
+const time_t FINF_FLUSH_DELAY = 1;	// Seconds before dirty Finder info is written back
+
+struct meta_entry {
+	meta_entry() : have_stat(false), have_finf(false), finf_dirty(false), have_rsize(false) {}
+	bool have_stat;
+	int stat_err;		// errno of stat(), or 0
+	struct stat st;
+	bool have_finf;
+	bool finf_dirty;	// Finder info not yet written to helper file
+	int finf_len;		// Valid bytes in finf (0 = no Finder info file)
+	uint8 finf[SIZEOF_FInfo + SIZEOF_FXInfo];
+	bool have_rsize;
+	uint32 rsize;
+};
+
+typedef std::map<std::string, meta_entry> meta_map;
+static meta_map meta_cache;
+static int num_finf_dirty = 0;
+static time_t finf_dirty_since;
+
+static int inotify_fd = -1;
+static std::map<int, std::string> watch_dirs;	// Watch descriptor -> directory
+static std::map<std::string, int> dir_watches;	// Directory -> watch descriptor (-1 = can't watch)
+
+const uint32 WATCH_MASK = IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE;
+
+// Split path into directory and key ("dir/name", without trailing "/")
+static std::string meta_key(const char *path, std::string &dir)
+{
+	std::string key(path);
+	while (key.size() > 1 && key[key.size() - 1] == '/')
+		key.erase(key.size() - 1);
+	std::string::size_type slash = key.rfind('/');
+	if (slash == std::string::npos)
+		dir = ".";
+	else if (slash == 0)
+		dir = "/";
+	else
+		dir = key.substr(0, slash);
+	return key;
+}
+
+static std::string join_path(const std::string &dir, const char *name)
+{
+	return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+static void flush_finf(const std::string &key, meta_entry &e)
+{
+	if (!e.finf_dirty)
+		return;
+	e.finf_dirty = false;
+	num_finf_dirty--;
+
+	// File deleted in the meantime? Then don't create a helper file for it
+	struct stat st;
+	if (lstat(key.c_str(), &st) < 0 && errno == ENOENT) {
+		e.have_finf = false;
+		return;
+	}
+
+	int fd = open_finf(key.c_str(), O_RDWR);
+	bool ok = fd >= 0 && write(fd, e.finf, e.finf_len) == e.finf_len;
+	if (fd >= 0 && close(fd) < 0)
+		ok = false;
+	if (!ok) {
+		// Forget the cached copy, so it doesn't hide what is really on disk
+		printf("WARNING: Can't write Finder info of %s (%s)\n", key.c_str(), strerror(errno));
+		e.have_finf = false;
+	}
+}
+
+static void flush_all_finf(void)
+{
+	for (meta_map::iterator i = meta_cache.begin(); num_finf_dirty && i != meta_cache.end(); ++i)
+		flush_finf(i->first, i->second);
+}
+
+// Write back Finder info that has been dirty for long enough
+static void flush_old_finf(void)
+{
+	if (num_finf_dirty && time(NULL) - finf_dirty_since >= FINF_FLUSH_DELAY)
+		flush_all_finf();
+}
+
+static void meta_invalidate(const std::string &key)
+{
+	meta_map::iterator i = meta_cache.find(key);
+	if (i != meta_cache.end()) {
+		flush_finf(i->first, i->second);
+		meta_cache.erase(i);
+	}
+}
+
+static void meta_clear(void)
+{
+	flush_all_finf();
+	meta_cache.clear();
+}
+
+// Watch directory (and helper directories) of a path, returns false if not possible
+static bool watch_dir(const std::string &dir)
+{
+	std::map<std::string, int>::const_iterator i = dir_watches.find(dir);
+	if (i != dir_watches.end())
+		return i->second >= 0;
+
+	int wd = inotify_add_watch(inotify_fd, dir.c_str(), WATCH_MASK);
+	dir_watches[dir] = wd;
+	if (wd < 0)
+		return false;
+	watch_dirs[wd] = dir;
+	static const char *const helpers[] = {".finf", ".rsrc"};
+	for (int h=0; h<2; h++) {
+		std::string helper = join_path(dir, helpers[h]);
+		int hwd = inotify_add_watch(inotify_fd, helper.c_str(), WATCH_MASK);
+		if (hwd >= 0)
+			watch_dirs[hwd] = helper;
+	}
+	return true;
+}
+
+static void unwatch_all(void)
+{
+	std::map<int, std::string>::const_iterator i, end = watch_dirs.end();
+	for (i = watch_dirs.begin(); i != end; ++i)
+		inotify_rm_watch(inotify_fd, i->first);
+	watch_dirs.clear();
+	dir_watches.clear();
+}
+
+// Process pending inotify events
+static void meta_process_events(void)
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	for (;;) {
+		ssize_t len = read(inotify_fd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+		for (char *p = buf; p < buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				meta_clear();
+				continue;
+			}
+			std::map<int, std::string>::iterator w = watch_dirs.find(ev->wd);
+			if (w == watch_dirs.end())
+				continue;
+			if (ev->mask & IN_IGNORED) {
+				// Watched directory is gone, forget everything about it
+				dir_watches.erase(w->second);
+				watch_dirs.erase(w);
+				meta_clear();
+				continue;
+			}
+
+			// Events in helper directories refer to the file in the parent directory
+			std::string dir = w->second;
+			std::string::size_type slash = dir.rfind('/');
+			std::string last = slash == std::string::npos ? dir : dir.substr(slash + 1);
+			if (last == ".finf" || last == ".rsrc") {
+				dir = slash == 0 ? "/" : slash == std::string::npos ? "." : dir.substr(0, slash);
+			} else if (ev->len && (!strcmp(ev->name, ".finf") || !strcmp(ev->name, ".rsrc")) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) {
+				// Helper directory appeared, watch it and drop all entries of this directory
+				std::string helper = join_path(dir, ev->name);
+				int hwd = inotify_add_watch(inotify_fd, helper.c_str(), WATCH_MASK);
+				if (hwd >= 0)
+					watch_dirs[hwd] = helper;
+				meta_clear();
+				continue;
+			}
+			if (ev->len)
+				meta_invalidate(join_path(dir, ev->name));
+			if (!ev->len || (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+				// The directory itself changed
+				std::string parent;
+				meta_invalidate(meta_key(dir.c_str(), parent));
+			}
+		}
+	}
+}
+
+// Find cache entry for path (NULL = path can't be cached)
+static meta_entry *meta_lookup(const char *path)
+{
+	if (inotify_fd < 0)
+		return NULL;
+
+	meta_process_events();
+	flush_old_finf();
+
+	std::string dir;
+	std::string key = meta_key(path, dir);
+	meta_map::iterator i = meta_cache.find(key);
+	if (i != meta_cache.end())
+		return &i->second;
+
+	if (!watch_dir(dir))
+		return NULL;
+	if (meta_cache.size() >= META_CACHE_MAX)
+		meta_clear();
+	return &meta_cache[key];
+}
+#endif
+
 
 /*
  *  Initialization
@@ -45,6 +279,10 @@ const uint16 DEFAULT_FINDER_FLAGS = kHasBeenInited;
 
 void extfs_init(void)
 {
+#if USE_META_CACHE
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	D(bug("extfs metadata cache %s\n", inotify_fd < 0 ? "disabled" : "enabled"));
+#endif
 }
 
 
@@ -54,6 +292,54 @@ void extfs_init(void)
 
 void extfs_exit(void)
 {
+#if USE_META_CACHE
+	if (inotify_fd >= 0) {
+		meta_clear();
+		unwatch_all();
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+#endif
+}
+
+
+/*
+ *  Write back cached data (called once per second)
+ */
+
+void extfs_flush(void)
+{
+#if USE_META_CACHE
+	if (inotify_fd >= 0) {
+		meta_process_events();
+		flush_old_finf();
+	}
+#endif
+}
+
+
+/*
+ *  Get file/directory status (cached)
+ */
+
+int extfs_stat(const char *path, struct stat *st)
+{
+#if USE_META_CACHE
+	meta_entry *e = meta_lookup(path);
+	if (e) {
+		if (!e->have_stat) {
+			e->stat_err = stat(path, &e->st) < 0 ? errno : 0;
+			e->have_stat = true;
+		}
+		if (e->stat_err) {
+			errno = e->stat_err;
+			return -1;
+		}
+		*st = e->st;
+		return 0;
+	}
+#endif
+	return stat(path, st);
 }
 
 
@@ -229,14 +515,38 @@ void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 	WriteMacInt32(finfo + fdLocation, (uint32)-1);
 
 	// Read Finder info file
-	int fd = open_finf(path, O_RDONLY);
-	if (fd >= 0) {
-		ssize_t actual = read(fd, Mac2HostAddr(finfo), SIZEOF_FInfo);
-		if (fxinfo)
-			actual += read(fd, Mac2HostAddr(fxinfo), SIZEOF_FXInfo);
-		close(fd);
-		if (actual >= SIZEOF_FInfo)
+#if USE_META_CACHE
+	meta_entry *e = meta_lookup(path);
+	if (e) {
+		if (!e->have_finf) {
+			e->finf_len = 0;
+			int fd = open_finf(path, O_RDONLY);
+			if (fd >= 0) {
+				ssize_t actual = read(fd, e->finf, sizeof(e->finf));
+				if (actual > 0)
+					e->finf_len = actual;
+				close(fd);
+			}
+			e->have_finf = true;
+		}
+		if (e->finf_len >= SIZEOF_FInfo) {
+			Host2Mac_memcpy(finfo, e->finf, SIZEOF_FInfo);
+			if (fxinfo)
+				Host2Mac_memcpy(fxinfo, e->finf + SIZEOF_FInfo, e->finf_len - SIZEOF_FInfo);
 			return;
+		}
+	} else
+#endif
+	{
+		int fd = open_finf(path, O_RDONLY);
+		if (fd >= 0) {
+			ssize_t actual = read(fd, Mac2HostAddr(finfo), SIZEOF_FInfo);
+			if (fxinfo)
+				actual += read(fd, Mac2HostAddr(fxinfo), SIZEOF_FXInfo);
+			close(fd);
+			if (actual >= SIZEOF_FInfo)
+				return;
+		}
 	}
 
 	// No Finder info file, translate file name extension to MacOS type/creator
@@ -265,6 +575,38 @@ void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
 		D(bug("utime failed on %s\n", path));
 	}
 
+#if USE_META_CACHE
+	// Update cached Finder info, it is written back later
+	meta_entry *e = meta_lookup(path);
+	if (e) {
+		if (!e->have_finf) {
+			e->finf_len = 0;
+			int fd = open_finf(path, O_RDONLY);
+			if (fd >= 0) {
+				ssize_t actual = read(fd, e->finf, sizeof(e->finf));
+				if (actual > 0)
+					e->finf_len = actual;
+				close(fd);
+			}
+			e->have_finf = true;
+		}
+		if (e->finf_len < SIZEOF_FInfo)
+			memset(e->finf + e->finf_len, 0, sizeof(e->finf) - e->finf_len);
+		Mac2Host_memcpy(e->finf, finfo, SIZEOF_FInfo);
+		if (fxinfo) {
+			Mac2Host_memcpy(e->finf + SIZEOF_FInfo, fxinfo, SIZEOF_FXInfo);
+			e->finf_len = SIZEOF_FInfo + SIZEOF_FXInfo;
+		} else if (e->finf_len < SIZEOF_FInfo)
+			e->finf_len = SIZEOF_FInfo;
+		if (!e->finf_dirty) {
+			if (num_finf_dirty++ == 0)
+				finf_dirty_since = time(NULL);
+			e->finf_dirty = true;
+		}
+		return;
+	}
+#endif
+
 	// Open Finder info file
 	int fd = open_finf(path, O_RDWR);
 	if (fd < 0)
@@ -282,7 +624,7 @@ void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir)
  *  Resource fork emulation functions
  */
 
-uint32 get_rfork_size(const char *path)
+static uint32 read_rfork_size(const char *path)
 {
 	// Open resource file
 	int fd = open_rsrc(path, O_RDONLY);
@@ -297,6 +639,21 @@ uint32 get_rfork_size(const char *path)
 	return size < 0 ? 0 : size;
 }
 
+uint32 get_rfork_size(const char *path)
+{
+#if USE_META_CACHE
+	meta_entry *e = meta_lookup(path);
+	if (e) {
+		if (!e->have_rsize) {
+			e->rsize = read_rfork_size(path);
+			e->have_rsize = true;
+		}
+		return e->rsize;
+	}
+#endif
+	return read_rfork_size(path);
+}
+
 int open_rfork(const char *path, int flag)
 {
 	return open_rsrc(path, flag);
@@ -337,6 +694,19 @@ ssize_t extfs_write(int fd, void *buffer, size_t length)
 
 bool extfs_remove(const char *path)
 {
+#if USE_META_CACHE
+	// Pending Finder info of a removed file is dropped
+	if (inotify_fd >= 0) {
+		std::string dir;
+		meta_map::iterator i = meta_cache.find(meta_key(path, dir));
+		if (i != meta_cache.end()) {
+			if (i->second.finf_dirty)
+				num_finf_dirty--;
+			meta_cache.erase(i);
+		}
+	}
+#endif
+
 	// Remove helpers first, don't complain if this fails
 	char helper_path[MAX_PATH_LENGTH];
 	make_helper_path(path, helper_path, ".finf/", false);
@@ -370,6 +740,15 @@ bool extfs_remove(const char *path)
 
 bool extfs_rename(const char *old_path, const char *new_path)
 {
+#if USE_META_CACHE
+	// Write pending Finder info before the helper file is moved
+	if (inotify_fd >= 0) {
+		std::string dir;
+		meta_invalidate(meta_key(old_path, dir));
+		meta_invalidate(meta_key(new_path, dir));
+	}
+#endif
+
 	// Rename helpers first, don't complain if this fails
 	char old_helper_path[MAX_PATH_LENGTH], new_helper_path[MAX_PATH_LENGTH];
 	make_helper_path(old_path, old_helper_path, ".finf/", false);
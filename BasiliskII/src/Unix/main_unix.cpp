@@ -33,6 +33,7 @@
 
 #ifndef USE_SDL_VIDEO
 # include <X11/Xlib.h>
+# include "video_headless.h"
 #endif
 
 #ifdef HAVE_PTHREADS
@@ -81,6 +82,7 @@ using std::string;
 #include "sys.h"
 #include "rom_patches.h"
 #include "xpram.h"
+#include "persist_unix.h"
 #include "timer.h"
 #include "video.h"
 #include "emul_op.h"
@@ -93,6 +95,8 @@ using std::string;
 #include "vm_alloc.h"
 #include "sigsegv.h"
 #include "rpc.h"
+#include "bench.h"
+#include "snapshot.h"
 
 #include "Tiny68020.h"
 extern Tiny68020 tiny68020;
@@ -149,17 +153,11 @@ X11_LOCK_TYPE x_display_lock = X11_LOCK_INIT;		// X11 display lock
 #endif
 #endif
 
-static uint8 last_xpram[XPRAM_SIZE];				// Buffer for monitoring XPRAM changes
-
 #ifdef HAVE_PTHREADS
 #if !EMULATED_68K
 static pthread_t emul_thread;						// Handle of MacOS emulation thread (main thread)
 #endif
 
-static bool xpram_thread_active = false;			// Flag: XPRAM watchdog installed
-static volatile bool xpram_thread_cancel = false;	// Flag: Cancel XPRAM thread
-static pthread_t xpram_thread;						// XPRAM watchdog
-
 static bool tick_thread_active = false;				// Flag: 60Hz thread installed
 static volatile bool tick_thread_cancel = false;	// Flag: Cancel 60Hz thread
 static pthread_t tick_thread;						// 60Hz thread
@@ -202,6 +200,10 @@ static struct sigaction sigint_sa;	// sigaction for SIGINT handler
 static void sigint_handler(...);
 #endif
 
+static struct sigaction sigusr2_sa;	// sigaction for SIGUSR2 handler (take snapshot)
+static volatile sig_atomic_t snapshot_requested = 0;
+static void sigusr2_handler(int sig);
+
 #if REAL_ADDRESSING
 static bool lm_area_mapped = false;	// Flag: Low Memory area mmap()ped
 #endif
@@ -211,7 +213,6 @@ static const char *gui_connection_path = NULL;	// GUI connection identifier
 
 
 // Prototypes
-static void *xpram_func(void *arg);
 static void *tick_func(void *arg);
 static void one_tick(...);
 #if !EMULATED_68K
@@ -503,19 +504,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	// Benchmark mode overrides some prefs
+	BenchInit();
+
+	// Derive guest time from the instruction count?
+	ICountInit();
+
 #ifndef USE_SDL_VIDEO
-	// Open display
-	x_display = XOpenDisplay(x_display_name);
-	if (x_display == NULL) {
-		char str[256];
-		sprintf(str, GetString(STR_NO_XSERVER_ERR), XDisplayName(x_display_name));
-		ErrorAlert(str);
-		QuitEmulator();
+	// Open display (not needed by the headless display driver)
+	if (!VideoHeadless()) {
+		x_display = XOpenDisplay(x_display_name);
+		if (x_display == NULL) {
+			char str[256];
+			sprintf(str, GetString(STR_NO_XSERVER_ERR), XDisplayName(x_display_name));
+			ErrorAlert(str);
+			QuitEmulator();
+		}
 	}
 
 #if defined(ENABLE_XF86_DGA) && !defined(ENABLE_MON)
 	// Fork out, so we can return from fullscreen mode when things get ugly
-	XF86DGAForkApp(DefaultScreen(x_display));
+	if (x_display)
+		XF86DGAForkApp(DefaultScreen(x_display));
 #endif
 #endif
 
@@ -529,7 +539,13 @@ int main(int argc, char **argv)
 	sdl_flags |= SDL_INIT_AUDIO;
 #endif
 	assert(sdl_flags != 0);
-	if (SDL_Init(sdl_flags) == -1) {
+	int sdl_err = -1;
+#if defined(USE_SDL_VIDEO) && !SDL_VERSION_ATLEAST(2,0,0) && !defined(__MACOSX__)
+	// SDL 1.2 can read X11 events in a thread of its own, SDL_PumpEvents() on the
+	// CPU thread is then a no-op (not supported by all video drivers, so retry without)
+	sdl_err = SDL_Init(sdl_flags | SDL_INIT_EVENTTHREAD);
+#endif
+	if (sdl_err == -1 && SDL_Init(sdl_flags) == -1) {
 		char str[256];
 		sprintf(str, "Could not initialize SDL: %s.\n", SDL_GetError());
 		ErrorAlert(str);
@@ -694,6 +710,16 @@ int main(int argc, char **argv)
 		QuitEmulator();
 	D(bug("Initialization complete\n"));
 
+	// Restore machine state from snapshot, if requested
+	const char *resume_path = PrefsFindString("resume");
+	bool resumed = resume_path && SnapshotLoad(resume_path);
+
+	// Share patched ROM with other instances, let the host merge RAM pages
+	if (PrefsFindBool("romshare") && vm_share_fixed(ROMBaseHost, ROMSize, "BasiliskII-rom") < 0)
+		printf("WARNING: Cannot share ROM with other instances\n");
+	if (PrefsFindBool("rammerge") && vm_set_mergeable(RAMBaseHost, RAMSize) < 0)
+		printf("WARNING: Cannot enable page merging for Mac RAM: %s\n", strerror(errno));
+
 	D(bug("Mac RAM starts at %p (%08x)\n", RAMBaseHost, RAMBaseMac));
 	D(bug("Mac ROM starts at %p (%08x)\n", ROMBaseHost, ROMBaseMac));
 
@@ -756,18 +782,26 @@ int main(int argc, char **argv)
 	sigaction(SIGINT, &sigint_sa, NULL);
 #endif
 
+	// Setup SIGUSR2 handler to take a snapshot
+	sigemptyset(&sigusr2_sa.sa_mask);
+	sigusr2_sa.sa_handler = sigusr2_handler;
+	sigusr2_sa.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &sigusr2_sa, NULL);
+
 #ifndef USE_CPU_EMUL_SERVICES
 #if defined(HAVE_PTHREADS)
 
-	// POSIX threads available, start 60Hz thread
-	Set_pthread_attr(&tick_thread_attr, 0);
-	tick_thread_active = (pthread_create(&tick_thread, &tick_thread_attr, tick_func, NULL) == 0);
-	if (!tick_thread_active) {
-		sprintf(str, GetString(STR_TICK_THREAD_ERR), strerror(errno));
-		ErrorAlert(str);
-		QuitEmulator();
+	// POSIX threads available, start 60Hz thread (the CPU thread ticks in deterministic time mode)
+	if (ICountRate == 0) {
+		Set_pthread_attr(&tick_thread_attr, 0);
+		tick_thread_active = (pthread_create(&tick_thread, &tick_thread_attr, tick_func, NULL) == 0);
+		if (!tick_thread_active) {
+			sprintf(str, GetString(STR_TICK_THREAD_ERR), strerror(errno));
+			ErrorAlert(str);
+			QuitEmulator();
+		}
+		D(bug("60Hz thread started\n"));
 	}
-	D(bug("60Hz thread started\n"));
 
 #elif defined(HAVE_TIMER_CREATE) && defined(_POSIX_REALTIME_SIGNALS)
 
@@ -822,16 +856,16 @@ int main(int argc, char **argv)
 #endif
 #endif
 
-#ifdef USE_PTHREADS_SERVICES
-	// Start XPRAM watchdog thread
-	memcpy(last_xpram, XPRAM, XPRAM_SIZE);
-	xpram_thread_active = (pthread_create(&xpram_thread, NULL, xpram_func, NULL) == 0);
-	D(bug("XPRAM thread started\n"));
-#endif
+	// Start writing back XPRAM changes
+	PersistInit();
+
 	tiny68020.SetMemoryPtr(RAMBaseHost);
-	// Start 68k and jump to ROM boot routine
+	// Start 68k and jump to ROM boot routine (or continue where the snapshot was taken)
 	D(bug("Starting emulation...\n"));
-	Start680x0();
+	if (resumed)
+		Resume680x0();
+	else
+		Start680x0();
 
 	QuitEmulator();
 	return 0;
@@ -876,20 +910,17 @@ void QuitEmulator(void)
 	setitimer(ITIMER_REAL, &req, NULL);
 #endif
 
-#ifdef USE_PTHREADS_SERVICES
-	// Stop XPRAM watchdog thread
-	if (xpram_thread_active) {
-		xpram_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(xpram_thread);
-#endif
-		pthread_join(xpram_thread, NULL);
-	}
-#endif
+	// Write back XPRAM and prefs changes
+	PersistExit();
 
 	// Deinitialize everything
 	ExitAll();
 
+	// Print host memory usage, PSS counts shared pages only partially
+	unsigned long rss_kb, pss_kb;
+	if (PrefsFindBool("memstats") && vm_get_rss(&rss_kb, &pss_kb) == 0)
+		printf("Memory: RSS %lu KB, PSS %lu KB, %lu KB shared with other processes\n", rss_kb, pss_kb, rss_kb - pss_kb);
+
 	// Free ROM/RAM areas
 	if (RAMBaseHost != VM_MAP_FAILED) {
 		vm_release(RAMBaseHost, RAMSize + 0x100000);
@@ -1109,29 +1140,14 @@ void TriggerNMI(void)
 
 
 /*
- *  XPRAM watchdog thread (saves XPRAM every minute)
+ *  SIGUSR2 handler, the snapshot is taken by the CPU thread
  */
 
-static void xpram_watchdog(void)
+static void sigusr2_handler(int sig)
 {
-	if (memcmp(last_xpram, XPRAM, XPRAM_SIZE)) {
-		memcpy(last_xpram, XPRAM, XPRAM_SIZE);
-		SaveXPRAM();
-	}
+	snapshot_requested = 1;
 }
 
-#ifdef USE_PTHREADS_SERVICES
-static void *xpram_func(void *arg)
-{
-	while (!xpram_thread_cancel) {
-		for (int i=0; i<60 && !xpram_thread_cancel; i++)
-			Delay_usec(999999);		// Only wait 1 second so we quit promptly when xpram_thread_cancel becomes true
-		xpram_watchdog();
-	}
-	return NULL;
-}
-#endif
-
 
 /*
  *  60Hz thread (really 60.15Hz)
@@ -1149,7 +1165,7 @@ static void one_second(void)
 	static int second_counter = 0;
 	if (++second_counter > 60) {
 		second_counter = 0;
-		xpram_watchdog();
+		PersistFlush();
 	}
 #endif
 }
@@ -1162,6 +1178,12 @@ static void one_tick(...)
 		one_second();
 	}
 
+	// Snapshot requested by SIGUSR2?
+	if (snapshot_requested) {
+		snapshot_requested = 0;
+		SnapshotRequest();
+	}
+
 #ifndef USE_PTHREADS_SERVICES
 	// Threads not used to trigger interrupts, perform video refresh from here
 	VideoRefresh();
@@ -1179,25 +1201,52 @@ static void one_tick(...)
 	}
 }
 
+// Deterministic time mode, called by the CPU thread
+void ICountTick(void)
+{
+	one_tick();
+}
+
 #ifdef USE_PTHREADS_SERVICES
 static void *tick_func(void *arg)
 {
 	uint64 start = GetTicks_usec();
 	int64 ticks = 0;
 	uint64 next = start;
+
+	// Ticks are suspended while the Mac is idle, the Time Manager thread wakes it up in time
+	// (not with SDL, whose input events are only read on the tick)
+#if PRECISE_TIMING && !defined(USE_SDL_VIDEO)
+	int32 idle_limit = PrefsFindInt32("ticklessidle") * 1000;
+#else
+	int32 idle_limit = 0;
+#endif
+
+	int64 skipped_total = 0;
 	while (!tick_thread_cancel) {
-		one_tick();
 		next += 16625;
 		int64 delay = next - GetTicks_usec();
 		if (delay > 0)
 			Delay_usec(delay);
 		else if (delay < -16625)
 			next = GetTicks_usec();
+
+		// Checked after the delay, the interrupt of the last tick woke up the emulator thread
+		if (idle_sleep(0, idle_limit)) {
+			int64 skipped = (int64)(GetTicks_usec() - next) / 16625;
+			if (skipped > 0) {
+				next += skipped * 16625;
+				skipped_total += skipped;
+				idle_skip_ticks(skipped);
+			}
+		}
+
+		one_tick();
 		ticks++;
 	}
 #if DEBUG
 	uint64 end = GetTicks_usec();
-	D(bug("%lld ticks in %lld usec = %f ticks/sec\n", ticks, end - start, ticks * 1000000.0 / (end - start)));
+	D(bug("%lld ticks in %lld usec = %f ticks/sec, %lld skipped while idle\n", ticks, end - start, ticks * 1000000.0 / (end - start), skipped_total));
 #endif
 	return NULL;
 }
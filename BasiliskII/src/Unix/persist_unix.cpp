@@ -0,0 +1,353 @@
+/*
+ *  persist_unix.cpp - Write-back of XPRAM and prefs files
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  All settings files of the emulator (XPRAM/NVRAM and prefs) are written
+ *  here. A single thread wakes up every "persistinterval" seconds and
+ *  writes the files whose contents changed since they were last read or
+ *  written, nothing at all is done for unchanged files. Watched memory
+ *  blocks (XPRAM) are only compared when their dirty flag was set by the
+ *  emulation. Files are replaced atomically by writing a temporary file
+ *  next to them, syncing it and renaming it over the old one.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "prefs.h"
+#include "persist_unix.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+using std::string;
+using std::vector;
+
+// The standalone prefs editor always writes immediately
+#if defined(HAVE_PTHREADS) && !defined(STANDALONE_GUI)
+#define USE_PERSIST_THREAD 1
+#include <pthread.h>
+#endif
+
+
+// File managed by the write-back service
+struct persist_file {
+	string path;				// Name used by the caller
+	string target;				// File actually replaced (symlinks resolved)
+	vector<uint8> saved;		// Contents on disk
+	bool saved_valid;			// Flag: saved is known (false if the file doesn't exist)
+	vector<uint8> pending;		// Contents to be written
+	bool has_pending;
+	const uint8 *watch_data;	// Watched memory block or NULL
+	size_t watch_size;
+	volatile bool *watch_dirty;
+};
+
+static vector<persist_file> files;
+
+#ifdef USE_PERSIST_THREAD
+static pthread_mutex_t persist_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t persist_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t persist_thread;
+static bool persist_thread_active = false;		// Flag: Write-back thread installed
+static bool persist_thread_cancel = false;		// Flag: Cancel write-back thread
+static int32 persist_interval;					// Seconds between write-backs
+#define LOCK_PERSIST pthread_mutex_lock(&persist_lock)
+#define UNLOCK_PERSIST pthread_mutex_unlock(&persist_lock)
+#else
+static const bool persist_thread_active = false;
+#define LOCK_PERSIST
+#define UNLOCK_PERSIST
+#endif
+
+
+/*
+ *  Find file entry, create it with the current contents of the file if it doesn't exist
+ */
+
+static persist_file &find_file(const char *path)
+{
+	for (size_t i = 0; i < files.size(); i++)
+		if (files[i].path == path)
+			return files[i];
+
+	persist_file f;
+	f.path = path;
+	f.target = path;
+	char real[PATH_MAX];
+	if (realpath(path, real))
+		f.target = real;
+	f.saved_valid = false;
+	f.has_pending = false;
+	f.watch_data = NULL;
+	f.watch_size = 0;
+	f.watch_dirty = NULL;
+
+	int fd = open(f.target.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		uint8 buf[4096];
+		ssize_t actual;
+		while ((actual = read(fd, buf, sizeof(buf))) > 0)
+			f.saved.insert(f.saved.end(), buf, buf + actual);
+		f.saved_valid = (actual == 0);
+		close(fd);
+	}
+
+	files.push_back(f);
+	return files.back();
+}
+
+
+/*
+ *  Atomically replace file contents, the directory is synced by the caller
+ */
+
+static bool write_file(const string &path, const vector<uint8> &data)
+{
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp%d", path.c_str(), (int)getpid());
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return false;
+
+	size_t done = 0;
+	while (done < data.size()) {
+		ssize_t actual = write(fd, &data[done], data.size() - done);
+		if (actual < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		done += actual;
+	}
+	if (done < data.size() || fsync(fd) < 0) {
+		int saved_errno = errno;
+		close(fd);
+		unlink(tmp);
+		errno = saved_errno;
+		return false;
+	}
+	close(fd);
+
+	if (rename(tmp, path.c_str()) < 0) {
+		int saved_errno = errno;
+		unlink(tmp);
+		errno = saved_errno;
+		return false;
+	}
+	return true;
+}
+
+static string dir_of(const string &path)
+{
+	string::size_type pos = path.find_last_of('/');
+	if (pos == string::npos)
+		return ".";
+	if (pos == 0)
+		return "/";
+	return path.substr(0, pos);
+}
+
+static void sync_dir(const string &dir)
+{
+	int fd = open(dir.c_str(), O_RDONLY);
+	if (fd >= 0) {
+		fsync(fd);
+		close(fd);
+	}
+}
+
+
+/*
+ *  Write one file if its contents changed, returns true if it was written (persist_lock held)
+ */
+
+static bool flush_file(persist_file &f)
+{
+	if (f.watch_dirty && *f.watch_dirty) {
+		// Clear the flag first, so writes during the copy are caught next time
+		*f.watch_dirty = false;
+		f.pending.assign(f.watch_data, f.watch_data + f.watch_size);
+		f.has_pending = true;
+	}
+	if (!f.has_pending)
+		return false;
+	if (f.saved_valid && f.pending == f.saved) {
+		f.has_pending = false;
+		return false;
+	}
+
+	D(bug("Persist: writing %s (%d bytes)\n", f.target.c_str(), (int)f.pending.size()));
+	if (!write_file(f.target, f.pending)) {
+		// Keep it pending, it's retried next time
+		fprintf(stderr, "WARNING: Unable to save %s (%s)\n", f.path.c_str(), strerror(errno));
+		return false;
+	}
+	f.saved.swap(f.pending);
+	f.saved_valid = true;
+	f.pending.clear();
+	f.has_pending = false;
+	return true;
+}
+
+static void flush_all(void)
+{
+	// Files sharing a directory get only one directory sync
+	vector<string> dirs;
+	for (size_t i = 0; i < files.size(); i++)
+		if (flush_file(files[i])) {
+			string dir = dir_of(files[i].target);
+			if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end())
+				dirs.push_back(dir);
+		}
+	for (size_t i = 0; i < dirs.size(); i++)
+		sync_dir(dirs[i]);
+}
+
+
+/*
+ *  Write-back thread
+ */
+
+#ifdef USE_PERSIST_THREAD
+static void *persist_func(void *arg)
+{
+	LOCK_PERSIST;
+	while (!persist_thread_cancel) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += persist_interval;
+		while (!persist_thread_cancel && pthread_cond_timedwait(&persist_cond, &persist_lock, &deadline) != ETIMEDOUT) ;
+		if (!persist_thread_cancel)
+			flush_all();
+	}
+	UNLOCK_PERSIST;
+	return NULL;
+}
+#endif
+
+
+/*
+ *  Initialization
+ */
+
+void PersistInit(void)
+{
+#ifdef USE_PERSIST_THREAD
+	persist_interval = PrefsFindInt32("persistinterval");
+	if (persist_interval <= 0)
+		persist_interval = 60;
+	persist_thread_cancel = false;
+	persist_thread_active = (pthread_create(&persist_thread, NULL, persist_func, NULL) == 0);
+	D(bug("Persist thread started (%d seconds)\n", persist_interval));
+#endif
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void PersistExit(void)
+{
+#ifdef USE_PERSIST_THREAD
+	if (persist_thread_active) {
+		LOCK_PERSIST;
+		persist_thread_cancel = true;
+		pthread_cond_signal(&persist_cond);
+		UNLOCK_PERSIST;
+		pthread_join(persist_thread, NULL);
+		persist_thread_active = false;
+	}
+#endif
+	PersistFlush();
+}
+
+
+/*
+ *  Watch memory block
+ */
+
+void PersistWatch(const char *path, const void *data, size_t size, volatile bool *dirty)
+{
+	LOCK_PERSIST;
+	persist_file &f = find_file(path);
+	f.watch_data = (const uint8 *)data;
+	f.watch_size = size;
+	f.watch_dirty = dirty;
+	*dirty = true;		// Compare once, the caller may have set defaults
+	UNLOCK_PERSIST;
+}
+
+
+/*
+ *  Replace file contents
+ */
+
+void PersistWrite(const char *path, const void *data, size_t size)
+{
+	LOCK_PERSIST;
+	persist_file &f = find_file(path);
+	f.pending.assign((const uint8 *)data, (const uint8 *)data + size);
+	f.has_pending = true;
+	if (!persist_thread_active && flush_file(f))
+		sync_dir(dir_of(f.target));
+	UNLOCK_PERSIST;
+}
+
+
+/*
+ *  Delete file
+ */
+
+void PersistRemove(const char *path)
+{
+	LOCK_PERSIST;
+	persist_file &f = find_file(path);
+	unlink(f.target.c_str());
+	f.saved.clear();
+	f.saved_valid = false;
+	f.pending.clear();
+	f.has_pending = false;
+	UNLOCK_PERSIST;
+}
+
+
+/*
+ *  Write all changed files
+ */
+
+void PersistFlush(void)
+{
+	LOCK_PERSIST;
+	flush_all();
+	UNLOCK_PERSIST;
+}
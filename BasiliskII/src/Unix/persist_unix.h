@@ -0,0 +1,40 @@
+/*
+ *  persist_unix.h - Write-back of XPRAM and prefs files
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PERSIST_UNIX_H
+#define PERSIST_UNIX_H
+
+// Start the write-back thread, PersistExit() stops it and writes everything still pending
+extern void PersistInit(void);
+extern void PersistExit(void);
+
+// Save a memory block to a file whenever *dirty is set and the contents changed
+extern void PersistWatch(const char *path, const void *data, size_t size, volatile bool *dirty);
+
+// Replace the contents of a file (deferred while the write-back thread is running)
+extern void PersistWrite(const char *path, const void *data, size_t size);
+
+// Delete a file
+extern void PersistRemove(const char *path);
+
+// Write all changed files now
+extern void PersistFlush(void);
+
+#endif
@@ -25,6 +25,7 @@
 using std::string;
 
 #include "prefs.h"
+#include "persist_unix.h"
 
 // Platform-specific preferences items
 prefs_desc platform_prefs_items[] = {
@@ -41,6 +42,13 @@ prefs_desc platform_prefs_items[] = {
 	{"dsp", TYPE_STRING, false,            "audio output (dsp) device name"},
 	{"mixer", TYPE_STRING, false,          "audio mixer device name"},
 	{"idlewait", TYPE_BOOLEAN, false,      "sleep when idle"},
+	{"ticklessidle", TYPE_INT32, false,    "suspend 60Hz ticks while idle for up to this many milliseconds (not with SDL)"},
+	{"icount", TYPE_INT32, false,          "derive guest time from executed instructions, this many per microsecond (0 = host clock)"},
+	{"persistinterval", TYPE_INT32, false, "write back changed XPRAM and prefs files every this many seconds"},
+	{"headlessshm", TYPE_STRING, false,    "name of shared memory frame buffer of headless display"},
+	{"headlessinput", TYPE_STRING, false,  "path of input socket of headless display"},
+	{"rfbport", TYPE_INT32, false,         "TCP port of RFB (VNC) server for headless display"},
+	{"rfbaddress", TYPE_STRING, false,     "IP address the RFB server listens on (default 127.0.0.1)"},
 #ifdef USE_SDL_VIDEO
 	{"sdlrender", TYPE_STRING, false,      "SDL_Renderer driver (\"auto\", \"software\" (may be faster), etc.)"},
 #endif
@@ -238,16 +246,35 @@ void SavePrefs(void)
 	{
 		create_directories(prefs_dir, 0700);
 	}
-	if ((f = fopen(prefs_name.c_str(), "w")) != NULL)
+
+	// Format into memory, so unchanged prefs aren't written and the file is replaced atomically
+	char *buf = NULL;
+	size_t size = 0;
+#ifdef HAVE_OPEN_MEMSTREAM
+	if ((f = open_memstream(&buf, &size)) != NULL)
 	{
 		SavePrefsToStream(f);
 		fclose(f);
 	}
-	else
+#else
+	if ((f = tmpfile()) != NULL)
+	{
+		SavePrefsToStream(f);
+		size = ftell(f);
+		buf = (char *)malloc(size + 1);
+		rewind(f);
+		size = fread(buf, 1, size, f);
+		fclose(f);
+	}
+#endif
+	if (buf == NULL)
 	{
 		fprintf(stderr, "WARNING: Unable to save %s (%s)\n",
 		        prefs_name.c_str(), strerror(errno));
+		return;
 	}
+	PersistWrite(prefs_name.c_str(), buf, size);
+	free(buf);
 }
 
 /*
@@ -0,0 +1,876 @@
+/*
+ *  rfb_server.cpp - RFB (VNC) server for the headless display
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Clients connect to "rfbport" on the loopback interface, or on the
+ *  address given by "rfbaddress". There is no authentication. The server
+ *  thread accepts clients, parses their messages and sends the queued
+ *  output, input events go straight to the ADB. Frame buffer updates are
+ *  encoded by the headless refresh, which passes the rectangles it found
+ *  changed, so the screen is not compared a second time. Supported are
+ *  the Raw and ZRLE (if built with zlib) encodings and the DesktopSize
+ *  pseudo-encoding for mode changes.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include <vector>
+
+#include "main.h"
+#include "prefs.h"
+#include "adb.h"
+#include "video.h"
+#include "video_headless.h"
+#include "rfb_server.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+using std::vector;
+
+
+// Constants
+const int MAX_CLIENTS = 8;
+const int MAX_DIRTY_RECTS = 64;						// More are merged into their bounding box
+const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;	// Clients with more unsent data get no new updates
+const int ZRLE_TILE = 64;
+
+// Client to server messages
+enum {
+	RFB_SET_PIXEL_FORMAT = 0,
+	RFB_SET_ENCODINGS = 2,
+	RFB_UPDATE_REQUEST = 3,
+	RFB_KEY_EVENT = 4,
+	RFB_POINTER_EVENT = 5,
+	RFB_CUT_TEXT = 6
+};
+
+// Encodings
+const int32 RFB_ENCODING_RAW = 0;
+const int32 RFB_ENCODING_ZRLE = 16;
+const int32 RFB_ENCODING_DESKTOP_SIZE = -223;
+
+// Client states
+enum {
+	STATE_VERSION,		// Waiting for protocol version
+	STATE_SECURITY,		// Waiting for security type
+	STATE_INIT,			// Waiting for ClientInit
+	STATE_NORMAL
+};
+
+struct rfb_pixel_format {
+	uint8 bpp, depth, big_endian, true_colour;
+	uint16 red_max, green_max, blue_max;
+	uint8 red_shift, green_shift, blue_shift;
+};
+
+struct rfb_client {
+	int fd;
+	int state;						// STATE_*
+	int minor_version;				// Protocol version 3.x
+	bool closed;
+	vector<uint8> in;				// Received data not parsed yet
+	vector<uint8> out;				// Data not sent yet, starting at out_pos
+	size_t out_pos;
+
+	rfb_pixel_format format;
+	int cpixel_size, cpixel_offset;	// Compressed pixel for ZRLE
+	int32 encoding;
+	bool desktop_size;				// Client understands DesktopSize
+	uint32 width, height;			// Frame buffer size known to client
+	int buttons;					// Mouse button state
+
+	bool update_requested;
+	bool size_changed;
+	vector<headless_shm_rect> dirty;
+
+#ifdef HAVE_LIBZ
+	z_stream zs;
+	bool zs_active;
+#endif
+};
+
+// Global variables
+bool RFBActive = false;
+
+static pthread_mutex_t rfb_lock = PTHREAD_MUTEX_INITIALIZER;	// Protects everything below
+static pthread_t rfb_thread;
+static bool rfb_thread_active = false;
+static volatile bool rfb_thread_cancel = false;
+
+static int listen_fd = -1;
+static int wake_pipe[2] = {-1, -1};		// Wakes up the server thread when there is output
+static vector<rfb_client *> clients;
+
+static uint32 frame_width, frame_height, frame_depth, frame_bytes_per_row;
+static uint32 frame_palette[256];		// 0x00rrggbb
+
+static const rfb_pixel_format server_format = {32, 24, 0, 1, 255, 255, 255, 16, 8, 0};
+
+
+/*
+ *  Output helpers
+ */
+
+static inline void put8(vector<uint8> &v, uint32 x)
+{
+	v.push_back(x);
+}
+
+static inline void put16(vector<uint8> &v, uint32 x)
+{
+	v.push_back(x >> 8);
+	v.push_back(x);
+}
+
+static inline void put32(vector<uint8> &v, uint32 x)
+{
+	v.push_back(x >> 24);
+	v.push_back(x >> 16);
+	v.push_back(x >> 8);
+	v.push_back(x);
+}
+
+static inline uint32 get16(const uint8 *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32 get32(const uint8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_rect_header(vector<uint8> &v, uint32 x, uint32 y, uint32 w, uint32 h, int32 encoding)
+{
+	put16(v, x);
+	put16(v, y);
+	put16(v, w);
+	put16(v, h);
+	put32(v, encoding);
+}
+
+
+/*
+ *  Pixel formats
+ */
+
+static void put_format(vector<uint8> &v, const rfb_pixel_format &f)
+{
+	put8(v, f.bpp);
+	put8(v, f.depth);
+	put8(v, f.big_endian);
+	put8(v, f.true_colour);
+	put16(v, f.red_max);
+	put16(v, f.green_max);
+	put16(v, f.blue_max);
+	put8(v, f.red_shift);
+	put8(v, f.green_shift);
+	put8(v, f.blue_shift);
+	put8(v, 0);
+	put16(v, 0);
+}
+
+static void use_format(rfb_client *c, const rfb_pixel_format &f)
+{
+	c->format = f;
+
+	// ZRLE sends 3 bytes per pixel if the colour bits fit into either the lower or the upper 3 bytes
+	uint32 bits = (f.red_max << f.red_shift) | (f.green_max << f.green_shift) | (f.blue_max << f.blue_shift);
+	c->cpixel_size = f.bpp / 8;
+	c->cpixel_offset = 0;
+	if (f.bpp == 32 && f.depth <= 24) {
+		if ((bits & 0xff000000) == 0) {
+			c->cpixel_size = 3;
+			c->cpixel_offset = f.big_endian ? 1 : 0;
+		} else if ((bits & 0x000000ff) == 0) {
+			c->cpixel_size = 3;
+			c->cpixel_offset = f.big_endian ? 0 : 1;
+		}
+	}
+}
+
+static bool set_format(rfb_client *c, const uint8 *p)
+{
+	rfb_pixel_format f;
+	f.bpp = p[0];
+	f.depth = p[1];
+	f.big_endian = p[2];
+	f.true_colour = p[3];
+	f.red_max = get16(p + 4);
+	f.green_max = get16(p + 6);
+	f.blue_max = get16(p + 8);
+	f.red_shift = p[10];
+	f.green_shift = p[11];
+	f.blue_shift = p[12];
+	if (!f.true_colour || (f.bpp != 8 && f.bpp != 16 && f.bpp != 32)) {
+		printf("WARNING: RFB client requested unsupported pixel format (%d bpp, true colour %d)\n", f.bpp, f.true_colour);
+		return false;
+	}
+	use_format(c, f);
+	return true;
+}
+
+// Convert w pixels of a Mac frame buffer line starting at x to 0x00rrggbb
+static void convert_line(const uint8 *line, uint32 x, uint32 w, uint32 *dst)
+{
+	switch (frame_depth) {
+		case 1:
+			for (uint32 i = x; i < x + w; i++)
+				*dst++ = frame_palette[(line[i >> 3] >> (7 - (i & 7))) & 1];
+			break;
+		case 2:
+			for (uint32 i = x; i < x + w; i++)
+				*dst++ = frame_palette[(line[i >> 2] >> ((3 - (i & 3)) * 2)) & 3];
+			break;
+		case 4:
+			for (uint32 i = x; i < x + w; i++)
+				*dst++ = frame_palette[(line[i >> 1] >> ((1 - (i & 1)) * 4)) & 15];
+			break;
+		case 8:
+			for (uint32 i = x; i < x + w; i++)
+				*dst++ = frame_palette[line[i]];
+			break;
+		case 16:
+			for (uint32 i = x; i < x + w; i++) {
+				uint32 v = (line[i * 2] << 8) | line[i * 2 + 1];
+				uint32 r = (v >> 10) & 0x1f, g = (v >> 5) & 0x1f, b = v & 0x1f;
+				*dst++ = (((r << 3) | (r >> 2)) << 16) | (((g << 3) | (g >> 2)) << 8) | ((b << 3) | (b >> 2));
+			}
+			break;
+		case 32:
+			for (uint32 i = x; i < x + w; i++)
+				*dst++ = (line[i * 4 + 1] << 16) | (line[i * 4 + 2] << 8) | line[i * 4 + 3];
+			break;
+	}
+}
+
+// Convert 0x00rrggbb to the client's pixel value
+static inline uint32 pack_pixel(const rfb_pixel_format &f, uint32 rgb)
+{
+	uint32 r = (((rgb >> 16) & 0xff) * (f.red_max + 1)) >> 8;
+	uint32 g = (((rgb >> 8) & 0xff) * (f.green_max + 1)) >> 8;
+	uint32 b = ((rgb & 0xff) * (f.blue_max + 1)) >> 8;
+	return (r << f.red_shift) | (g << f.green_shift) | (b << f.blue_shift);
+}
+
+// Append "size" bytes of a pixel value in the client's byte order, starting at byte "offset"
+static inline void put_pixel(vector<uint8> &v, const rfb_pixel_format &f, uint32 pixel, int size, int offset)
+{
+	uint8 b[4];
+	int n = f.bpp / 8;
+	for (int i = 0; i < n; i++)
+		b[i] = f.big_endian ? pixel >> (8 * (n - 1 - i)) : pixel >> (8 * i);
+	v.insert(v.end(), b + offset, b + offset + size);
+}
+
+
+/*
+ *  Encodings
+ */
+
+static void encode_raw(rfb_client *c, const uint8 *base, const headless_shm_rect &r)
+{
+	vector<uint32> rgb(r.w);
+	int size = c->format.bpp / 8;
+	c->out.reserve(c->out.size() + r.w * r.h * size);
+	for (uint32 y = r.y; y < r.y + r.h; y++) {
+		convert_line(base + y * frame_bytes_per_row, r.x, r.w, &rgb[0]);
+		for (uint32 x = 0; x < r.w; x++)
+			put_pixel(c->out, c->format, pack_pixel(c->format, rgb[x]), size, 0);
+	}
+}
+
+#ifdef HAVE_LIBZ
+static bool encode_zrle(rfb_client *c, const uint8 *base, const headless_shm_rect &r)
+{
+	if (!c->zs_active) {
+		memset(&c->zs, 0, sizeof(c->zs));
+		if (deflateInit(&c->zs, Z_BEST_SPEED) != Z_OK)
+			return false;
+		c->zs_active = true;
+	}
+
+	// Tiles of solid colour or raw compressed pixels, row by row
+	vector<uint8> tiles;
+	vector<uint32> pixels(ZRLE_TILE * ZRLE_TILE);
+	for (uint32 ty = r.y; ty < r.y + r.h; ty += ZRLE_TILE) {
+		uint32 th = r.y + r.h - ty < (uint32)ZRLE_TILE ? r.y + r.h - ty : ZRLE_TILE;
+		for (uint32 tx = r.x; tx < r.x + r.w; tx += ZRLE_TILE) {
+			uint32 tw = r.x + r.w - tx < (uint32)ZRLE_TILE ? r.x + r.w - tx : ZRLE_TILE;
+			uint32 n = tw * th;
+			for (uint32 y = 0; y < th; y++)
+				convert_line(base + (ty + y) * frame_bytes_per_row, tx, tw, &pixels[y * tw]);
+			uint32 i = 1;
+			while (i < n && pixels[i] == pixels[0])
+				i++;
+			if (i == n) {
+				put8(tiles, 1);
+				put_pixel(tiles, c->format, pack_pixel(c->format, pixels[0]), c->cpixel_size, c->cpixel_offset);
+			} else {
+				put8(tiles, 0);
+				for (i = 0; i < n; i++)
+					put_pixel(tiles, c->format, pack_pixel(c->format, pixels[i]), c->cpixel_size, c->cpixel_offset);
+			}
+		}
+	}
+
+	// Compress into the output, preceded by the length
+	size_t len_pos = c->out.size();
+	put32(c->out, 0);
+	c->zs.next_in = &tiles[0];
+	c->zs.avail_in = tiles.size();
+	do {
+		size_t pos = c->out.size();
+		size_t chunk = deflateBound(&c->zs, c->zs.avail_in) + 16;
+		c->out.resize(pos + chunk);
+		c->zs.next_out = &c->out[pos];
+		c->zs.avail_out = chunk;
+		if (deflate(&c->zs, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+			return false;
+		c->out.resize(pos + chunk - c->zs.avail_out);
+	} while (c->zs.avail_in > 0 || c->zs.avail_out == 0);
+	uint32 len = c->out.size() - len_pos - 4;
+	c->out[len_pos] = len >> 24;
+	c->out[len_pos + 1] = len >> 16;
+	c->out[len_pos + 2] = len >> 8;
+	c->out[len_pos + 3] = len;
+	return true;
+}
+#endif
+
+
+/*
+ *  Frame buffer updates
+ */
+
+static void add_dirty(rfb_client *c, uint32 x, uint32 y, uint32 w, uint32 h)
+{
+	headless_shm_rect r = {x, y, w, h};
+	c->dirty.push_back(r);
+	if (c->dirty.size() > (size_t)MAX_DIRTY_RECTS) {
+		uint32 x1 = frame_width, y1 = frame_height, x2 = 0, y2 = 0;
+		for (size_t i = 0; i < c->dirty.size(); i++) {
+			const headless_shm_rect &d = c->dirty[i];
+			if (d.x < x1) x1 = d.x;
+			if (d.y < y1) y1 = d.y;
+			if (d.x + d.w > x2) x2 = d.x + d.w;
+			if (d.y + d.h > y2) y2 = d.y + d.h;
+		}
+		c->dirty.clear();
+		r.x = x1;
+		r.y = y1;
+		r.w = x2 - x1;
+		r.h = y2 - y1;
+		c->dirty.push_back(r);
+	}
+}
+
+// Send all dirty rectangles of a client that asked for an update
+static void send_update(rfb_client *c, const uint8 *base)
+{
+	// DesktopSize first, then rectangles clipped to what the client knows
+	bool send_size = c->size_changed && c->desktop_size;
+	if (send_size) {
+		c->width = frame_width;
+		c->height = frame_height;
+	}
+	c->size_changed = false;
+	uint32 w = c->width < frame_width ? c->width : frame_width;
+	uint32 h = c->height < frame_height ? c->height : frame_height;
+	vector<headless_shm_rect> rects;
+	for (size_t i = 0; i < c->dirty.size(); i++) {
+		headless_shm_rect r = c->dirty[i];
+		if (r.x >= w || r.y >= h || r.w == 0 || r.h == 0)
+			continue;
+		if (r.x + r.w > w)
+			r.w = w - r.x;
+		if (r.y + r.h > h)
+			r.h = h - r.y;
+		rects.push_back(r);
+	}
+	c->dirty.clear();
+	if (rects.empty() && !send_size)
+		return;
+
+	put8(c->out, 0);	// FramebufferUpdate
+	put8(c->out, 0);
+	put16(c->out, rects.size() + (send_size ? 1 : 0));
+	if (send_size)
+		put_rect_header(c->out, 0, 0, frame_width, frame_height, RFB_ENCODING_DESKTOP_SIZE);
+	for (size_t i = 0; i < rects.size(); i++) {
+		const headless_shm_rect &r = rects[i];
+		put_rect_header(c->out, r.x, r.y, r.w, r.h, c->encoding);
+#ifdef HAVE_LIBZ
+		if (c->encoding == RFB_ENCODING_ZRLE) {
+			if (!encode_zrle(c, base, r))
+				c->closed = true;
+			continue;
+		}
+#endif
+		encode_raw(c, base, r);
+	}
+	c->update_requested = false;
+}
+
+void RFBUpdate(const uint8 *base, const headless_shm_rect *rects, int num_rects)
+{
+	bool wake = false;
+	pthread_mutex_lock(&rfb_lock);
+	for (size_t i = 0; i < clients.size(); i++) {
+		rfb_client *c = clients[i];
+		if (c->state != STATE_NORMAL || c->closed)
+			continue;
+		for (int j = 0; j < num_rects; j++)
+			add_dirty(c, rects[j].x, rects[j].y, rects[j].w, rects[j].h);
+		if (!c->update_requested || c->out.size() - c->out_pos > MAX_PENDING_OUTPUT)
+			continue;
+		if (c->dirty.empty() && !c->size_changed)
+			continue;
+		send_update(c, base);
+		wake = true;
+	}
+	pthread_mutex_unlock(&rfb_lock);
+	if (wake)
+		write(wake_pipe[1], "", 1);
+}
+
+void RFBSetFormat(uint32 width, uint32 height, uint32 depth, uint32 bytes_per_row)
+{
+	pthread_mutex_lock(&rfb_lock);
+	frame_width = width;
+	frame_height = height;
+	frame_depth = depth;
+	frame_bytes_per_row = bytes_per_row;
+	for (size_t i = 0; i < clients.size(); i++) {
+		rfb_client *c = clients[i];
+		c->size_changed = (c->width != width || c->height != height);
+		c->dirty.clear();
+		add_dirty(c, 0, 0, width, height);
+	}
+	pthread_mutex_unlock(&rfb_lock);
+}
+
+void RFBSetPalette(const uint8 *pal, int num)
+{
+	pthread_mutex_lock(&rfb_lock);
+	for (int i = 0; i < num && i < 256; i++)
+		frame_palette[i] = (pal[i * 3] << 16) | (pal[i * 3 + 1] << 8) | pal[i * 3 + 2];
+	for (size_t i = 0; i < clients.size(); i++) {
+		clients[i]->dirty.clear();
+		add_dirty(clients[i], 0, 0, frame_width, frame_height);
+	}
+	pthread_mutex_unlock(&rfb_lock);
+}
+
+
+/*
+ *  Client messages
+ */
+
+static void handle_pointer(rfb_client *c, int mask, int x, int y)
+{
+	ADBMouseMoved(x, y);
+	for (int b = 0; b < 3; b++) {
+		int bit = 1 << b;
+		if ((mask & bit) && !(c->buttons & bit))
+			ADBMouseDown(b);
+		else if (!(mask & bit) && (c->buttons & bit))
+			ADBMouseUp(b);
+	}
+
+	// Wheel as page up/down
+	if ((mask & 8) && !(c->buttons & 8)) {
+		ADBKeyDown(0x74);
+		ADBKeyUp(0x74);
+	}
+	if ((mask & 16) && !(c->buttons & 16)) {
+		ADBKeyDown(0x79);
+		ADBKeyUp(0x79);
+	}
+	c->buttons = mask;
+}
+
+static void send_server_init(rfb_client *c)
+{
+	static const char name[] = "Mac";
+	c->width = frame_width;
+	c->height = frame_height;
+	put16(c->out, frame_width);
+	put16(c->out, frame_height);
+	put_format(c->out, server_format);
+	put32(c->out, sizeof(name) - 1);
+	c->out.insert(c->out.end(), name, name + sizeof(name) - 1);
+}
+
+// Parse one message, returns the number of bytes used, 0 if incomplete, -1 if the client must be dropped
+static int parse_message(rfb_client *c, const uint8 *p, size_t avail)
+{
+	switch (c->state) {
+		case STATE_VERSION: {
+			if (avail < 12)
+				return 0;
+			int major, minor;
+			if (sscanf((const char *)p, "RFB %03d.%03d", &major, &minor) != 2 || major != 3)
+				return -1;
+			c->minor_version = minor >= 8 ? 8 : (minor == 7 ? 7 : 3);
+			if (c->minor_version == 3) {
+				put32(c->out, 1);	// Security type None
+				c->state = STATE_INIT;
+			} else {
+				put8(c->out, 1);	// One security type: None
+				put8(c->out, 1);
+				c->state = STATE_SECURITY;
+			}
+			return 12;
+		}
+
+		case STATE_SECURITY:
+			if (avail < 1)
+				return 0;
+			if (p[0] != 1)
+				return -1;
+			if (c->minor_version == 8)
+				put32(c->out, 0);	// SecurityResult OK
+			c->state = STATE_INIT;
+			return 1;
+
+		case STATE_INIT:
+			if (avail < 1)
+				return 0;
+			send_server_init(c);
+			c->state = STATE_NORMAL;
+			return 1;
+	}
+
+	if (avail < 1)
+		return 0;
+	switch (p[0]) {
+		case RFB_SET_PIXEL_FORMAT:
+			if (avail < 20)
+				return 0;
+			if (!set_format(c, p + 4))
+				return -1;
+			add_dirty(c, 0, 0, frame_width, frame_height);
+			return 20;
+
+		case RFB_SET_ENCODINGS: {
+			if (avail < 4)
+				return 0;
+			size_t n = get16(p + 2);
+			if (avail < 4 + n * 4)
+				return 0;
+			bool have_encoding = false;
+			c->encoding = RFB_ENCODING_RAW;
+			c->desktop_size = false;
+			for (size_t i = 0; i < n; i++) {
+				int32 e = get32(p + 4 + i * 4);
+				if (e == RFB_ENCODING_DESKTOP_SIZE)
+					c->desktop_size = true;
+				else if (!have_encoding && e == RFB_ENCODING_RAW)
+					have_encoding = true;
+#ifdef HAVE_LIBZ
+				else if (!have_encoding && e == RFB_ENCODING_ZRLE) {
+					c->encoding = RFB_ENCODING_ZRLE;
+					have_encoding = true;
+				}
+#endif
+			}
+			D(bug("RFB client %d uses encoding %d\n", c->fd, c->encoding));
+			return 4 + n * 4;
+		}
+
+		case RFB_UPDATE_REQUEST:
+			if (avail < 10)
+				return 0;
+			if (!p[1])
+				add_dirty(c, get16(p + 2), get16(p + 4), get16(p + 6), get16(p + 8));
+			c->update_requested = true;
+			return 10;
+
+		case RFB_KEY_EVENT: {
+			if (avail < 8)
+				return 0;
+			int code = KeysymToADB(get32(p + 4));
+			if (code >= 0) {
+				if (p[1])
+					ADBKeyDown(code);
+				else
+					ADBKeyUp(code);
+			}
+			return 8;
+		}
+
+		case RFB_POINTER_EVENT:
+			if (avail < 6)
+				return 0;
+			handle_pointer(c, p[1], get16(p + 2), get16(p + 4));
+			return 6;
+
+		case RFB_CUT_TEXT: {
+			if (avail < 8)
+				return 0;
+			uint32 len = get32(p + 4);
+			if (len > 0x100000)
+				return -1;
+			if (avail < 8 + len)
+				return 0;
+			return 8 + len;
+		}
+
+		default:
+			D(bug("RFB client %d sent unknown message %d\n", c->fd, p[0]));
+			return -1;
+	}
+}
+
+static void read_client(rfb_client *c)
+{
+	uint8 buf[4096];
+	ssize_t actual = recv(c->fd, buf, sizeof(buf), 0);
+	if (actual <= 0) {
+		if (actual == 0 || (errno != EAGAIN && errno != EINTR))
+			c->closed = true;
+		return;
+	}
+	c->in.insert(c->in.end(), buf, buf + actual);
+
+	size_t pos = 0;
+	while (pos < c->in.size()) {
+		int used = parse_message(c, &c->in[pos], c->in.size() - pos);
+		if (used < 0) {
+			c->closed = true;
+			break;
+		}
+		if (used == 0)
+			break;
+		pos += used;
+	}
+	c->in.erase(c->in.begin(), c->in.begin() + pos);
+}
+
+static void write_client(rfb_client *c)
+{
+	while (c->out_pos < c->out.size()) {
+		ssize_t actual = send(c->fd, &c->out[c->out_pos], c->out.size() - c->out_pos, MSG_NOSIGNAL);
+		if (actual < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				c->closed = true;
+			break;
+		}
+		c->out_pos += actual;
+	}
+	if (c->out_pos == c->out.size()) {
+		c->out.clear();
+		c->out_pos = 0;
+	} else if (c->out_pos > MAX_PENDING_OUTPUT / 4) {
+		c->out.erase(c->out.begin(), c->out.begin() + c->out_pos);
+		c->out_pos = 0;
+	}
+}
+
+
+/*
+ *  Server thread
+ */
+
+static void accept_client(void)
+{
+	int fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+	if (clients.size() >= (size_t)MAX_CLIENTS) {
+		close(fd);
+		return;
+	}
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	rfb_client *c = new rfb_client;
+	c->fd = fd;
+	c->state = STATE_VERSION;
+	c->minor_version = 3;
+	c->closed = false;
+	c->out_pos = 0;
+	use_format(c, server_format);
+	c->encoding = RFB_ENCODING_RAW;
+	c->desktop_size = false;
+	c->width = c->height = 0;
+	c->buttons = 0;
+	c->update_requested = false;
+	c->size_changed = false;
+#ifdef HAVE_LIBZ
+	c->zs_active = false;
+#endif
+	static const char version[] = "RFB 003.008\n";
+	c->out.insert(c->out.end(), version, version + 12);
+	clients.push_back(c);
+	D(bug("RFB client %d connected\n", fd));
+}
+
+static void delete_client(rfb_client *c)
+{
+	D(bug("RFB client %d disconnected\n", c->fd));
+	close(c->fd);
+#ifdef HAVE_LIBZ
+	if (c->zs_active)
+		deflateEnd(&c->zs);
+#endif
+	delete c;
+}
+
+static void *rfb_func(void *arg)
+{
+	vector<struct pollfd> fds;
+	while (!rfb_thread_cancel) {
+		pthread_mutex_lock(&rfb_lock);
+		fds.resize(2 + clients.size());
+		fds[0].fd = listen_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = wake_pipe[0];
+		fds[1].events = POLLIN;
+		for (size_t i = 0; i < clients.size(); i++) {
+			fds[2 + i].fd = clients[i]->fd;
+			fds[2 + i].events = POLLIN | (clients[i]->out_pos < clients[i]->out.size() ? POLLOUT : 0);
+		}
+		pthread_mutex_unlock(&rfb_lock);
+
+		if (poll(&fds[0], fds.size(), 100) < 0)
+			continue;
+
+		if (fds[1].revents & POLLIN) {
+			char buf[64];
+			read(wake_pipe[0], buf, sizeof(buf));
+		}
+
+		// Clients are only added and removed by this thread, so fds[] still matches
+		pthread_mutex_lock(&rfb_lock);
+		for (size_t i = 0; i < fds.size() - 2; i++) {
+			rfb_client *c = clients[i];
+			if (fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR))
+				read_client(c);
+			if (!c->closed)
+				write_client(c);
+		}
+		for (size_t i = 0; i < clients.size(); ) {
+			if (clients[i]->closed) {
+				delete_client(clients[i]);
+				clients.erase(clients.begin() + i);
+			} else
+				i++;
+		}
+		if (fds[0].revents & POLLIN)
+			accept_client();
+		pthread_mutex_unlock(&rfb_lock);
+	}
+	return NULL;
+}
+
+
+/*
+ *  Initialization
+ */
+
+bool RFBInit(void)
+{
+	int port = PrefsFindInt32("rfbport");
+	if (port <= 0)
+		return false;
+	const char *address = PrefsFindString("rfbaddress");
+
+	struct sockaddr_in sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons(port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (address && inet_aton(address, &sa.sin_addr) == 0) {
+		printf("WARNING: Invalid RFB server address '%s'\n", address);
+		return false;
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		printf("WARNING: Cannot create RFB server socket: %s\n", strerror(errno));
+		return false;
+	}
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(listen_fd, 4) < 0 || pipe(wake_pipe) < 0) {
+		printf("WARNING: Cannot listen on RFB port %d: %s\n", port, strerror(errno));
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+	fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+	// Until the Mac sets a palette, index 0 is white and the rest black
+	frame_palette[0] = 0xffffff;
+
+	rfb_thread_cancel = false;
+	rfb_thread_active = (pthread_create(&rfb_thread, NULL, rfb_func, NULL) == 0);
+	if (!rfb_thread_active) {
+		RFBExit();
+		return false;
+	}
+	D(bug("RFB server listening on %s:%d\n", inet_ntoa(sa.sin_addr), port));
+	RFBActive = true;
+	return true;
+}
+
+void RFBExit(void)
+{
+	RFBActive = false;
+	if (rfb_thread_active) {
+		rfb_thread_cancel = true;
+		pthread_join(rfb_thread, NULL);
+		rfb_thread_active = false;
+	}
+	for (size_t i = 0; i < clients.size(); i++)
+		delete_client(clients[i]);
+	clients.clear();
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+	}
+	if (wake_pipe[0] >= 0) {
+		close(wake_pipe[0]);
+		close(wake_pipe[1]);
+		wake_pipe[0] = wake_pipe[1] = -1;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+ *  rfb_server.h - RFB (VNC) server for the headless display
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef RFB_SERVER_H
+#define RFB_SERVER_H
+
+// Flag: Server is running (set by RFBInit())
+extern bool RFBActive;
+
+// Start the server if the "rfbport" pref is set, returns true if it is running
+extern bool RFBInit(void);
+extern void RFBExit(void);
+
+// Called by video_headless.cpp with its buffer lock held
+extern void RFBSetFormat(uint32 width, uint32 height, uint32 depth, uint32 bytes_per_row);
+extern void RFBSetPalette(const uint8 *pal, int num);
+extern void RFBUpdate(const uint8 *base, const headless_shm_rect *rects, int num_rects);
+
+// Translate an X keysym (as used by RFB key events) to a Mac keycode, -1 if unknown (in video_x.cpp)
+extern int KeysymToADB(uint32 keysym);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ *  serial_bench.cpp - Serial driver benchmark over a pty loopback
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The driver opens the slave side of a pty as "seriala", a thread echoes
+ *  everything that arrives on the master side back. Commands are issued
+ *  the way the Mac does, completions are picked up when the driver
+ *  triggers the serial interrupt. Measured are the round trip time of
+ *  single bytes and the throughput of streaming 4K reads and writes; all
+ *  received data is checked.
+ *
+ *  SERIAL_SRC selects the driver, so an older serial_unix.cpp can be
+ *  compared against the current one:
+ *    make serial_bench SERIAL_BENCH_SRC=/tmp/serial_unix_old.cpp
+ *
+ *  Usage: serial_bench [MB]
+ */
+
+#ifndef SERIAL_SRC
+#define SERIAL_SRC "serial_unix.cpp"
+#endif
+
+#include SERIAL_SRC
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+// Glue
+uintptr MEMBaseDiff;
+SERDPort *the_serd_port[2];
+static char slave_path[128];
+const char *PrefsFindString(const char *name, int index) { return strcmp(name, "seriala") == 0 ? slave_path : NULL; }
+void Set_pthread_attr(pthread_attr_t *attr, int priority) { pthread_attr_init(attr); }
+extern "C" {
+int pty_allocate(int *ptyfd, int *ttyfd, char *ttyname, int ttynamelen) { return 0; }
+void pty_make_controlling_tty(int *ttyfd, const char *ttyname) {}
+}
+
+// Completions are signalled through the serial interrupt
+static pthread_mutex_t irq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t irq_cond = PTHREAD_COND_INITIALIZER;
+static uint32 num_irqs = 0;
+
+void SetInterruptFlag(uint32 flag) {}
+
+void TriggerInterrupt(void)
+{
+	pthread_mutex_lock(&irq_lock);
+	num_irqs++;
+	pthread_cond_broadcast(&irq_cond);
+	pthread_mutex_unlock(&irq_lock);
+}
+
+// Mac memory layout
+const uint32 MEM_SIZE = 0x40000;
+const uint32 IN_PB = 0x1000;
+const uint32 OUT_PB = 0x1100;
+const uint32 IN_DT = 0x1200;
+const uint32 OUT_DT = 0x1300;
+const uint32 OUT_BUF = 0x10000;
+const uint32 IN_BUF = 0x20000;
+const uint32 CHUNK = 4096;
+
+static uint8 *mem;
+
+
+/*
+ *  Echo thread on the master side
+ */
+
+static void *echo_func(void *arg)
+{
+	int fd = *(int *)arg;
+	uint8 buf[16384];
+	for (;;) {
+		ssize_t actual = read(fd, buf, sizeof(buf));
+		if (actual <= 0)
+			break;
+		for (ssize_t done = 0; done < actual; ) {
+			ssize_t n = write(fd, buf + done, actual - done);
+			if (n <= 0)
+				return NULL;
+			done += n;
+		}
+	}
+	return NULL;
+}
+
+
+/*
+ *  Benchmark
+ */
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void start_read(SERDPort *p, uint32 len)
+{
+	WriteMacInt32(IN_PB + ioBuffer, IN_BUF);
+	WriteMacInt32(IN_PB + ioReqCount, len);
+	p->prime_in(IN_PB, 0);
+}
+
+static void start_write(SERDPort *p, uint32 len)
+{
+	WriteMacInt32(OUT_PB + ioBuffer, OUT_BUF);
+	WriteMacInt32(OUT_PB + ioReqCount, len);
+	p->prime_out(OUT_PB, 0);
+}
+
+// Wait for serial interrupts until one (or both) of the commands is done
+static void wait_irq(SERDPort *p, bool both)
+{
+	pthread_mutex_lock(&irq_lock);
+	while (both ? !p->read_done || !p->write_done : !p->read_done && !p->write_done)
+		pthread_cond_wait(&irq_cond, &irq_lock);
+	pthread_mutex_unlock(&irq_lock);
+}
+
+static uint8 pattern(uint64 pos) { return uint8(pos * 7 + (pos >> 11)); }
+
+int main(int argc, char **argv)
+{
+	uint64 total = (argc > 1 ? atoi(argv[1]) : 16) * 1048576ULL;
+	mem = new uint8[MEM_SIZE];
+	memset(mem, 0, MEM_SIZE);
+	MEMBaseDiff = (uintptr)mem;
+
+	// pty loopback
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+		perror("posix_openpt");
+		return 1;
+	}
+	strncpy(slave_path, ptsname(master), sizeof(slave_path) - 1);
+	struct termios t;
+	tcgetattr(master, &t);
+	cfmakeraw(&t);
+	tcsetattr(master, TCSANOW, &t);
+	pthread_t echo_thread;
+	pthread_create(&echo_thread, NULL, echo_func, &master);
+
+	SerialInit();
+	SERDPort *p = the_serd_port[0];
+	p->input_dt = IN_DT;
+	p->output_dt = OUT_DT;
+	if (p->open(stop10 | noParity | data8 | baud57600) != noErr) {
+		fprintf(stderr, "Can't open %s\n", slave_path);
+		return 1;
+	}
+	int errors = 0;
+
+	// Round trip of single bytes
+	const int ROUND_TRIPS = 5000;
+	double start = now();
+	for (int i = 0; i < ROUND_TRIPS; i++) {
+		WriteMacInt8(OUT_BUF, i);
+		start_read(p, 1);
+		start_write(p, 1);
+		wait_irq(p, true);
+		p->read_done = p->write_done = false;
+		if (ReadMacInt32(IN_PB + ioActCount) != 1 || ReadMacInt8(IN_BUF) != uint8(i))
+			errors++;
+	}
+	double rtt = (now() - start) / ROUND_TRIPS;
+
+	// Streaming
+	uint64 sent = 0, received = 0;
+	uint32 irqs = num_irqs, reads = 0;
+	start = now();
+	for (uint32 i = 0; i < CHUNK; i++)
+		WriteMacInt8(OUT_BUF + i, pattern(i));
+	start_read(p, CHUNK);
+	start_write(p, CHUNK);
+	sent = CHUNK;
+	while (received < total) {
+		wait_irq(p, false);
+		if (p->write_done) {
+			p->write_done = false;
+			if (ReadMacInt32(OUT_PB + ioActCount) != CHUNK)
+				errors++;
+			if (sent < total) {
+				for (uint32 i = 0; i < CHUNK; i++)
+					WriteMacInt8(OUT_BUF + i, pattern(sent + i));
+				start_write(p, CHUNK);
+				sent += CHUNK;
+			}
+		}
+		if (p->read_done) {
+			p->read_done = false;
+			uint32 actual = ReadMacInt32(IN_PB + ioActCount);
+			if (actual == 0)
+				errors++;
+			for (uint32 i = 0; i < actual; i++)
+				if (ReadMacInt8(IN_BUF + i) != pattern(received + i)) {
+					errors++;
+					break;
+				}
+			received += actual;
+			reads++;
+			if (received < total)
+				start_read(p, CHUNK);
+		}
+	}
+	double mbs = total / (now() - start) / 1048576.0;
+	irqs = num_irqs - irqs;
+
+	p->close();
+	SerialExit();
+	pthread_join(echo_thread, NULL);	// Ends when the slave side is closed
+	close(master);
+
+	printf("round trip %.1f us, %.2f MB/s, %.0f bytes per read, %u interrupts\n", rtt * 1e6, mbs, double(total) / reads, irqs);
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
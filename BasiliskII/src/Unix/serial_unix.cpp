@@ -29,9 +29,14 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <pthread.h>
-#include <semaphore.h>
 #include <termios.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #ifdef __linux__
 #include <linux/lp.h>
@@ -91,32 +96,13 @@ public:
 		protocol = serial;
 		fd = -1;
 		pid = 0;
-		input_thread_active = output_thread_active = false;
-
-		Set_pthread_attr(&thread_attr, 2);
+		input_pb = output_pb = 0;
+		in_pos = in_count = 0;
+		in_eof = in_error = false;
+		polled_fd = -1;
 	}
 
-	virtual ~XSERDPort()
-	{
-		if (input_thread_active) {
-			input_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-			pthread_cancel(input_thread);
-#endif
-			pthread_join(input_thread, NULL);
-			sem_destroy(&input_signal);
-			input_thread_active = false;
-		}
-		if (output_thread_active) {
-			output_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-			pthread_cancel(output_thread);
-#endif
-			pthread_join(output_thread, NULL);
-			sem_destroy(&output_signal);
-			output_thread_active = false;
-		}
-	}
+	virtual ~XSERDPort() {}
 
 	virtual int16 open(uint16 config);
 	virtual int16 prime_in(uint32 pb, uint32 dce);
@@ -125,40 +111,64 @@ public:
 	virtual int16 status(uint32 pb, uint32 dce, uint16 code);
 	virtual int16 close(void);
 
+	bool do_io(void);
+	uint32 wanted_events(void);
+
+	int fd;								// FD of device
+	int polled_fd;						// FD as known to the I/O thread (-1 = not polled)
+
 private:
 	bool open_pty(void);
 	bool configure(uint16 config);
 	void set_handshake(uint32 s, bool with_dtr);
-	static void *input_func(void *arg);
-	static void *output_func(void *arg);
+	void fill_input(void);
+	void abort_io(void);
 
 	const char *device_name;			// Device name
 	enum {serial, parallel, pty, midi}
 		protocol;						// Type of device
-	int fd;								// FD of device
 	pid_t pid;							// PID of child process
 
-	bool io_killed;						// Flag: KillIO called, I/O threads must not call deferred tasks
-	bool quitting;						// Flag: Quit threads
-
-	pthread_attr_t thread_attr;			// Input/output thread attributes
-
-	bool input_thread_active;			// Flag: Input thread installed
-	volatile bool input_thread_cancel;	// Flag: Cancel input thread
-	pthread_t input_thread;				// Data input thread
-	sem_t input_signal;					// Signal for input thread: execute command
-	uint32 input_pb;					// Command parameter for input thread
+	// The following fields are protected by io_lock
+	uint32 input_pb;					// Pending read command, 0 = none or already completed
+	uint32 output_pb;					// Pending write command, 0 = none or already completed
+	uint32 output_done;					// Number of bytes of output_pb already written
 
-	bool output_thread_active;			// Flag: Output thread installed
-	volatile bool output_thread_cancel;	// Flag: Cancel output thread
-	pthread_t output_thread;			// Data output thread
-	sem_t output_signal;				// Signal for output thread: execute command
-	uint32 output_pb;					// Command parameter for output thread
+	static const uint32 IN_BUF_SIZE = 4096;
+	uint8 in_buf[IN_BUF_SIZE];			// Ring buffer for data received from the device
+	uint32 in_pos;						// Index of first byte in in_buf
+	uint32 in_count;					// Number of bytes in in_buf
+	bool in_eof;						// Flag: device returned end of file
+	bool in_error;						// Flag: reading from device failed
 
 	struct termios mode;				// Terminal configuration
 };
 
 
+// Serial I/O thread shared by all ports
+static pthread_t io_thread;
+static bool io_thread_active = false;			// Flag: I/O thread installed
+static volatile bool io_thread_cancel = false;	// Flag: Cancel I/O thread
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static int io_wakeup[2] = {-1, -1};				// Pipe for waking up the I/O thread
+static bool io_thread_waiting = false;			// Flag: I/O thread may be sleeping, commands must wake it up
+#ifdef HAVE_SYS_EPOLL_H
+static int io_epoll_fd = -1;
+#endif
+
+static void *io_func(void *arg);
+
+// Wake up I/O thread to look at new commands, unless it is already awake (io_lock held)
+static void wakeup_io_thread(void)
+{
+	if (io_thread_waiting && io_wakeup[1] >= 0) {
+		io_thread_waiting = false;
+		uint8 b = 0;
+		while (write(io_wakeup[1], &b, 1) < 0 && errno == EINTR) ;
+	}
+}
+
+
 /*
  *  Initialization
  */
@@ -168,6 +178,31 @@ void SerialInit(void)
 	// Read serial preferences and create structs for both ports
 	the_serd_port[0] = new XSERDPort(PrefsFindString("seriala"));
 	the_serd_port[1] = new XSERDPort(PrefsFindString("serialb"));
+
+	// Start I/O thread
+	if (pipe(io_wakeup) < 0) {
+		io_wakeup[0] = io_wakeup[1] = -1;
+		return;
+	}
+	fcntl(io_wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(io_wakeup[1], F_SETFL, O_NONBLOCK);
+#ifdef HAVE_SYS_EPOLL_H
+	io_epoll_fd = epoll_create(4);
+	if (io_epoll_fd >= 0) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = NULL;
+		epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, io_wakeup[0], &ev);
+	}
+#endif
+	pthread_attr_t io_thread_attr;
+	pthread_attr_init(&io_thread_attr);
+	Set_pthread_attr(&io_thread_attr, 2);
+	io_thread_cancel = false;
+	io_thread_active = (pthread_create(&io_thread, &io_thread_attr, io_func, NULL) == 0);
+	pthread_attr_destroy(&io_thread_attr);
+	if (!io_thread_active)
+		printf("WARNING: Cannot start serial I/O thread\n");
 }
 
 
@@ -177,6 +212,28 @@ void SerialInit(void)
 
 void SerialExit(void)
 {
+	// Stop I/O thread
+	if (io_thread_active) {
+		pthread_mutex_lock(&io_lock);
+		io_thread_cancel = true;
+		io_thread_waiting = true;	// The thread may be past its check of io_thread_cancel
+		wakeup_io_thread();
+		pthread_mutex_unlock(&io_lock);
+		pthread_join(io_thread, NULL);
+		io_thread_active = false;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	if (io_epoll_fd >= 0) {
+		::close(io_epoll_fd);
+		io_epoll_fd = -1;
+	}
+#endif
+	if (io_wakeup[0] >= 0) {
+		::close(io_wakeup[0]);
+		::close(io_wakeup[1]);
+		io_wakeup[0] = io_wakeup[1] = -1;
+	}
+
 	delete (XSERDPort *)the_serd_port[0];
 	delete (XSERDPort *)the_serd_port[1];
 }
@@ -193,8 +250,8 @@ int16 XSERDPort::open(uint16 config)
 		return openErr;
 
 	// Init variables
-	io_killed = false;
-	quitting = false;
+	if (!io_thread_active)
+		return openErr;
 
 	// Open port, according to the syntax of the path
 	if (device_name[0] == '|') {
@@ -239,38 +296,17 @@ int16 XSERDPort::open(uint16 config)
 	}
 	configure(config);
 
-	// Start input/output threads
-	input_thread_cancel = false;
-	output_thread_cancel = false;
-	if (sem_init(&input_signal, 0, 0) < 0)
-		goto open_error;
-	if (sem_init(&output_signal, 0, 0) < 0)
-		goto open_error; 
-	input_thread_active = (pthread_create(&input_thread, &thread_attr, input_func, this) == 0);
-	output_thread_active = (pthread_create(&output_thread, &thread_attr, output_func, this) == 0);
-	if (!input_thread_active || !output_thread_active)
-		goto open_error;
+	// Hand port over to the I/O thread
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	pthread_mutex_lock(&io_lock);
+	input_pb = output_pb = 0;
+	in_pos = in_count = 0;
+	in_eof = in_error = false;
+	wakeup_io_thread();
+	pthread_mutex_unlock(&io_lock);
 	return noErr;
 
 open_error:
-	if (input_thread_active) {
-		input_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(input_thread);
-#endif
-		pthread_join(input_thread, NULL);
-		sem_destroy(&input_signal);
-		input_thread_active = false;
-	}
-	if (output_thread_active) {
-		output_thread_cancel = true;
-#ifdef HAVE_PTHREAD_CANCEL
-		pthread_cancel(output_thread);
-#endif
-		pthread_join(output_thread, NULL);
-		sem_destroy(&output_signal);
-		output_thread_active = false;
-	}
 	if (fd > 0) {
 		::close(fd);
 		fd = -1;
@@ -285,12 +321,14 @@ open_error:
 
 int16 XSERDPort::prime_in(uint32 pb, uint32 dce)
 {
-	// Send input command to input_thread
+	// Send input command to I/O thread
+	pthread_mutex_lock(&io_lock);
 	read_done = false;
 	read_pending = true;
 	input_pb = pb;
 	WriteMacInt32(input_dt + serdtDCE, dce);
-	sem_post(&input_signal);
+	wakeup_io_thread();
+	pthread_mutex_unlock(&io_lock);
 	return 1;	// Command in progress
 }
 
@@ -301,12 +339,15 @@ int16 XSERDPort::prime_in(uint32 pb, uint32 dce)
 
 int16 XSERDPort::prime_out(uint32 pb, uint32 dce)
 {
-	// Send output command to output_thread
+	// Send output command to I/O thread
+	pthread_mutex_lock(&io_lock);
 	write_done = false;
 	write_pending = true;
 	output_pb = pb;
+	output_done = 0;
 	WriteMacInt32(output_dt + serdtDCE, dce);
-	sem_post(&output_signal);
+	wakeup_io_thread();
+	pthread_mutex_unlock(&io_lock);
 	return 1;	// Command in progress
 }
 
@@ -319,12 +360,9 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 {
 	switch (code) {
 		case 1:			// KillIO
-			io_killed = true;
 			if (protocol == serial)
 				tcflush(fd, TCIOFLUSH);
-			while (read_pending || write_pending)
-				usleep(10000);
-			io_killed = false;
+			abort_io();
 			return noErr;
 
 		case kSERDConfiguration:
@@ -434,6 +472,10 @@ int16 XSERDPort::control(uint32 pb, uint32 dce, uint16 code)
 		case kSERDResetChannel:
 			if (protocol == serial)
 				tcflush(fd, TCIOFLUSH);
+			pthread_mutex_lock(&io_lock);
+			in_pos = in_count = 0;
+			in_eof = in_error = false;
+			pthread_mutex_unlock(&io_lock);
 			return noErr;
 
 		case kSERDAssertRTS: {
@@ -484,8 +526,11 @@ int16 XSERDPort::status(uint32 pb, uint32 dce, uint16 code)
 {
 	switch (code) {
 		case kSERDInputCount: {
-			int num;
+			int num = 0;
 			ioctl(fd, FIONREAD, &num);
+			pthread_mutex_lock(&io_lock);
+			num += in_count;
+			pthread_mutex_unlock(&io_lock);
 			WriteMacInt32(pb + csParam, num);
 			return noErr;
 		}
@@ -529,26 +574,21 @@ int16 XSERDPort::status(uint32 pb, uint32 dce, uint16 code)
 
 int16 XSERDPort::close()
 {
-	// Kill threads
-	if (input_thread_active) {
-		quitting = true;
-		sem_post(&input_signal);
-		pthread_join(input_thread, NULL);
-		input_thread_active = false;
-		sem_destroy(&input_signal);
-	}
-	if (output_thread_active) {
-		quitting = true;
-		sem_post(&output_signal);
-		pthread_join(output_thread, NULL);
-		output_thread_active = false;
-		sem_destroy(&output_signal);
-	}
+	// Take port away from the I/O thread
+	pthread_mutex_lock(&io_lock);
+#ifdef HAVE_SYS_EPOLL_H
+	if (polled_fd >= 0)
+		epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, polled_fd, NULL);
+#endif
+	polled_fd = -1;
+	input_pb = output_pb = 0;
 
 	// Close port
 	if (fd > 0)
 		::close(fd);
 	fd = -1;
+	wakeup_io_thread();
+	pthread_mutex_unlock(&io_lock);
 
 	// Wait for the subprocess to exit
 	if (pid)
@@ -721,119 +761,255 @@ void XSERDPort::set_handshake(uint32 s, bool with_dtr)
 
 
 /*
- *  Data input thread
+ *  Abort pending commands (KillIO)
  */
 
-void *XSERDPort::input_func(void *arg)
+void XSERDPort::abort_io(void)
 {
-	XSERDPort *s = (XSERDPort *)arg;
-	while (!s->input_thread_cancel) {
+	pthread_mutex_lock(&io_lock);
+	if (input_pb) {
+		WriteMacInt16(input_pb + ioResult, uint16(abortErr));
+		WriteMacInt32(input_pb + ioActCount, 0);
+		read_pending = read_done = false;
+		input_pb = 0;
+	}
+	if (output_pb) {
+		WriteMacInt16(output_pb + ioResult, uint16(abortErr));
+		WriteMacInt32(output_pb + ioActCount, 0);
+		write_pending = write_done = false;
+		output_pb = 0;
+	}
+	in_pos = in_count = 0;
+	in_eof = in_error = false;
+	pthread_mutex_unlock(&io_lock);
+}
+
+
+/*
+ *  Read everything the device has to offer into the input buffer (io_lock held)
+ */
 
-		// Wait for commands
-		sem_wait(&s->input_signal);
-		if (s->quitting)
+void XSERDPort::fill_input(void)
+{
+	while (in_count < IN_BUF_SIZE && !in_eof && !in_error) {
+		uint32 end = (in_pos + in_count) % IN_BUF_SIZE;
+		uint32 len = (end >= in_pos) ? IN_BUF_SIZE - end : in_pos - end;
+		ssize_t actual = read(fd, in_buf + end, len);
+		if (actual > 0)
+			in_count += actual;
+		else if (actual == 0)
+			in_eof = true;
+		else if (errno == EINTR)
+			continue;
+		else {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				in_error = true;
 			break;
+		}
+	}
+}
+
+
+/*
+ *  Do all possible work for the port without blocking, returns true if
+ *  a command was completed (io_lock held)
+ */
+
+bool XSERDPort::do_io(void)
+{
+	if (fd < 0)
+		return false;
+	bool completed = false;
+
+	// With nothing buffered, a read command takes the data straight from the device
+	uint32 direct = 0;
+	bool drained = false;
+	if (input_pb && in_count == 0 && !in_eof && !in_error) {
+		uint8 *buf = Mac2HostAddr(ReadMacInt32(input_pb + ioBuffer));
+		ssize_t actual;
+		do {
+			actual = read(fd, buf, ReadMacInt32(input_pb + ioReqCount));
+		} while (actual < 0 && errno == EINTR);
+		if (actual > 0)
+			direct = actual;
+		else if (actual == 0)
+			in_eof = true;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK)
+			in_error = true;
+		else
+			drained = true;
+	}
 
-		// Execute command
-		void *buf = Mac2HostAddr(ReadMacInt32(s->input_pb + ioBuffer));
-		uint32 length = ReadMacInt32(s->input_pb + ioReqCount);
-		D(bug("input_func waiting for %ld bytes of data...\n", length));
-		int32 actual = read(s->fd, buf, length);
-		D(bug(" %ld bytes received\n", actual));
+	// Collect input, complete read command with everything available up to the requested length
+	// (parallel ports are only read on request)
+	if (!direct && !drained && (protocol != parallel || input_pb))
+		fill_input();
+	if (input_pb && (direct || in_count || in_eof || in_error)) {
+		uint8 *buf = Mac2HostAddr(ReadMacInt32(input_pb + ioBuffer));
+		uint32 length = ReadMacInt32(input_pb + ioReqCount);
+		uint32 actual = direct;
+		while (actual < length && in_count) {
+			uint32 chunk = IN_BUF_SIZE - in_pos;
+			if (chunk > in_count)
+				chunk = in_count;
+			if (chunk > length - actual)
+				chunk = length - actual;
+			memcpy(buf + actual, in_buf + in_pos, chunk);
+			actual += chunk;
+			in_pos = (in_pos + chunk) % IN_BUF_SIZE;
+			in_count -= chunk;
+		}
+		D(bug(" %d of %d bytes received\n", actual, length));
 
 #if MONITOR
 		bug("Receiving serial data:\n");
-		uint8 *adr = (uint8 *)buf;
-		for (int i=0; i<actual; i++) {
-			bug("%02x ", adr[i]);
+		for (uint32 i=0; i<actual; i++) {
+			bug("%02x ", buf[i]);
 		}
 		bug("\n");
 #endif
 
-		// KillIO called? Then simply return
-		if (s->io_killed) {
-
-			WriteMacInt16(s->input_pb + ioResult, uint16(abortErr));
-			WriteMacInt32(s->input_pb + ioActCount, 0);
-			s->read_pending = s->read_done = false;
+		// Set error code (end of file and read errors are reported once, then the device is read again)
+		WriteMacInt32(input_pb + ioActCount, actual);
+		WriteMacInt32(input_dt + serdtResult, actual == 0 && in_error ? uint16(readErr) : noErr);
+		in_eof = false;
+		if (actual == 0)
+			in_error = false;
+		input_pb = 0;
+		read_done = true;
+		completed = true;
+	}
 
-		} else {
+	// Write as much of the output command as the device accepts, complete it when everything is written
+	if (output_pb) {
+		uint8 *buf = Mac2HostAddr(ReadMacInt32(output_pb + ioBuffer));
+		uint32 length = ReadMacInt32(output_pb + ioReqCount);
+		bool error = false;
+		while (output_done < length) {
+			ssize_t actual = write(fd, buf + output_done, length - output_done);
+			if (actual >= 0)
+				output_done += actual;
+			else if (errno != EINTR) {
+				error = (errno != EAGAIN && errno != EWOULDBLOCK);
+				break;
+			}
+		}
+		if (output_done == length || error) {
+			D(bug(" %d of %d bytes transmitted\n", output_done, length));
 
-			// Set error code
-			if (actual >= 0) {
-				WriteMacInt32(s->input_pb + ioActCount, actual);
-				WriteMacInt32(s->input_dt + serdtResult, noErr);
-			} else {
-				WriteMacInt32(s->input_pb + ioActCount, 0);
-				WriteMacInt32(s->input_dt + serdtResult, uint16(readErr));
+#if MONITOR
+			bug("Sending serial data:\n");
+			for (uint32 i=0; i<output_done; i++) {
+				bug("%02x ", buf[i]);
 			}
+			bug("\n");
+#endif
 
-			// Trigger serial interrupt
-			D(bug(" triggering serial interrupt\n"));
-			s->read_done = true;
-			SetInterruptFlag(INTFLAG_SERIAL);
-			TriggerInterrupt();
+			// Set error code
+			WriteMacInt32(output_pb + ioActCount, output_done);
+			WriteMacInt32(output_dt + serdtResult, error ? uint16(writErr) : noErr);
+			output_pb = 0;
+			write_done = true;
+			completed = true;
 		}
 	}
-	return NULL;
+	return completed;
 }
 
 
 /*
- *  Data output thread
+ *  Events the I/O thread has to wait for (io_lock held)
  */
 
-void *XSERDPort::output_func(void *arg)
+uint32 XSERDPort::wanted_events(void)
 {
-	XSERDPort *s = (XSERDPort *)arg;
-	while (!s->output_thread_cancel) {
+	if (fd < 0)
+		return 0;
+	uint32 events = 0;
+	if (in_count < IN_BUF_SIZE && !in_eof && !in_error && (protocol != parallel || input_pb))
+		events |= POLLIN;
+	if (output_pb)
+		events |= POLLOUT;
+	return events;
+}
 
-		// Wait for commands
-		sem_wait(&s->output_signal);
-		if (s->quitting)
-			break;
 
-		// Execute command
-		void *buf = Mac2HostAddr(ReadMacInt32(s->output_pb + ioBuffer));
-		uint32 length = ReadMacInt32(s->output_pb + ioReqCount);
-		D(bug("output_func transmitting %ld bytes of data...\n", length));
+/*
+ *  I/O thread, serves all ports: waits until one of the devices is ready
+ *  or a new command arrives, then moves as much data as possible and
+ *  triggers one serial interrupt for all completed commands
+ */
 
-#if MONITOR
-		bug("Sending serial data:\n");
-		uint8 *adr = (uint8 *)buf;
-		for (int i=0; i<length; i++) {
-			bug("%02x ", adr[i]);
+static void *io_func(void *arg)
+{
+	const int NUM_PORTS = 2;
+	while (!io_thread_cancel) {
+
+		// Move data and complete commands
+		bool completed = false;
+		pthread_mutex_lock(&io_lock);
+		io_thread_waiting = false;
+		for (int i=0; i<NUM_PORTS; i++) {
+			XSERDPort *p = (XSERDPort *)the_serd_port[i];
+			if (p->do_io())
+				completed = true;
 		}
-		bug("\n");
-#endif
-
-		int32 actual = write(s->fd, buf, length);
-		D(bug(" %ld bytes transmitted\n", actual));
 
-		// KillIO called? Then simply return
-		if (s->io_killed) {
-
-			WriteMacInt16(s->output_pb + ioResult, uint16(abortErr));
-			WriteMacInt32(s->output_pb + ioActCount, 0);
-			s->write_pending = s->write_done = false;
-
-		} else {
-
-			// Set error code
-			if (actual >= 0) {
-				WriteMacInt32(s->output_pb + ioActCount, actual);
-				WriteMacInt32(s->output_dt + serdtResult, noErr);
-			} else {
-				WriteMacInt32(s->output_pb + ioActCount, 0);
-				WriteMacInt32(s->output_dt + serdtResult, uint16(writErr));
+		// Update the set of events to wait for (open ports are registered once and edge-triggered,
+		// do_io() reads and writes until the device would block, or until the next command wakes us up)
+#ifdef HAVE_SYS_EPOLL_H
+		int timeout = -1;
+		for (int i=0; i<NUM_PORTS; i++) {
+			XSERDPort *p = (XSERDPort *)the_serd_port[i];
+			if (p->fd < 0 || p->polled_fd == p->fd)
+				continue;
+			struct epoll_event ev;
+			ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+			ev.data.ptr = p;
+			if (epoll_ctl(io_epoll_fd, EPOLL_CTL_ADD, p->fd, &ev) == 0)
+				p->polled_fd = p->fd;
+			else if (p->wanted_events())
+				timeout = 10;	// Device can't be polled (e.g. parallel port), retry periodically
+		}
+#else
+		struct pollfd pfd[NUM_PORTS + 1];
+		int num_pfd = 0;
+		pfd[num_pfd].fd = io_wakeup[0];
+		pfd[num_pfd++].events = POLLIN;
+		for (int i=0; i<NUM_PORTS; i++) {
+			XSERDPort *p = (XSERDPort *)the_serd_port[i];
+			uint32 events = p->wanted_events();
+			if (events) {
+				pfd[num_pfd].fd = p->fd;
+				pfd[num_pfd++].events = events;
 			}
-	
-			// Trigger serial interrupt
+		}
+#endif
+		io_thread_waiting = true;
+		pthread_mutex_unlock(&io_lock);
+
+		// Trigger serial interrupt
+		if (completed) {
 			D(bug(" triggering serial interrupt\n"));
-			s->write_done = true;
 			SetInterruptFlag(INTFLAG_SERIAL);
 			TriggerInterrupt();
 		}
+
+		// Wait for something to do
+#ifdef HAVE_SYS_EPOLL_H
+		struct epoll_event ev[NUM_PORTS + 1];
+		bool woken = false;
+		int num_ev = epoll_wait(io_epoll_fd, ev, NUM_PORTS + 1, timeout);
+		for (int i=0; i<num_ev; i++)
+			if (ev[i].data.ptr == NULL)
+				woken = true;
+#else
+		bool woken = poll(pfd, num_pfd, -1) > 0 && (pfd[0].revents & POLLIN);
+#endif
+		if (woken) {
+			uint8 buf[16];
+			while (read(io_wakeup[0], buf, sizeof(buf)) > 0) ;
+		}
 	}
 	return NULL;
 }
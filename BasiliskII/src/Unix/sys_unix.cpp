@@ -57,6 +57,7 @@
 #include "user_strings.h"
 #include "sys.h"
 #include "disk_unix.h"
+#include "bench.h"
 
 #if defined(BINCUE)
 #include "bincue.h"
@@ -69,6 +70,7 @@
 
 static disk_factory *disk_factories[] = {
 #ifndef STANDALONE_GUI
+	disk_cow_factory,
 	disk_sparsebundle_factory,
 #if defined(HAVE_LIBVHD)
 	disk_vhd_factory,
@@ -754,6 +756,7 @@ size_t Sys_read(void *arg, void *buffer, loff_t offset, size_t length)
 	mac_file_handle *fh = (mac_file_handle *)arg;
 	if (!fh)
 		return 0;
+	BenchDiskRead += length;
 
 #if defined(BINCUE)
 	if (fh->is_bincue)
@@ -782,6 +785,7 @@ size_t Sys_write(void *arg, void *buffer, loff_t offset, size_t length)
 	mac_file_handle *fh = (mac_file_handle *)arg;
 	if (!fh)
 		return 0;
+	BenchDiskWritten += length;
 
 	if (fh->generic_disk)
 		return fh->generic_disk->write(buffer, offset, length);
@@ -960,6 +964,18 @@ bool SysIsFixedDisk(void *arg)
 }
 
 
+/*
+ *  Write back data that disk image drivers hold in memory
+ */
+
+void SysFlushDisks(void)
+{
+	for (open_mac_file_handle *p = open_mac_file_handles; p; p = p->next)
+		if (p->fh->generic_disk && !p->fh->read_only)
+			p->fh->generic_disk->flush();
+}
+
+
 /*
  *  Check if a disk is inserted in the drive (always true for files)
  */
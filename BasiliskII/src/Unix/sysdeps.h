@@ -219,6 +219,7 @@ typedef uae_u32 uaecptr;
 
 /* Timing functions */
 extern uint64 GetTicks_usec(void);
+extern uint64 GuestTicks_usec(void);
 extern void Delay_usec(uint64 usec);
 
 /* Spinlocks */
@@ -20,7 +20,9 @@
 
 #include "sysdeps.h"
 #include "macos_util.h"
+#include "prefs.h"
 #include "timer.h"
+#include "bench.h"
 
 #include <errno.h>
 
@@ -50,6 +52,82 @@ static inline void mach_current_time(tm_time_t &t) {
 #endif
 
 
+/*
+ *  Deterministic time mode: the guest clocks (Microseconds(), Time Manager,
+ *  60Hz tick, date/time and the PowerPC time base) count executed guest
+ *  instructions instead of host time. The CPU core calls ICountService()
+ *  when the instruction deadline of the next tick or timer wakeup is
+ *  reached, so interrupts arrive at the same instruction on every run.
+ *  Idle time is skipped instead of slept.
+ */
+
+uint32 ICountRate = 0;
+
+static const uint32 ICOUNT_DATE = 0xb492f400;	// Date/time at start (1.1.2000 00:00)
+static const uint64 ICOUNT_TICK_USEC = 16625;	// 60Hz tick period, like the tick thread
+
+static uint64 icount_warp = 0;			// Instructions skipped while idle
+static uint64 icount_next_tick;			// Guest clock of next 60Hz tick (in instructions)
+static uint64 icount_deadline;			// Guest clock of next tick or timer wakeup
+
+// Guest clock in instructions
+static inline uint64 icount_now(void)
+{
+	return BenchInstructionCount() + icount_warp;
+}
+
+void ICountInit(void)
+{
+	int32 rate = PrefsFindInt32("icount");
+	if (rate <= 0)
+		return;
+#if defined(PRECISE_TIMING) && !defined(PRECISE_TIMING_POSIX)
+	printf("WARNING: Deterministic time mode not supported with this Time Manager, using host clock\n");
+#else
+	ICountRate = rate;
+	icount_next_tick = ICOUNT_TICK_USEC * rate;
+	icount_deadline = icount_next_tick;
+	D(bug("Deterministic time mode, %d instructions per microsecond\n", rate));
+#endif
+}
+
+// Fire the tick and the Time Manager if they are due, then set the next deadline
+void ICountService(void)
+{
+	if (ICountRate == 0)
+		return;
+
+	uint64 now = icount_now();
+	if (now >= icount_next_tick) {
+		do {
+			icount_next_tick += ICOUNT_TICK_USEC * ICountRate;
+		} while (icount_next_tick <= now);
+		ICountTick();
+	}
+
+	icount_deadline = icount_next_tick;
+	tm_time_t wakeup;
+	if (TimerCheckWakeup(wakeup)) {
+#if defined(HAVE_CLOCK_GETTIME) || defined(__MACH__)
+		uint64 insns = (uint64)wakeup.tv_sec * 1000000 * ICountRate + ((uint64)wakeup.tv_nsec * ICountRate + 999) / 1000;
+#else
+		uint64 insns = ((uint64)wakeup.tv_sec * 1000000 + wakeup.tv_usec) * ICountRate;
+#endif
+		if (insns < icount_deadline)
+			icount_deadline = insns < now ? now : insns;
+	}
+	ICountSetDeadline(icount_deadline - icount_warp);
+}
+
+void ICountIdle(void)
+{
+	uint64 now = icount_now();
+	if (icount_deadline > now)
+		icount_warp += icount_deadline - now;
+	ICountService();
+}
+
+
 /*
  *  Return microseconds since boot (64 bit)
  */
@@ -57,19 +135,7 @@ static inline void mach_current_time(tm_time_t &t) {
 void Microseconds(uint32 &hi, uint32 &lo)
 {
 	D(bug("Microseconds\n"));
-#if defined(__MACH__)
-	tm_time_t t;
-	mach_current_time(t);
-	uint64 tl = (uint64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
-#elif defined(HAVE_CLOCK_GETTIME)
-	struct timespec t;
-	clock_gettime(CLOCK_REALTIME, &t);
-	uint64 tl = (uint64)t.tv_sec * 1000000 + t.tv_nsec / 1000;
-#else
-	struct timeval t;
-	gettimeofday(&t, NULL);
-	uint64 tl = (uint64)t.tv_sec * 1000000 + t.tv_usec;
-#endif
+	uint64 tl = GuestTicks_usec();
 	hi = tl >> 32;
 	lo = tl;
 }
@@ -81,6 +147,8 @@ void Microseconds(uint32 &hi, uint32 &lo)
 
 uint32 TimerDateTime(void)
 {
+	if (ICountRate)
+		return ICOUNT_DATE + GuestTicks_usec() / 1000000;
 	return TimeToMacTime(time(NULL));
 }
 
@@ -91,6 +159,16 @@ uint32 TimerDateTime(void)
 
 void timer_current_time(tm_time_t &t)
 {
+	if (ICountRate) {
+		uint64 nsec = icount_now() * 1000 / ICountRate;
+		t.tv_sec = nsec / 1000000000;
+#if defined(HAVE_CLOCK_GETTIME) || defined(__MACH__)
+		t.tv_nsec = nsec % 1000000000;
+#else
+		t.tv_usec = nsec % 1000000000 / 1000;
+#endif
+		return;
+	}
 #if defined(__MACH__)
 	mach_current_time(t);
 #elif defined(HAVE_CLOCK_GETTIME)
@@ -245,6 +323,18 @@ uint64 GetTicks_usec(void)
 }
 
 
+/*
+ *  Get current value of guest microsecond clock
+ */
+
+uint64 GuestTicks_usec(void)
+{
+	if (ICountRate)
+		return icount_now() / ICountRate;
+	return GetTicks_usec();
+}
+
+
 /*
  *  Delay by specified number of microseconds (<1 second)
  *  (adapted from SDL_Delay() source; this function is designed to provide
@@ -352,11 +442,35 @@ static int idle_sem_ok = -1;
 #endif
 #endif
 
+#ifdef IDLE_USES_COND_WAIT
+// All protected by idle_lock
+static bool idle_pending = false;				// idle_resume() called, don't wait
+static uint32 idle_period_count = 0;			// Number of the current idle period, 0 = not idle
+static uint32 idle_last_period = 0;
+static uint32 idle_wakeups = 0;					// Incremented to wake up threads in idle_sleep()
+static pthread_cond_t idle_sleep_cond = PTHREAD_COND_INITIALIZER;
+static int idle_skipped = 0;					// Ticks skipped by the 60Hz thread, not caught up yet
+#endif
+
 void idle_wait(void)
 {
+	// Nothing but the CPU thread advances the guest clock in deterministic time mode
+	if (ICountRate) {
+		ICountIdle();
+		return;
+	}
+
 #ifdef IDLE_USES_COND_WAIT
 	pthread_mutex_lock(&idle_lock);
-	pthread_cond_wait(&idle_cond, &idle_lock);
+	if (!idle_pending) {
+		if (++idle_last_period == 0)
+			idle_last_period = 1;
+		idle_period_count = idle_last_period;
+		while (!idle_pending)
+			pthread_cond_wait(&idle_cond, &idle_lock);
+		idle_period_count = 0;
+	}
+	idle_pending = false;
 	pthread_mutex_unlock(&idle_lock);
 #else
 #ifdef IDLE_USES_SEMAPHORE
@@ -385,7 +499,12 @@ void idle_wait(void)
 void idle_resume(void)
 {
 #ifdef IDLE_USES_COND_WAIT
+	pthread_mutex_lock(&idle_lock);
+	idle_pending = true;
+	idle_wakeups++;
 	pthread_cond_signal(&idle_cond);
+	pthread_cond_broadcast(&idle_sleep_cond);
+	pthread_mutex_unlock(&idle_lock);
 #else
 #ifdef IDLE_USES_SEMAPHORE
 	LOCK_IDLE;
@@ -399,3 +518,85 @@ void idle_resume(void)
 #endif
 #endif
 }
+
+
+/*
+ *  Tickless idle: while the emulator thread sleeps in idle_wait(), the 60Hz
+ *  and refresh threads have nothing to do until idle_resume() wakes it up.
+ *  That happens on every interrupt, so the Time Manager, ADB input, audio
+ *  and network threads all end the idle period.
+ */
+
+// Return the number of the current idle period, 0 if the emulator thread is not idle
+uint32 idle_period(void)
+{
+#ifdef IDLE_USES_COND_WAIT
+	pthread_mutex_lock(&idle_lock);
+	uint32 period = idle_period_count;
+	pthread_mutex_unlock(&idle_lock);
+	return period;
+#else
+	return 0;
+#endif
+}
+
+// Wait up to max_usec while the emulator thread stays idle (in the given idle period, unless 0), returns false if it wasn't idle
+bool idle_sleep(uint32 period, int32 max_usec)
+{
+#ifdef IDLE_USES_COND_WAIT
+	if (max_usec <= 0)
+		return false;
+
+	struct timespec deadline;
+#ifdef HAVE_CLOCK_GETTIME
+	clock_gettime(CLOCK_REALTIME, &deadline);
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	deadline.tv_sec = tv.tv_sec;
+	deadline.tv_nsec = tv.tv_usec * 1000;
+#endif
+	deadline.tv_sec += max_usec / 1000000;
+	deadline.tv_nsec += (max_usec % 1000000) * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&idle_lock);
+	bool idle = idle_period_count != 0 && !idle_pending && (period == 0 || period == idle_period_count);
+	if (idle) {
+		uint32 wakeups = idle_wakeups;
+		while (wakeups == idle_wakeups)
+			if (pthread_cond_timedwait(&idle_sleep_cond, &idle_lock, &deadline) == ETIMEDOUT)
+				break;
+	}
+	pthread_mutex_unlock(&idle_lock);
+	return idle;
+#else
+	return false;
+#endif
+}
+
+// The 60Hz thread skipped ticks while idle, the emulator thread catches them up
+void idle_skip_ticks(int n)
+{
+#ifdef IDLE_USES_COND_WAIT
+	pthread_mutex_lock(&idle_lock);
+	idle_skipped += n;
+	pthread_mutex_unlock(&idle_lock);
+#endif
+}
+
+int idle_take_skipped_ticks(void)
+{
+#ifdef IDLE_USES_COND_WAIT
+	pthread_mutex_lock(&idle_lock);
+	int n = idle_skipped;
+	idle_skipped = 0;
+	pthread_mutex_unlock(&idle_lock);
+	return n;
+#else
+	return 0;
+#endif
+}
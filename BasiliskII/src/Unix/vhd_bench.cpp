@@ -0,0 +1,255 @@
+/*
+ *  vhd_bench.cpp - Dynamic VHD throughput benchmark, compares plain libvhd
+ *                  I/O against the cached access of disk_vhd
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  An empty dynamic VHD is generated, then filled sequentially (allocating
+ *  all blocks), rewritten, read back, and accessed with random 4K writes
+ *  and reads. This runs once through vhd_io_read()/vhd_io_write() and once
+ *  through disk_vhd, with a flush() after each write pass. Every read is
+ *  checked, and the image written by disk_vhd is read back through libvhd
+ *  at the end.
+ *
+ *  Usage: vhd_bench [file [MB]]
+ */
+
+// Pull in the whole driver, the static libvhd wrappers are used for the
+// reference run
+#include "vhd_unix.cpp"
+
+#include <sys/time.h>
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void put32(uint8 *p, uint32 v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static void put64(uint8 *p, uint64 v) { put32(p, v >> 32); put32(p + 4, v); }
+
+static uint32 checksum(const uint8 *p, size_t len)
+{
+	uint32 sum = 0;
+	for (size_t i = 0; i < len; i++)
+		sum += p[i];
+	return ~sum;
+}
+
+// Write an empty dynamic VHD with 2MB blocks
+static bool create_vhd(const char *path, uint64 size)
+{
+	const uint32 block_size = 2 * 1024 * 1024;
+	uint32 blocks = (size + block_size - 1) / block_size;
+	uint32 bat_bytes = (blocks * 4 + 511) & ~511;
+
+	// CHS geometry as in the VHD specification
+	uint64 secs = std::min(size / 512, (uint64)65535 * 16 * 255);
+	uint32 spt, heads, cth;
+	if (secs >= 65535 * 16 * 63) {
+		spt = 255; heads = 16; cth = secs / spt;
+	} else {
+		spt = 17; cth = secs / spt;
+		heads = std::max((cth + 1023) / 1024, 4U);
+		if (cth >= heads * 1024 || heads > 16) { spt = 31; heads = 16; cth = secs / spt; }
+		if (cth >= heads * 1024) { spt = 63; heads = 16; cth = secs / spt; }
+	}
+
+	uint8 footer[512];
+	memset(footer, 0, sizeof(footer));
+	memcpy(footer, "conectix", 8);
+	put32(footer + 8, 2);					// Features
+	put32(footer + 12, 0x00010000);			// Version
+	put64(footer + 16, 512);				// Dynamic header offset
+	memcpy(footer + 28, "bas2", 4);			// Creator application
+	put32(footer + 36, 0x5769326b);			// Creator host OS ("Wi2k")
+	put64(footer + 40, size);				// Original size
+	put64(footer + 48, size);				// Current size
+	put32(footer + 56, (cth / heads) << 16 | heads << 8 | spt);
+	put32(footer + 60, HD_TYPE_DYNAMIC);
+	for (int i = 0; i < 16; i++)
+		footer[68 + i] = rand();			// UUID
+	put32(footer + 64, checksum(footer, sizeof(footer)));
+
+	uint8 header[1024];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "cxsparse", 8);
+	put64(header + 8, ~0ULL);				// Data offset
+	put64(header + 16, 1536);				// BAT offset
+	put32(header + 24, 0x00010000);			// Version
+	put32(header + 28, blocks);				// BAT entries
+	put32(header + 32, block_size);
+	put32(header + 36, checksum(header, sizeof(header)));
+
+	std::vector<uint8> bat(bat_bytes, 0xff);
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool ok = write(fd, footer, 512) == 512 && write(fd, header, 1024) == 1024
+	       && write(fd, &bat[0], bat_bytes) == (ssize_t)bat_bytes && write(fd, footer, 512) == 512;
+	close(fd);
+	return ok;
+}
+
+// Test data, depends on position and generation
+static void fill(uint8 *buf, loff_t offset, size_t len, uint32 gen)
+{
+	for (size_t i = 0; i < len; i += 4)
+		put32(buf + i, (uint32)((offset + i) >> 2) * 2654435761U ^ gen);
+}
+
+// Access through libvhd or disk_vhd
+struct target {
+	vhd_context_t *ctx;
+	disk_generic *disk;
+	size_t read(void *buf, loff_t offset, size_t len) {
+		return disk ? disk->read(buf, offset, len) : vhd_unix_read(ctx, buf, offset, len);
+	}
+	size_t write(void *buf, loff_t offset, size_t len) {
+		return disk ? disk->write(buf, offset, len) : vhd_unix_write(ctx, buf, offset, len);
+	}
+	void flush(void) { if (disk) disk->flush(); }
+};
+
+const size_t SEQ_CHUNK = 64 * 1024;
+const size_t RND_CHUNK = 4096;
+const int RND_OPS = 20000;
+enum { SEQ_ALLOC, SEQ_REWRITE, SEQ_READ, RND_WRITE, RND_READ, NUM_PASSES };
+static const char *pass_names[NUM_PASSES] = {"alloc", "rewrite", "read", "4K write", "4K read"};
+
+// Run all passes, return number of bad transfers
+static int run(target &t, uint64 size, std::vector<uint32> &gen, double *mbs)
+{
+	std::vector<uint8> buf(SEQ_CHUNK), ref(SEQ_CHUNK);
+	int errors = 0;
+	for (int pass = SEQ_ALLOC; pass <= SEQ_READ; pass++) {
+		double start = now();
+		for (uint64 ofs = 0; ofs < size; ofs += SEQ_CHUNK) {
+			if (pass == SEQ_READ) {
+				if (t.read(&buf[0], ofs, SEQ_CHUNK) != SEQ_CHUNK)
+					errors++;
+				fill(&ref[0], ofs, SEQ_CHUNK, gen[ofs / RND_CHUNK]);
+				if (memcmp(&buf[0], &ref[0], SEQ_CHUNK))
+					errors++;
+			} else {
+				for (size_t i = 0; i < SEQ_CHUNK / RND_CHUNK; i++)
+					gen[ofs / RND_CHUNK + i] = pass;
+				fill(&buf[0], ofs, SEQ_CHUNK, pass);
+				if (t.write(&buf[0], ofs, SEQ_CHUNK) != SEQ_CHUNK)
+					errors++;
+			}
+		}
+		t.flush();
+		mbs[pass] = size / (now() - start) / 1048576.0;
+	}
+
+	uint32 chunks = size / RND_CHUNK;
+	for (int pass = RND_WRITE; pass <= RND_READ; pass++) {
+		srand(pass);
+		double start = now();
+		for (int i = 0; i < RND_OPS; i++) {
+			uint32 c = rand() % chunks;
+			loff_t ofs = (loff_t)c * RND_CHUNK;
+			if (pass == RND_READ) {
+				if (t.read(&buf[0], ofs, RND_CHUNK) != RND_CHUNK)
+					errors++;
+				fill(&ref[0], ofs, RND_CHUNK, gen[c]);
+				if (memcmp(&buf[0], &ref[0], RND_CHUNK))
+					errors++;
+			} else {
+				gen[c] = pass * RND_OPS + i;
+				fill(&buf[0], ofs, RND_CHUNK, gen[c]);
+				if (t.write(&buf[0], ofs, RND_CHUNK) != RND_CHUNK)
+					errors++;
+			}
+		}
+		t.flush();
+		mbs[pass] = RND_OPS * RND_CHUNK / (now() - start) / 1048576.0;
+	}
+	return errors;
+}
+
+static vhd_context_t *open_ctx(const char *path)
+{
+	int size;
+	vhd_context_t *ctx = NULL;
+	if (vhd_unix_open(path, &size, false, &ctx) != disk_generic::DISK_VALID) {
+		fprintf(stderr, "Can't open %s\n", path);
+		exit(1);
+	}
+	return ctx;
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = argc > 1 ? argv[1] : "vhd_bench.vhd";
+	uint64 size = (argc > 2 ? atoi(argv[2]) : 64) * 1048576ULL;
+	std::vector<uint32> gen(size / RND_CHUNK);
+	double mbs[2][NUM_PASSES];
+	int errors = 0;
+
+	// libvhd
+	if (!create_vhd(path, size)) {
+		fprintf(stderr, "Can't create %s\n", path);
+		return 1;
+	}
+	target libvhd = {open_ctx(path), NULL};
+	errors += run(libvhd, size, gen, mbs[0]);
+	vhd_unix_close(libvhd.ctx);
+
+	// disk_vhd
+	create_vhd(path, size);
+	target cached = {NULL, NULL};
+	if (disk_vhd_factory(path, false, &cached.disk) != disk_generic::DISK_VALID) {
+		fprintf(stderr, "Can't open %s\n", path);
+		return 1;
+	}
+	errors += run(cached, size, gen, mbs[1]);
+	delete cached.disk;
+
+	// Read the disk_vhd image back through libvhd
+	vhd_context_t *ctx = open_ctx(path);
+	std::vector<uint8> buf(SEQ_CHUNK), ref(SEQ_CHUNK);
+	for (uint64 ofs = 0; ofs < size; ofs += SEQ_CHUNK) {
+		if (vhd_unix_read(ctx, &buf[0], ofs, SEQ_CHUNK) != SEQ_CHUNK)
+			errors++;
+		for (size_t i = 0; i < SEQ_CHUNK; i += RND_CHUNK)
+			fill(&ref[i], ofs + i, RND_CHUNK, gen[(ofs + i) / RND_CHUNK]);
+		if (memcmp(&buf[0], &ref[0], SEQ_CHUNK))
+			errors++;
+	}
+	vhd_unix_close(ctx);
+	unlink(path);
+
+	printf("%-10s", "MB/s");
+	for (int pass = 0; pass < NUM_PASSES; pass++)
+		printf(" %10s", pass_names[pass]);
+	printf("\n");
+	for (int i = 0; i < 2; i++) {
+		printf("%-10s", i ? "disk_vhd" : "libvhd");
+		for (int pass = 0; pass < NUM_PASSES; pass++)
+			printf(" %10.1f", mbs[i][pass]);
+		printf("\n");
+	}
+	printf("%d errors\n", errors);
+	return errors ? 1 : 0;
+}
@@ -24,6 +24,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <vector>
+#include <algorithm>
 extern "C" {
 #include <libvhd.h>
 }
@@ -127,26 +131,217 @@ static void vhd_unix_close(vhd_context_t *ctx)
 }
 
 
+/*
+ *  Dynamic disks without a parent are accessed directly: the BAT is read
+ *  once, the sector bitmaps of used blocks are kept in memory and only
+ *  written back (after the data) by flush(), and consecutive writes are
+ *  collected into one. flush() runs once a second from SysFlushDisks(),
+ *  when too many bitmaps have changed and on close, so acknowledged writes
+ *  reach the file within about a second. Only the allocation of new blocks
+ *  still goes through libvhd, which updates ctx->bat itself. Fixed and
+ *  differencing disks use libvhd for everything.
+ */
+
 struct disk_vhd : disk_generic {
 	disk_vhd(vhd_context_t *ctx, bool read_only, loff_t size)
-	: ctx(ctx), read_only(read_only), file_size(size) { }
+	: ctx(ctx), read_only(read_only), file_size(size), data_fd(-1),
+		num_dirty(0), wbuf_offset(0) {
+		if (ctx->footer.type == HD_TYPE_DYNAMIC && vhd_get_bat(ctx) == 0)
+			data_fd = open(ctx->file, read_only ? O_RDONLY : O_RDWR);
+		if (data_fd >= 0) {
+			bitmap.resize(ctx->bat.entries, NULL);
+			bitmap_dirty.resize(ctx->bat.entries, false);
+			D(bug("vhd cache: %d blocks of %d sectors\n", ctx->bat.entries, ctx->spb));
+		}
+	}
 	
-	virtual ~disk_vhd() { vhd_unix_close(ctx); }
+	virtual ~disk_vhd() {
+		if (data_fd >= 0) {
+			flush();
+			for (size_t i = 0; i < bitmap.size(); i++)
+				free(bitmap[i]);
+			close(data_fd);
+		}
+		vhd_unix_close(ctx);
+	}
 	virtual bool is_read_only() { return read_only; }
 	virtual loff_t size() { return file_size; }
 	
 	virtual size_t read(void *buf, loff_t offset, size_t length) {
-		return vhd_unix_read(ctx, buf, offset, length);
+		if (data_fd < 0)
+			return vhd_unix_read(ctx, buf, offset, length);
+		return block_do(&disk_vhd::block_read, buf, offset, length);
 	}
 	
 	virtual size_t write(void *buf, loff_t offset, size_t length) {
-		return vhd_unix_write(ctx, buf, offset, length);
+		if (data_fd < 0)
+			return vhd_unix_write(ctx, buf, offset, length);
+		return block_do(&disk_vhd::block_write, buf, offset, length);
+	}
+
+	// Write everything back, data before the bitmaps that make it visible
+	virtual bool flush(void) {
+		if (data_fd < 0)
+			return true;
+		bool ok = flush_wbuf();
+		if (num_dirty == 0)
+			return ok;
+		fdatasync(data_fd);
+		for (size_t i = 0; i < bitmap.size(); i++)
+			if (bitmap_dirty[i]) {
+				if (vhd_write_bitmap(ctx, i, bitmap[i]) != 0) {
+					printf("WARNING: Unable to write VHD bitmap of block %d\n", (int)i);
+					ok = false;
+				}
+				bitmap_dirty[i] = false;
+			}
+		num_dirty = 0;
+		fsync(ctx->fd);
+		return ok;
 	}
 
 protected:
 	vhd_context_t *ctx;
 	bool read_only;
 	loff_t file_size;
+
+	int data_fd;						// Own (cached) file descriptor for data I/O, -1 = use libvhd
+	std::vector<char *> bitmap;			// Sector bitmap of each block, NULL = not read yet
+	std::vector<bool> bitmap_dirty;		// Flag: bitmap changed since it was read
+	int num_dirty;						// Number of changed bitmaps
+
+	std::vector<uint8> wbuf;			// Collected consecutive writes
+	off_t wbuf_offset;					// File offset of wbuf
+
+	static const int MAX_DIRTY_BITMAPS = 64;	// Write bitmaps back when this many changed
+	static const size_t MAX_WBUF = 256 * 1024;	// Flush collected writes at this size
+
+	static bool bit_test(const char *map, uint32 n) { return map[n >> 3] & (0x80 >> (n & 7)); }
+	static void bit_set(char *map, uint32 n) { map[n >> 3] |= (0x80 >> (n & 7)); }
+
+	// File offset of sector sec of block blk
+	off_t sector_offset(uint32 blk, uint32 sec) {
+		return ((off_t)ctx->bat.bat[blk] + ctx->bm_secs + sec) * VHD_SECTOR_SIZE;
+	}
+
+	typedef bool (disk_vhd::*block_func)(char *buf, uint32 blk, uint32 sec, uint32 secs);
+
+	// Split a sector aligned operation into blocks
+	size_t block_do(block_func func, void *buf, loff_t offset, size_t length) {
+		if ((offset % VHD_SECTOR_SIZE) || (length % VHD_SECTOR_SIZE)) {
+			printf("vhd access only supported on sector boundaries (%d)\n",
+					VHD_SECTOR_SIZE);
+			return 0;
+		}
+		char *b = (char *)buf;
+		uint64 sec = offset / VHD_SECTOR_SIZE;
+		uint32 secs = length / VHD_SECTOR_SIZE;
+		while (secs) {
+			uint32 blk = sec / ctx->spb;
+			uint32 start = sec % ctx->spb;
+			uint32 num = std::min(secs, ctx->spb - start);
+			if (blk >= ctx->bat.entries || !(this->*func)(b, blk, start, num))
+				return 0;
+			b += num * VHD_SECTOR_SIZE;
+			sec += num;
+			secs -= num;
+		}
+		return length;
+	}
+
+	// Get sector bitmap of used block
+	char *get_bitmap(uint32 blk) {
+		if (bitmap[blk] == NULL && vhd_read_bitmap(ctx, blk, &bitmap[blk]) != 0) {
+			D(bug("vhd bitmap read error, block %d\n", blk));
+			bitmap[blk] = NULL;
+		}
+		return bitmap[blk];
+	}
+
+	bool block_read(char *buf, uint32 blk, uint32 sec, uint32 secs) {
+		if (ctx->bat.bat[blk] == DD_BLK_UNUSED) {
+			memset(buf, 0, secs * VHD_SECTOR_SIZE);
+			return true;
+		}
+		const char *map = get_bitmap(blk);
+		if (map == NULL)
+			return false;
+
+		// Read runs of used sectors at once, unused sectors read as zeroes
+		while (secs) {
+			bool used = bit_test(map, sec);
+			uint32 num = 1;
+			while (num < secs && bit_test(map, sec + num) == used)
+				num++;
+			size_t len = num * VHD_SECTOR_SIZE;
+			if (used) {
+				off_t pos = sector_offset(blk, sec);
+				if (!wbuf.empty() && pos < wbuf_offset + (off_t)wbuf.size() && wbuf_offset < pos + (off_t)len && !flush_wbuf())
+					return false;
+				if (pread(data_fd, buf, len, pos) != (ssize_t)len) {
+					D(bug("vhd read error %d\n", errno));
+					return false;
+				}
+			} else
+				memset(buf, 0, len);
+			buf += len;
+			sec += num;
+			secs -= num;
+		}
+		return true;
+	}
+
+	bool block_write(char *buf, uint32 blk, uint32 sec, uint32 secs) {
+		if (ctx->bat.bat[blk] == DD_BLK_UNUSED) {
+			// Let libvhd allocate the block, it writes data, bitmap and BAT
+			if (!flush_wbuf())
+				return false;
+			int err = vhd_io_write(ctx, buf, (uint64)blk * ctx->spb + sec, secs);
+			if (err) {
+				D(bug("vhd write error %d\n", err));
+				return false;
+			}
+			return true;
+		}
+		char *map = get_bitmap(blk);
+		if (map == NULL)
+			return false;
+
+		// Append to collected writes if consecutive
+		off_t pos = sector_offset(blk, sec);
+		size_t len = secs * VHD_SECTOR_SIZE;
+		if (!wbuf.empty() && (pos != wbuf_offset + (off_t)wbuf.size() || wbuf.size() + len > MAX_WBUF) && !flush_wbuf())
+			return false;
+		if (wbuf.empty())
+			wbuf_offset = pos;
+		wbuf.insert(wbuf.end(), (uint8 *)buf, (uint8 *)buf + len);
+
+		// Mark sectors used, the bitmap is written later
+		for (uint32 i = 0; i < secs; i++)
+			if (!bit_test(map, sec + i)) {
+				bit_set(map, sec + i);
+				if (!bitmap_dirty[blk]) {
+					bitmap_dirty[blk] = true;
+					num_dirty++;
+				}
+			}
+		if (num_dirty >= MAX_DIRTY_BITMAPS)
+			return flush();
+		return true;
+	}
+
+	// Write collected data
+	bool flush_wbuf(void) {
+		if (wbuf.empty())
+			return true;
+		ssize_t actual = pwrite(data_fd, &wbuf[0], wbuf.size(), wbuf_offset);
+		bool ok = (actual == (ssize_t)wbuf.size());
+		if (!ok) {
+			D(bug("vhd write error %d\n", errno));
+		}
+		wbuf.clear();
+		return ok;
+	}
 };
 
 disk_generic::status disk_vhd_factory(const char *path,
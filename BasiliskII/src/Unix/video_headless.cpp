@@ -0,0 +1,643 @@
+/*
+ *  video_headless.cpp - Display driver without a window
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The guest draws into a plain memory frame buffer that is never shown.
+ *  The refresh thread still compares it against the last frame every
+ *  "frameskip" ticks, like the static window refresh of the X11 driver,
+ *  so that benchmark runs include a realistic screen update cost. The
+ *  screen size comes from "screen=headless/<w>/<h>", there is no input
+ *  unless one of the prefs below provides it.
+ *
+ *  With the "headlessshm" pref, the copy of the last frame lives in a POSIX
+ *  shared memory object together with a header describing the mode, the
+ *  palette and the rectangles changed by the last refresh, so that external
+ *  programs can display or record the screen. With "headlessinput", mouse
+ *  and keyboard events are read from a Unix domain socket. The layouts are
+ *  described in video_headless.h. With "rfbport", rfb_server.cpp serves
+ *  the changed rectangles to VNC clients.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#if defined(SHEEPSHAVER) || defined(USE_PTHREADS_SERVICES)
+#include <pthread.h>
+#define USE_REFRESH_THREAD 1
+#endif
+
+#include "cpu_emulation.h"
+#include "main.h"
+#include "prefs.h"
+#include "adb.h"
+#include "video.h"
+#include "video_defs.h"
+#include "timer.h"
+#include "vm_alloc.h"
+#include "bench.h"
+#include "video_headless.h"
+#include "rfb_server.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Constants
+const int REFRESH_DELAY = 16667;	// 60 Hz, in usec
+
+// Global variables
+static int frame_skip;							// Prefs item
+static int tick_counter = 0;
+static int32 idle_limit;						// Max. usec to sleep while the Mac is idle
+
+static uint8 *the_buffer = NULL;				// Mac frame buffer (where MacOS draws into)
+static uint8 *the_buffer_copy = NULL;			// Frame buffer contents at the last refresh
+static uint32 the_buffer_size = 0;				// Size of allocated the_buffer
+static uint32 cur_width, cur_height;			// Geometry of current mode
+static uint32 cur_depth, cur_bytes_per_row;
+
+static headless_shm_header *shm_header = NULL;	// Shared frame buffer (the_buffer_copy is part of it), or NULL
+static uint32 shm_size = 0;						// Size of shared memory object
+static char *shm_name = NULL;					// Name of shared memory object
+
+static headless_shm_rect dirty_rects[HEADLESS_SHM_MAX_RECTS];	// Changed by the last refresh
+static int num_dirty_rects = 0;
+
+static int input_fd = -1;						// Input socket
+static char *input_path = NULL;					// Path of input socket
+
+#ifdef USE_REFRESH_THREAD
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;	// Protects the geometry while the refresh runs
+#define LOCK_BUFFER pthread_mutex_lock(&buffer_lock)
+#define UNLOCK_BUFFER pthread_mutex_unlock(&buffer_lock)
+
+static pthread_t refresh_thread;
+static bool refresh_thread_active = false;
+static volatile bool refresh_thread_cancel = false;
+#else
+#define LOCK_BUFFER
+#define UNLOCK_BUFFER
+#endif
+
+
+/*
+ *  Check for headless mode
+ */
+
+bool VideoHeadless(void)
+{
+	const char *mode_str = PrefsFindString("screen");
+	return mode_str && strncmp(mode_str, "headless/", 9) == 0;
+}
+
+static void get_screen_size(int &width, int &height)
+{
+	width = 640;
+	height = 480;
+	const char *mode_str = PrefsFindString("screen");
+	if (mode_str == NULL || sscanf(mode_str, "headless/%d/%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+		width = 640;
+		height = 480;
+	}
+}
+
+
+/*
+ *  Shared frame buffer
+ */
+
+static bool open_shm(void)
+{
+#ifdef HAVE_SHM_OPEN
+	const char *name = PrefsFindString("headlessshm");
+	if (name == NULL)
+		return false;
+
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("WARNING: Cannot open shared frame buffer '%s': %s\n", name, strerror(errno));
+		return false;
+	}
+	shm_size = HEADLESS_SHM_FB_OFFSET + the_buffer_size;
+	void *p = MAP_FAILED;
+	if (ftruncate(fd, shm_size) == 0)
+		p = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		printf("WARNING: Cannot map shared frame buffer '%s': %s\n", name, strerror(errno));
+		shm_unlink(name);
+		return false;
+	}
+
+	shm_header = (headless_shm_header *)p;
+	shm_header->magic = HEADLESS_SHM_MAGIC;
+	shm_header->version = HEADLESS_SHM_VERSION;
+	shm_header->fb_offset = HEADLESS_SHM_FB_OFFSET;
+	shm_header->fb_size = the_buffer_size;
+	the_buffer_copy = (uint8 *)p + HEADLESS_SHM_FB_OFFSET;
+	shm_name = strdup(name);
+	D(bug("Shared frame buffer '%s' at %p\n", name, p));
+	return true;
+#else
+	return false;
+#endif
+}
+
+static void close_shm(void)
+{
+#ifdef HAVE_SHM_OPEN
+	if (shm_header) {
+		munmap(shm_header, shm_size);
+		shm_unlink(shm_name);
+		free(shm_name);
+		shm_header = NULL;
+		shm_name = NULL;
+	}
+#endif
+}
+
+// Start and end an update of the shared frame buffer, must be called with LOCK_BUFFER held
+static void shm_begin_update(void)
+{
+	shm_header->frame++;
+	__sync_synchronize();
+}
+
+static void shm_end_update(const headless_shm_rect *rects, int num_rects)
+{
+	memcpy(shm_header->rects, rects, num_rects * sizeof(headless_shm_rect));
+	shm_header->num_rects = num_rects;
+	__sync_synchronize();
+	shm_header->frame++;
+}
+
+// Add changed bytes x1..x2-1 of line y to the dirty rectangles, extending the previous one if adjacent
+static void add_dirty(uint32 y, uint32 x1, uint32 x2)
+{
+	// Convert bytes to pixels
+	x1 = x1 * 8 / cur_depth;
+	x2 = (x2 * 8 + cur_depth - 1) / cur_depth;
+	if (x2 > cur_width)
+		x2 = cur_width;
+
+	int n = num_dirty_rects;
+	if (n > 0) {
+		headless_shm_rect &r = dirty_rects[n - 1];
+		if (r.y + r.h == y || n == HEADLESS_SHM_MAX_RECTS) {
+			uint32 left = r.x < x1 ? r.x : x1;
+			uint32 right = r.x + r.w > x2 ? r.x + r.w : x2;
+			r.x = left;
+			r.w = right - left;
+			r.h = y + 1 - r.y;
+			return;
+		}
+	}
+	headless_shm_rect &r = dirty_rects[n];
+	r.x = x1;
+	r.y = y;
+	r.w = x2 - x1;
+	r.h = 1;
+	num_dirty_rects = n + 1;
+}
+
+static void set_palette(const uint8 *pal, int num)
+{
+	if (num > 256)
+		num = 256;
+	LOCK_BUFFER;
+	if (shm_header) {
+		shm_begin_update();
+		memcpy(shm_header->palette, pal, num * 3);
+		headless_shm_rect r = {0, 0, cur_width, cur_height};
+		shm_end_update(&r, 1);
+	}
+	if (RFBActive)
+		RFBSetPalette(pal, num);
+	UNLOCK_BUFFER;
+}
+
+
+/*
+ *  Input socket
+ */
+
+static void open_input(void)
+{
+	const char *path = PrefsFindString("headlessinput");
+	if (path == NULL)
+		return;
+
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("WARNING: Input socket path '%s' too long\n", path);
+		return;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	input_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (input_fd >= 0) {
+		unlink(path);
+		if (bind(input_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && fcntl(input_fd, F_SETFL, O_NONBLOCK) == 0) {
+			input_path = strdup(path);
+			ADBSetRelMouseMode(false);
+			D(bug("Input socket '%s'\n", path));
+			return;
+		}
+		close(input_fd);
+		input_fd = -1;
+	}
+	printf("WARNING: Cannot open input socket '%s': %s\n", path, strerror(errno));
+}
+
+static void close_input(void)
+{
+	if (input_fd >= 0) {
+		close(input_fd);
+		unlink(input_path);
+		free(input_path);
+		input_fd = -1;
+		input_path = NULL;
+	}
+}
+
+// Feed all pending input events to the ADB
+static void handle_input(void)
+{
+	headless_input_event ev;
+	while (recv(input_fd, &ev, sizeof(ev), 0) == sizeof(ev)) {
+		switch (ev.type) {
+			case HEADLESS_INPUT_MOUSE_MOVE:
+				ADBMouseMoved(ev.x, ev.y);
+				break;
+			case HEADLESS_INPUT_MOUSE_DOWN:
+				if (ev.code < 3)
+					ADBMouseDown(ev.code);
+				break;
+			case HEADLESS_INPUT_MOUSE_UP:
+				if (ev.code < 3)
+					ADBMouseUp(ev.code);
+				break;
+			case HEADLESS_INPUT_KEY_DOWN:
+				ADBKeyDown(ev.code & 0x7f);
+				break;
+			case HEADLESS_INPUT_KEY_UP:
+				ADBKeyUp(ev.code & 0x7f);
+				break;
+		}
+	}
+}
+
+
+/*
+ *  Frame buffer, allocated once for the largest mode
+ */
+
+static bool alloc_frame_buffer(uint32 size)
+{
+	the_buffer_size = (size + 0xfff) & ~0xfff;
+#ifdef SHEEPSHAVER
+	the_buffer = (uint8 *)vm_acquire(the_buffer_size);
+#else
+	the_buffer = (uint8 *)vm_acquire(the_buffer_size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+#endif
+	if (the_buffer == VM_MAP_FAILED) {
+		the_buffer = NULL;
+		return false;
+	}
+	if (!open_shm())
+		the_buffer_copy = new uint8[the_buffer_size];
+	memset(the_buffer, 0, the_buffer_size);
+	memset(the_buffer_copy, 0, the_buffer_size);
+	D(bug("the_buffer = %p, the_buffer_copy = %p\n", the_buffer, the_buffer_copy));
+	return true;
+}
+
+static void set_geometry(uint32 width, uint32 height, uint32 depth, uint32 bytes_per_row)
+{
+	LOCK_BUFFER;
+	cur_width = width;
+	cur_height = height;
+	cur_depth = depth;
+	cur_bytes_per_row = bytes_per_row;
+	if (shm_header) {
+		shm_begin_update();
+		shm_header->width = width;
+		shm_header->height = height;
+		shm_header->depth = depth;
+		shm_header->bytes_per_row = bytes_per_row;
+	}
+	memset(the_buffer_copy, 0, the_buffer_size);
+	if (shm_header)
+		shm_end_update(dirty_rects, 0);
+	if (RFBActive)
+		RFBSetFormat(width, height, depth, bytes_per_row);
+	UNLOCK_BUFFER;
+}
+
+
+/*
+ *  Screen refresh
+ */
+
+void HeadlessVideoRefresh(void)
+{
+	if (input_fd >= 0)
+		handle_input();
+
+	if (++tick_counter < frame_skip)
+		return;
+	tick_counter = 0;
+
+	LOCK_BUFFER;
+	uint64 start = GetTicks_usec();
+	bool changed = false;
+	bool track = shm_header || RFBActive;
+	num_dirty_rects = 0;
+	for (uint32 y = 0; y < cur_height; y++) {
+		uint8 *src = the_buffer + y * cur_bytes_per_row;
+		uint8 *dst = the_buffer_copy + y * cur_bytes_per_row;
+		if (memcmp(src, dst, cur_bytes_per_row) == 0)
+			continue;
+		if (!track) {
+			memcpy(dst, src, cur_bytes_per_row);
+			changed = true;
+			continue;
+		}
+
+		// Only copy the changed part of the line and record it
+		if (!changed && shm_header)
+			shm_begin_update();
+		changed = true;
+		uint32 x1 = 0, x2 = cur_bytes_per_row;
+		while (src[x1] == dst[x1])
+			x1++;
+		while (src[x2 - 1] == dst[x2 - 1])
+			x2--;
+		memcpy(dst + x1, src + x1, x2 - x1);
+		add_dirty(y, x1, x2);
+	}
+	if (changed && shm_header)
+		shm_end_update(dirty_rects, num_dirty_rects);
+	if (RFBActive)
+		RFBUpdate(the_buffer_copy, dirty_rects, num_dirty_rects);
+	uint64 usec = GetTicks_usec() - start;
+	UNLOCK_BUFFER;
+
+	if (BenchActive)
+		BenchRefresh(usec, changed);
+}
+
+#ifdef USE_REFRESH_THREAD
+static void *refresh_func(void *arg)
+{
+	uint64 next = GetTicks_usec();
+	while (!refresh_thread_cancel) {
+		next += REFRESH_DELAY;
+		int64 delay = next - GetTicks_usec();
+		if (delay < -REFRESH_DELAY)
+			next = GetTicks_usec();		// Lagging far behind, reset
+		else if (delay > 0)
+			Delay_usec(delay);
+
+		// A refresh done entirely while the Mac is idle shows the final frame, so
+		// there is nothing to do until the idle period ends. Not with an input
+		// socket or RFB clients, which this thread has to serve meanwhile.
+		uint32 period = idle_period();
+		HeadlessVideoRefresh();
+		if (period && tick_counter == 0 && input_fd < 0 && !RFBActive && idle_sleep(period, idle_limit))
+			next = GetTicks_usec();
+	}
+	return NULL;
+}
+#endif
+
+static bool start_refresh(void)
+{
+	frame_skip = PrefsFindInt32("frameskip");
+	if (frame_skip <= 0)
+		frame_skip = 1;
+#if PRECISE_TIMING
+	idle_limit = PrefsFindInt32("ticklessidle") * 1000;
+#endif
+	open_input();
+	if (RFBInit()) {
+		LOCK_BUFFER;
+		RFBSetFormat(cur_width, cur_height, cur_depth, cur_bytes_per_row);
+		UNLOCK_BUFFER;
+	}
+#ifdef USE_REFRESH_THREAD
+	refresh_thread_cancel = false;
+	refresh_thread_active = (pthread_create(&refresh_thread, NULL, refresh_func, NULL) == 0);
+	if (!refresh_thread_active)
+		return false;
+#endif
+	return true;
+}
+
+
+#ifdef SHEEPSHAVER
+/*
+ *  SheepShaver: one mode per depth in VModes[]
+ */
+
+bool HeadlessVideoInit(void)
+{
+	int width, height;
+	get_screen_size(width, height);
+
+	VideoInfo *p = VModes;
+	for (int d = APPLE_1_BIT; d <= APPLE_32_BIT; d++) {
+		p->viType = DIS_WINDOW;
+		p->viXsize = width;
+		p->viYsize = height;
+		p->viRowBytes = TrivialBytesPerRow(width, d);
+		p->viAppleMode = d;
+		p->viAppleID = APPLE_CUSTOM;
+		p++;
+	}
+	p->viType = DIS_INVALID;	// End marker
+	p->viRowBytes = 0;
+	p->viXsize = p->viYsize = 0;
+	p->viAppleMode = 0;
+	p->viAppleID = 0;
+
+	private_data = NULL;
+	video_activated = true;
+	display_type = DIS_WINDOW;
+	cur_mode = APPLE_32_BIT - APPLE_1_BIT;
+
+	if (!alloc_frame_buffer(TrivialBytesPerRow(width, APPLE_32_BIT) * height))
+		return false;
+	screen_base = Host2MacAddr(the_buffer);
+	set_geometry(width, height, 1 << (APPLE_32_BIT - APPLE_1_BIT), VModes[cur_mode].viRowBytes);
+	D(bug("Headless display %dx%d, screen_base %08x\n", width, height, screen_base));
+
+	return start_refresh();
+}
+
+int16 headless_video_mode_change(VidLocals *csSave, uint32 ParamPtr)
+{
+	// Return if no mode change
+	if ((csSave->saveData == ReadMacInt32(ParamPtr + csData)) &&
+	    (csSave->saveMode == ReadMacInt16(ParamPtr + csMode))) return noErr;
+
+	for (int i = 0; VModes[i].viType != DIS_INVALID; i++) {
+		if ((ReadMacInt16(ParamPtr + csMode) == VModes[i].viAppleMode) &&
+		    (ReadMacInt32(ParamPtr + csData) == VModes[i].viAppleID)) {
+			csSave->saveMode = ReadMacInt16(ParamPtr + csMode);
+			csSave->saveData = ReadMacInt32(ParamPtr + csData);
+			csSave->savePage = ReadMacInt16(ParamPtr + csPage);
+
+			// The frame buffer fits all modes, so it stays where it is
+			cur_mode = i;
+			set_geometry(VModes[i].viXsize, VModes[i].viYsize, 1 << (VModes[i].viAppleMode - APPLE_1_BIT), VModes[i].viRowBytes);
+
+			WriteMacInt32(ParamPtr + csBaseAddr, screen_base);
+			csSave->saveBaseAddr = screen_base;
+			return noErr;
+		}
+	}
+	return paramErr;
+}
+
+void HeadlessVideoSetPalette(void)
+{
+	uint8 pal[256 * 3];
+	for (int i = 0; i < 256; i++) {
+		pal[i * 3 + 0] = mac_pal[i].red;
+		pal[i * 3 + 1] = mac_pal[i].green;
+		pal[i * 3 + 2] = mac_pal[i].blue;
+	}
+	set_palette(pal, 256);
+}
+
+#else
+/*
+ *  Basilisk II: monitor_desc subclass
+ */
+
+class headless_monitor_desc : public monitor_desc {
+public:
+	headless_monitor_desc(const vector<video_mode> &available_modes, video_depth default_depth, uint32 default_id) : monitor_desc(available_modes, default_depth, default_id) {}
+	~headless_monitor_desc() {}
+
+	virtual void switch_to_current_mode(void);
+	virtual void set_palette(uint8 *pal, int num) { ::set_palette(pal, num); }
+	virtual void set_gamma(uint8 *gamma, int num) {}
+
+	void set_frame_base(void);
+};
+
+// Set Mac frame layout and base address (the buffer never moves)
+void headless_monitor_desc::set_frame_base(void)
+{
+	const video_mode &mode = get_current_mode();
+	set_geometry(mode.x, mode.y, 1 << mode.depth, mode.bytes_per_row);
+#if !REAL_ADDRESSING && !DIRECT_ADDRESSING
+	MacFrameLayout = FLAYOUT_DIRECT;
+	set_mac_frame_base(MacFrameBaseMac);
+
+	// Set variables used by UAE memory banking
+	MacFrameBaseHost = the_buffer;
+	MacFrameSize = mode.bytes_per_row * mode.y;
+	InitFrameBufferMapping();
+#else
+	set_mac_frame_base(Host2MacAddr(the_buffer));
+#endif
+	D(bug("monitor.mac_frame_base = %08x\n", get_mac_frame_base()));
+}
+
+void headless_monitor_desc::switch_to_current_mode(void)
+{
+	set_frame_base();
+}
+
+bool HeadlessVideoInit(bool classic)
+{
+	vector<video_mode> modes;
+	video_mode mode;
+	mode.resolution_id = 0x80;
+	mode.user_data = 0;
+	if (classic) {
+		mode.x = 512;
+		mode.y = 342;
+		mode.depth = VDEPTH_1BIT;
+		mode.bytes_per_row = 64;
+		modes.push_back(mode);
+	} else {
+		int width, height;
+		get_screen_size(width, height);
+		mode.x = width;
+		mode.y = height;
+		for (int d = VDEPTH_1BIT; d <= VDEPTH_32BIT; d++) {
+			mode.depth = video_depth(d);
+			mode.bytes_per_row = TrivialBytesPerRow(width, mode.depth);
+			modes.push_back(mode);
+		}
+	}
+
+	if (!alloc_frame_buffer(modes.back().bytes_per_row * modes.back().y))
+		return false;
+
+	headless_monitor_desc *monitor = new headless_monitor_desc(modes, modes.back().depth, 0x80);
+	VideoMonitors.push_back(monitor);
+	monitor->set_frame_base();
+	D(bug("Headless display %dx%d\n", modes.back().x, modes.back().y));
+
+	return start_refresh();
+}
+#endif
+
+
+/*
+ *  Deinitialization
+ */
+
+void HeadlessVideoExit(void)
+{
+#ifdef USE_REFRESH_THREAD
+	if (refresh_thread_active) {
+		refresh_thread_cancel = true;
+		pthread_join(refresh_thread, NULL);
+		refresh_thread_active = false;
+	}
+#endif
+	RFBExit();
+	close_input();
+	if (the_buffer) {
+		vm_release(the_buffer, the_buffer_size);
+		the_buffer = NULL;
+	}
+	if (shm_header)
+		close_shm();
+	else
+		delete[] the_buffer_copy;
+	the_buffer_copy = NULL;
+}
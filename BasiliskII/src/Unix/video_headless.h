@@ -0,0 +1,90 @@
+/*
+ *  video_headless.h - Display driver without a window
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIDEO_HEADLESS_H
+#define VIDEO_HEADLESS_H
+
+// Check whether the "screen" pref selects the headless display ("headless/<width>/<height>")
+extern bool VideoHeadless(void);
+
+/*
+ *  Shared frame buffer ("headlessshm" pref), a POSIX shared memory object
+ *  holding a headless_shm_header followed by the frame buffer at fb_offset.
+ *  All values are in host byte order, pixels are in Mac (big-endian) format.
+ *  "frame" is odd while an update is in progress. Readers copy what they
+ *  need and retry if "frame" was odd or changed meanwhile. A reader that
+ *  missed a frame must redraw everything, the dirty rectangles only cover
+ *  the last update.
+ */
+
+const uint32 HEADLESS_SHM_MAGIC = 0x42324642;	// 'B2FB'
+const uint32 HEADLESS_SHM_VERSION = 1;
+const uint32 HEADLESS_SHM_FB_OFFSET = 0x1000;
+const int HEADLESS_SHM_MAX_RECTS = 32;
+
+struct headless_shm_rect {
+	uint32 x, y, w, h;			// In pixels
+};
+
+struct headless_shm_header {
+	uint32 magic;				// HEADLESS_SHM_MAGIC
+	uint32 version;				// HEADLESS_SHM_VERSION
+	uint32 fb_offset;			// Offset of frame buffer from start of object
+	uint32 fb_size;				// Size of frame buffer (fits the largest mode)
+	uint32 width, height;		// Current mode
+	uint32 depth;				// Bits per pixel (1..32)
+	uint32 bytes_per_row;
+	volatile uint32 frame;		// Update counter, odd while updating
+	uint32 num_rects;			// Number of dirty rectangles of the last update
+	headless_shm_rect rects[HEADLESS_SHM_MAX_RECTS];
+	uint8 palette[256 * 3];		// RGB, for depths up to 8 bits
+};
+
+/*
+ *  Input socket ("headlessinput" pref), a Unix domain datagram socket that
+ *  accepts one headless_input_event per datagram.
+ */
+
+enum {
+	HEADLESS_INPUT_MOUSE_MOVE = 1,	// Absolute mouse position in x/y
+	HEADLESS_INPUT_MOUSE_DOWN,		// Mouse button (0..2) in code
+	HEADLESS_INPUT_MOUSE_UP,
+	HEADLESS_INPUT_KEY_DOWN,		// ADB key code in code
+	HEADLESS_INPUT_KEY_UP
+};
+
+struct headless_input_event {
+	uint8 type;					// HEADLESS_INPUT_*
+	uint8 code;
+	int16 x, y;					// Host byte order
+};
+
+// Called by video_x.cpp instead of its own functions when VideoHeadless() is true
+#ifdef SHEEPSHAVER
+extern bool HeadlessVideoInit(void);
+extern int16 headless_video_mode_change(VidLocals *csSave, uint32 ParamPtr);
+extern void HeadlessVideoSetPalette(void);
+#else
+extern bool HeadlessVideoInit(bool classic);
+#endif
+extern void HeadlessVideoExit(void);
+extern void HeadlessVideoRefresh(void);		// Only needed without a refresh thread
+
+#endif
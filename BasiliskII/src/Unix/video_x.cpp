@@ -65,6 +65,8 @@
 #include "user_strings.h"
 #include "video.h"
 #include "video_blit.h"
+#include "video_headless.h"
+#include "rfb_server.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -123,6 +125,7 @@ static bool emerg_quit = false;						// Flag: Ctrl-Esc pressed, emergency quit r
 static bool emul_suspended = false;					// Flag: Emulator suspended
 
 static bool classic_mode = false;					// Flag: Classic Mac video mode
+static bool headless = false;						// Flag: No display, video_headless.cpp does the work
 
 static bool use_keycodes = false;					// Flag: Use keycodes rather than keysyms
 static int keycode_table[256];						// X keycode -> Mac keycode translation table
@@ -1600,10 +1603,14 @@ bool X11_monitor_desc::video_open(void)
 	}
 
 #ifdef ENABLE_VOSF
-	// Load gray ramp to 8->16/32 expand map
-	if (!IsDirectMode(mode) && xdepth > 8)
-		for (int i=0; i<256; i++)
-			ExpandMap[i] = map_rgb(i, i, i, true);
+	// Load gray ramp to 8->16/32 expand map (like the palette, it repeats the first 2^depth entries)
+	if (!IsDirectMode(mode) && xdepth > 8) {
+		int num_in = 1 << depth_of_video_mode(mode);
+		for (int i=0; i<256; i++) {
+			int c = ((i & (num_in-1)) * 255) / (num_in-1);
+			ExpandMap[i] = map_rgb(c, c, c, true);
+		}
+	}
 #endif
 
 	// Create display driver object of requested type
@@ -1667,6 +1674,10 @@ bool VideoInit(bool classic)
 {
 	classic_mode = classic;
 
+	headless = VideoHeadless();
+	if (headless)
+		return HeadlessVideoInit(classic);
+
 #ifdef ENABLE_VOSF
 	// Zero the mainBuffer structure
 	mainBuffer.dirtyPages = NULL;
@@ -1884,6 +1895,11 @@ void X11_monitor_desc::video_close(void)
 
 void VideoExit(void)
 {
+	if (headless) {
+		HeadlessVideoExit();
+		return;
+	}
+
 	// Close displays
 	vector<monitor_desc *>::iterator i, end = VideoMonitors.end();
 	for (i = VideoMonitors.begin(); i != end; ++i)
@@ -1930,6 +1946,9 @@ void VideoQuitFullScreen(void)
 
 void VideoInterrupt(void)
 {
+	if (headless)
+		return;
+
 	// Emergency quit requested? Then quit
 	if (emerg_quit)
 		QuitEmulator();
@@ -2158,6 +2177,13 @@ static int kc_decode(KeySym ks, bool key_down)
 	return -1;
 }
 
+// Used by the RFB server, whose key events carry X keysyms
+int KeysymToADB(uint32 keysym)
+{
+	int code = kc_decode(keysym, false);
+	return code >= 0 ? code : -1;
+}
+
 static int event2keycode(XKeyEvent &ev, bool key_down)
 {
 	KeySym ks;
@@ -2701,6 +2727,11 @@ static void VideoRefreshInit(void)
 // This function is called on non-threaded platforms from a timer interrupt
 void VideoRefresh(void)
 {
+	if (headless) {
+		HeadlessVideoRefresh();
+		return;
+	}
+
 	// We need to check redraw_thread_active to inhibit refreshed during
 	// mode changes on non-threaded platforms
 	if (!redraw_thread_active)
@@ -24,6 +24,7 @@
 using std::string;
 
 #include "xpram.h"
+#include "persist_unix.h"
 
 // XPRAM file name, set by LoadPrefs() in prefs_unix.cpp
 string xpram_name;
@@ -41,6 +42,9 @@ void LoadXPRAM(const char* vmdir)
 		read(fd, XPRAM, XPRAM_SIZE);
 		close(fd);
 	}
+
+	// Changes are written back by persist_unix.cpp
+	PersistWatch(xpram_name.c_str(), XPRAM, XPRAM_SIZE, &XPRAMDirty);
 }
 
 /*
@@ -50,17 +54,7 @@ void LoadXPRAM(const char* vmdir)
 void SaveXPRAM(void)
 {
 	assert(!xpram_name.empty());
-	int fd;
-	if ((fd = open(xpram_name.c_str(), O_WRONLY | O_CREAT, 0666)) >= 0)
-	{
-		write(fd, XPRAM, XPRAM_SIZE);
-		close(fd);
-	}
-	else
-	{
-		fprintf(stderr, "WARNING: Unable to save %s (%s)\n",
-		        xpram_name.c_str(), strerror(errno));
-	}
+	PersistWrite(xpram_name.c_str(), XPRAM, XPRAM_SIZE);
 }
 
 /*
@@ -71,5 +65,5 @@ void ZapPRAM(void)
 {
 	// Delete file
 	assert(!xpram_name.empty());
-	unlink(xpram_name.c_str());
+	PersistRemove(xpram_name.c_str());
 }
@@ -18,11 +18,16 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <stddef.h>
+
 #include "sysdeps.h"
 #include "cpu_emulation.h"
 #include "emul_op.h"
 #include "timer.h"
 #include "spcflags.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "bench.h"
 
 #include "Tiny68020.h"
 Tiny68020 tiny68020;
@@ -124,6 +129,17 @@ void Start680x0(void)
 }
 
 
+/*
+ *  Start 680x0 emulation with the state restored by SnapshotLoad() (doesn't return)
+ */
+
+void Resume680x0(void)
+{
+	SPCFLAGS_INIT(0);
+	m68k_execute();
+}
+
+
 /*
  *  Trigger interrupt
  */
@@ -174,6 +190,9 @@ void Execute68k(uint32 addr, struct M68kRegisters *r)
 
 int quit_program = 0;
 
+// Nesting level of m68k_execute(), snapshots are only taken at the outermost level
+static int execute_depth = 0;
+
 void m68k_emulop_return(void)
 {
 	SPCFLAGS_SET( SPCFLAG_BRK );
@@ -182,10 +201,64 @@ void m68k_emulop_return(void)
 
 void m68k_emulop(uae_u32 opcode)
 {
+#ifdef UPDATE_UAE
 	struct M68kRegisters r;
 	tiny68020.exportRegs(r);
 	EmulOp(opcode, &r);
 	tiny68020.importRegs(r);
+#else
+	// Handlers work directly on the live register file
+	static_assert(offsetof(M68kRegisters, a) == 8 * sizeof(uint32) && offsetof(M68kRegisters, sr) == 16 * sizeof(uint32),
+		"M68kRegisters must match the Tiny68020 register layout");
+	uint16 sr = tiny68020.GetSR();
+	if (ProfilerActive) {
+		uint64 start = ProfilerClock();
+		EmulOp(opcode, tiny68020.RegsView());
+		ProfilerHandler(PROFILER_EMUL_OP | opcode, start);
+	} else
+		EmulOp(opcode, tiny68020.RegsView());
+	tiny68020.UpdateSR(sr);
+#endif
+}
+
+
+/*
+ *  Profiler sampling, the call chain is taken from the A6 frame links
+ */
+
+void ProfilerRequestSample(void)
+{
+	SPCFLAGS_SET( SPCFLAG_PROFILE );
+}
+
+static void profile_sample(void)
+{
+	uint32 callers[PROFILER_MAX_CALLERS];
+	int n = 0;
+	uint32 fp = tiny68020.RegsView()->a[6];
+	while (n < PROFILER_MAX_CALLERS && fp >= RAMBaseMac && fp < RAMBaseMac + RAMSize - 8) {
+		callers[n++] = ReadMacInt32(fp + 4);
+		uint32 next = ReadMacInt32(fp);
+		if (next <= fp)
+			break;
+		fp = next;
+	}
+	ProfilerService(tiny68020.GetPC(), callers, n);
+}
+
+/*
+ *  Executed instructions, for the benchmark
+ */
+
+uint64 BenchInstructionCount(void)
+{
+	return tiny68020.GetInsnCount();
+}
+
+// Deterministic time mode, the tick and timer interrupts are raised at this instruction
+void ICountSetDeadline(uint64 insns)
+{
+	tiny68020.SetInsnDeadline(insns);
 }
 
 int m68k_do_specialties(void)
@@ -201,8 +274,13 @@ int m68k_do_specialties(void)
 	if (SPCFLAGS_TEST( SPCFLAG_DOINT )) {
 		SPCFLAGS_CLEAR( SPCFLAG_DOINT );
 		int intr = intlev();
-		if (intr != -1)
+		if (intr != -1) {
+			if (ProfilerActive)
+				ProfilerInterrupt(intr);
+			if (BenchActive)
+				BenchInterrupt();
 			tiny68020.IRQ(intr);
+		}
 	}
 
 	if (SPCFLAGS_TEST( SPCFLAG_INT )) {
@@ -215,11 +293,22 @@ int m68k_do_specialties(void)
 		return 1;
 	}
 
+	if (SPCFLAGS_TEST( SPCFLAG_SNAPSHOT ) && execute_depth == 1) {
+		SPCFLAGS_CLEAR( SPCFLAG_SNAPSHOT );
+		SnapshotService();
+	}
+
+	if (SPCFLAGS_TEST( SPCFLAG_PROFILE )) {
+		SPCFLAGS_CLEAR( SPCFLAG_PROFILE );
+		profile_sample();
+	}
+
 	return 0;
 }
 
 void m68k_execute (void)
 {
+	execute_depth++;
 setjmpagain:
 	TRY(prb) {
 		for (;;) {
@@ -234,4 +323,5 @@ setjmpagain:
 	CATCH(prb) {
 		goto setjmpagain;
 	}
+	execute_depth--;
 }
@@ -0,0 +1,298 @@
+/*
+ *  bench.cpp - Headless boot benchmark
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  Setting the "bench" pref boots the configured ROM and disks with the
+ *  headless display, no sound and no network, and ends the run at one of
+ *  these points ("benchstop" pref):
+ *
+ *    finder   the Finder is the current application and idle (default)
+ *    emulop   the guest executed M68K_EMUL_OP_BENCH_STOP (0x713c in
+ *             Basilisk II, 0xfe78 in SheepShaver), its d0 is reported
+ *    <n>      n guest instructions were executed (checked at every
+ *             interrupt, so the run overshoots by up to one tick)
+ *
+ *  "benchtimeout" seconds end the run in any case. The report is a JSON
+ *  object written to the "bench" path ("-" = stdout) on exit. Example:
+ *
+ *    BasiliskII --rom Quadra.rom --disk boot.dsk --bench boot.json
+ *
+ *  With "icount" set, the guest clocks and interrupts follow the instruction
+ *  count, so two runs execute the same instructions (e.g. --icount 100).
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "cpu_emulation.h"
+#include "main.h"
+#include "prefs.h"
+#include "vm_alloc.h"
+#include "timer.h"
+#include "bench.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Public state
+bool BenchActive = false;
+uint64 BenchDiskRead = 0, BenchDiskWritten = 0;
+
+// Configuration
+enum {
+	STOP_FINDER,
+	STOP_EMULOP,
+	STOP_INSTRUCTIONS
+};
+static const char *output_path = NULL;
+static int stop_mode = STOP_FINDER;
+static uint64 insn_limit = 0;
+static uint64 timeout_usec = 0;
+
+// Run state
+static bool started = false;
+static bool stopped = false;
+static uint64 start_usec, start_insns;
+static uint64 interrupts = 0;
+static uint32 emulop_result = 0;
+static bool have_emulop_result = false;
+
+// Results, captured by BenchStop()
+static const char *stop_reason = NULL;
+static uint64 run_usec, run_insns;
+
+// Screen refresh cost, written by the refresh thread
+static uint64 refreshes = 0, refresh_usec = 0, refresh_changed = 0;
+
+
+/*
+ *  Initialization, forces the dummy devices
+ */
+
+void BenchInit(void)
+{
+	output_path = PrefsFindString("bench");
+	if (output_path == NULL)
+		return;
+	BenchActive = true;
+
+	const char *stop = PrefsFindString("benchstop");
+	if (stop == NULL || strcmp(stop, "finder") == 0)
+		stop_mode = STOP_FINDER;
+	else if (strcmp(stop, "emulop") == 0)
+		stop_mode = STOP_EMULOP;
+	else {
+		char *end;
+		insn_limit = strtoull(stop, &end, 0);
+		if (*end || insn_limit == 0) {
+			printf("WARNING: Invalid benchstop \"%s\", stopping at the Finder\n", stop);
+			stop_mode = STOP_FINDER;
+		} else
+			stop_mode = STOP_INSTRUCTIONS;
+	}
+	int32 timeout = PrefsFindInt32("benchtimeout");
+	timeout_usec = timeout > 0 ? uint64(timeout) * 1000000 : 0;
+
+	// Keep the configured screen size, but don't open a window
+	int width = 640, height = 480;
+	const char *mode_str = PrefsFindString("screen");
+	const char *size_str = mode_str ? strchr(mode_str, '/') : NULL;
+	if (size_str == NULL || sscanf(size_str, "/%d/%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+		width = 640;
+		height = 480;
+	}
+	char str[64];
+	snprintf(str, sizeof(str), "headless/%d/%d", width, height);
+	PrefsReplaceString("screen", str);
+
+	PrefsReplaceBool("nosound", true);
+#ifdef SHEEPSHAVER
+	PrefsReplaceBool("nonet", true);
+#else
+	while (PrefsFindString("ether"))
+		PrefsRemoveItem("ether");
+#endif
+	PrefsReplaceBool("nogui", true);
+
+	// The SynchIdleTime() patch tells us when the Finder is idle, BenchIdle() checks for it before sleeping
+	PrefsReplaceBool("idlewait", true);
+
+	D(bug("Benchmark mode, %s, report to %s\n", str, output_path));
+}
+
+
+/*
+ *  Start the clock
+ */
+
+void BenchStart(void)
+{
+	if (!BenchActive)
+		return;
+	start_usec = GetTicks_usec();
+	start_insns = BenchInstructionCount();
+	started = true;
+}
+
+
+/*
+ *  End the run
+ */
+
+void BenchStop(const char *reason)
+{
+	if (!BenchActive || stopped)
+		return;
+	stopped = true;
+	stop_reason = reason;
+	run_usec = started ? GetTicks_usec() - start_usec : 0;
+	run_insns = started ? BenchInstructionCount() - start_insns : 0;
+	D(bug("Benchmark stopped (%s)\n", reason));
+	QuitEmulator();
+}
+
+
+/*
+ *  CPU thread hooks
+ */
+
+void BenchInterrupt(void)
+{
+	if (!started || stopped)
+		return;
+	interrupts++;
+	if (stop_mode == STOP_INSTRUCTIONS && BenchInstructionCount() - start_insns >= insn_limit)
+		BenchStop("instructions");
+	else if (timeout_usec && GetTicks_usec() - start_usec >= timeout_usec)
+		BenchStop("timeout");
+}
+
+static bool finder_is_current(void)
+{
+	// CurApName is a Pascal string
+	static const char finder[] = "\006Finder";
+	for (int i = 0; i < 7; i++)
+		if (ReadMacInt8(0x910 + i) != uint8(finder[i]))
+			return false;
+	return true;
+}
+
+void BenchIdle(void)
+{
+	if (stop_mode == STOP_FINDER && started && finder_is_current())
+		BenchStop("finder");
+
+	// Not done yet, sleep like the emulator does without the benchmark
+	idle_wait();
+}
+
+void BenchEmulOp(uint32 result)
+{
+	emulop_result = result;
+	have_emulop_result = true;
+	if (stop_mode == STOP_EMULOP)
+		BenchStop("emulop");
+}
+
+
+/*
+ *  Refresh thread hook
+ */
+
+void BenchRefresh(uint64 usec, bool changed)
+{
+	refreshes++;
+	refresh_usec += usec;
+	if (changed)
+		refresh_changed++;
+}
+
+
+/*
+ *  Write the report
+ */
+
+void BenchExit(void)
+{
+	if (!BenchActive)
+		return;
+	if (!stopped) {
+		// The guest shut down or the emulator was quit some other way
+		stopped = true;
+		stop_reason = "quit";
+		run_usec = started ? GetTicks_usec() - start_usec : 0;
+		run_insns = started ? BenchInstructionCount() - start_insns : 0;
+	}
+	BenchActive = false;
+
+	FILE *f = strcmp(output_path, "-") == 0 ? stdout : fopen(output_path, "w");
+	if (f == NULL) {
+		printf("WARNING: Cannot write benchmark report to %s (%s)\n", output_path, strerror(errno));
+		return;
+	}
+
+	double seconds = run_usec * 1e-6;
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(f, "{\n");
+#ifdef SHEEPSHAVER
+	fprintf(f, "  \"emulator\": \"SheepShaver\",\n");
+#else
+	fprintf(f, "  \"emulator\": \"BasiliskII\",\n");
+#endif
+	fprintf(f, "  \"stop\": \"%s\",\n", stop_reason);
+	fprintf(f, "  \"seconds\": %.6f,\n", seconds);
+	fprintf(f, "  \"instructions\": %llu,\n", (unsigned long long)run_insns);
+	fprintf(f, "  \"mips\": %.3f,\n", seconds > 0 ? run_insns / seconds * 1e-6 : 0.0);
+	fprintf(f, "  \"interrupts\": %llu,\n", (unsigned long long)interrupts);
+	fprintf(f, "  \"interrupts_per_sec\": %.1f,\n", seconds > 0 ? interrupts / seconds : 0.0);
+	fprintf(f, "  \"icount\": %u,\n", ICountRate);
+	fprintf(f, "  \"disk_read_bytes\": %llu,\n", (unsigned long long)BenchDiskRead);
+	fprintf(f, "  \"disk_write_bytes\": %llu,\n", (unsigned long long)BenchDiskWritten);
+	fprintf(f, "  \"refreshes\": %llu,\n", (unsigned long long)refreshes);
+	fprintf(f, "  \"refreshes_changed\": %llu,\n", (unsigned long long)refresh_changed);
+	fprintf(f, "  \"refresh_ms\": %.3f,\n", refresh_usec * 1e-3);
+	fprintf(f, "  \"refresh_avg_us\": %.3f,\n", refreshes ? double(refresh_usec) / refreshes : 0.0);
+	fprintf(f, "  \"user_seconds\": %.3f,\n", ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6);
+	fprintf(f, "  \"sys_seconds\": %.3f,\n", ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6);
+	fprintf(f, "  \"max_rss_kb\": %ld,\n", (long)ru.ru_maxrss);
+	unsigned long rss_kb, pss_kb;
+	if (vm_get_rss(&rss_kb, &pss_kb) == 0) {
+		fprintf(f, "  \"rss_kb\": %lu,\n", rss_kb);
+		fprintf(f, "  \"pss_kb\": %lu,\n", pss_kb);
+	}
+	if (have_emulop_result)
+		fprintf(f, "  \"emulop_result\": %u,\n", emulop_result);
+	fprintf(f, "  \"ramsize\": %d\n", PrefsFindInt32("ramsize"));
+	fprintf(f, "}\n");
+
+	if (f == stdout)
+		fflush(f);
+	else
+		fclose(f);
+}
@@ -41,6 +41,7 @@ using std::vector;
 #include "sys.h"
 #include "prefs.h"
 #include "disk.h"
+#include "snapshot.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -184,6 +185,45 @@ void DiskExit(void)
 }
 
 
+/*
+ *  Save/restore driver state for machine snapshots
+ */
+
+void DiskSaveState(FILE *f)
+{
+	SnapshotPut32(f, acc_run_called);
+	SnapshotPut32(f, drives.size());
+	drive_vec::const_iterator info, end = drives.end();
+	for (info = drives.begin(); info != end; ++info) {
+		SnapshotPut32(f, info->num);
+		SnapshotPut32(f, info->status);
+		SnapshotPut32(f, info->to_be_mounted);
+	}
+}
+
+bool DiskLoadState(FILE *f)
+{
+	uint32 acc_run, n;
+	if (!SnapshotGet32(f, acc_run) || !SnapshotGet32(f, n))
+		return false;
+	if (n != drives.size()) {
+		printf("WARNING: Snapshot has %d disk drives, prefs specify %d\n", n, int(drives.size()));
+		return false;
+	}
+	drive_vec::iterator info, end = drives.end();
+	for (info = drives.begin(); info != end; ++info) {
+		uint32 num, status, to_be_mounted;
+		if (!SnapshotGet32(f, num) || !SnapshotGet32(f, status) || !SnapshotGet32(f, to_be_mounted))
+			return false;
+		info->num = num;
+		info->status = status;
+		info->to_be_mounted = to_be_mounted != 0;
+	}
+	acc_run_called = acc_run != 0;
+	return true;
+}
+
+
 /*
  *  Disk was inserted, flag for mounting
  */
@@ -534,11 +574,14 @@ int16 DiskStatus(uint32 pb, uint32 dce)
 
 
 /*
- *  Driver interrupt routine (1Hz) - check for volumes to be mounted
+ *  Driver interrupt routine (1Hz) - write back cached data, check for
+ *  volumes to be mounted
  */
 
 void DiskInterrupt(void)
 {
+	SysFlushDisks();
+
 	if (!acc_run_called)
 		return;
 
@@ -41,6 +41,8 @@
 #include "ether.h"
 #include "extfs.h"
 #include "emul_op.h"
+#include "prefs.h"
+#include "bench.h"
 
 #ifdef ENABLE_MON
 #include "mon.h"
@@ -51,6 +53,194 @@
 
 void PlayStartupSound();
 
+
+/*
+ *  Native memory traps (BlockMove, Munger, CmpString)
+ */
+
+enum {
+	MEM_TRAP_BLOCK_MOVE,
+	MEM_TRAP_BLOCK_MOVE_DATA,
+	MEM_TRAP_MUNGER,
+	MEM_TRAP_CMP_STRING,
+	MEM_TRAP_CMP_STRING_ROM,	// Fell back to the ROM routine
+	MEM_TRAP_NUM
+};
+
+static struct {
+	const char *name;
+	uint32 calls;
+	uint64 bytes;
+} mem_trap_stats[MEM_TRAP_NUM] = {
+	{"BlockMove"}, {"BlockMoveData"}, {"Munger"}, {"CmpString"}, {"CmpString (ROM)"}
+};
+
+static inline void count_mem_trap(int which, uint32 bytes)
+{
+	mem_trap_stats[which].calls++;
+	mem_trap_stats[which].bytes += bytes;
+}
+
+// BlockMove()/BlockMoveData(): A0 source, A1 destination, D0 byte count
+static void native_block_move(M68kRegisters *r)
+{
+	// BlockMoveData is the same trap with bit 9 set in the trap word (D1),
+	// direct calls from ROM code don't have a trap word
+	bool data = (r->d[1] & 0xf9ff) == 0xa02e && (r->d[1] & 0x200);
+	int32 count = r->d[0];
+	if (count > 0) {
+		uint32 dst = r->a[1];
+		memmove(Mac2HostAddr(dst), Mac2HostAddr(r->a[0]), count);
+
+		// Only RAM can hold code, the frame buffer and I/O space can't
+		if (!data && dst < RAMBaseMac + RAMSize)
+			FlushCodeCache(Mac2HostAddr(dst), count);
+	} else
+		count = 0;
+	count_mem_trap(data ? MEM_TRAP_BLOCK_MOVE_DATA : MEM_TRAP_BLOCK_MOVE, count);
+	r->d[0] = 0;	// noErr
+}
+
+// Munger(h, offset, ptr1, len1, ptr2, len2): pascal stack frame, the stub pops the arguments
+static void native_munger(M68kRegisters *r)
+{
+	uint32 sp = r->a[7];
+	int32 len2 = ReadMacInt32(sp + 4);
+	uint32 ptr2 = ReadMacInt32(sp + 8);
+	int32 len1 = ReadMacInt32(sp + 12);
+	uint32 ptr1 = ReadMacInt32(sp + 16);
+	int32 offset = ReadMacInt32(sp + 20);
+	uint32 h = ReadMacInt32(sp + 24);
+	int32 result = -1;
+	uint32 bytes = 0;
+
+	M68kRegisters r2;
+	r2.a[0] = h;
+	Execute68kTrap(0xa025, &r2);	// GetHandleSize()
+	int32 size = r2.d[0];
+	if (size < 0 || offset < 0 || offset > size)
+		goto done;
+
+	if (ptr1) {
+
+		// Search for target string
+		const uint8 *data = Mac2HostAddr(ReadMacInt32(h));
+		const uint8 *target = Mac2HostAddr(ptr1);
+		if (len1 < 0 || len1 > size - offset)
+			goto done;
+		int32 i;
+		for (i=offset; i<=size-len1; i++) {
+			const uint8 *p = len1 ? (const uint8 *)memchr(data + i, target[0], size - len1 - i + 1) : data + i;
+			if (p == NULL)
+				goto done;
+			i = p - data;
+			if (memcmp(p, target, len1) == 0)
+				break;
+		}
+		if (i > size - len1)
+			goto done;
+		bytes = i - offset + len1;
+		offset = i;
+	} else {
+
+		// Replace len1 bytes at offset (up to the end if negative)
+		if (len1 < 0 || len1 > size - offset)
+			len1 = size - offset;
+	}
+
+	if (ptr2 == 0) {
+		result = offset;
+		goto done;
+	}
+
+	// Replace target string with ptr2/len2, growing or shrinking the handle around the move
+	if (len2 < 0)
+		len2 = 0;
+	if (len2 > len1) {
+		r2.a[0] = h;
+		r2.d[0] = size - len1 + len2;
+		Execute68kTrap(0xa024, &r2);	// SetHandleSize()
+		if (r2.d[0])
+			goto done;
+	}
+	{
+		uint8 *data = Mac2HostAddr(ReadMacInt32(h));
+		memmove(data + offset + len2, data + offset + len1, size - offset - len1);
+		memmove(data + offset, Mac2HostAddr(ptr2), len2);
+	}
+	if (len2 < len1) {
+		r2.a[0] = h;
+		r2.d[0] = size - len1 + len2;
+		Execute68kTrap(0xa024, &r2);	// SetHandleSize()
+	}
+	bytes += size - offset + len2;
+	result = offset + len2;
+
+done:
+	count_mem_trap(MEM_TRAP_MUNGER, bytes);
+	WriteMacInt32(sp + 28, result);
+}
+
+// CmpString()/EqualString(): A0/A1 strings, D0 lengths (high/low word), returns D0 = 0 if equal
+static void native_cmp_string(M68kRegisters *r)
+{
+	uint32 len1 = r->d[0] >> 16, len2 = r->d[0] & 0xffff;
+	if (len1 != len2) {
+		count_mem_trap(MEM_TRAP_CMP_STRING, 0);
+		r->d[0] = 1;
+		return;
+	}
+	const uint8 *s1 = Mac2HostAddr(r->a[0]), *s2 = Mac2HostAddr(r->a[1]);
+
+	// Trap word flags: bit 9 = ignore diacriticals, bit 10 = case-sensitive
+	bool trap = (r->d[1] & 0xf9ff) == 0xa03c;
+	if (trap && (r->d[1] & 0x600) == 0x400) {
+		count_mem_trap(MEM_TRAP_CMP_STRING, len1);
+		r->d[0] = memcmp(s1, s2, len1) != 0;
+		return;
+	}
+
+	// Case and diacritical folding is only done natively for ASCII, the
+	// ROM has the tables for the rest of the Mac character set
+	bool ascii = trap;
+	for (uint32 i=0; ascii && i<len1; i++)
+		ascii = (s1[i] | s2[i]) < 0x80;
+	if (!ascii && CmpStringROM) {
+		count_mem_trap(MEM_TRAP_CMP_STRING_ROM, len1);
+		M68kRegisters r2 = *r;
+		Execute68k(CmpStringROM, &r2);
+		r->d[0] = r2.d[0];
+		return;
+	}
+	count_mem_trap(MEM_TRAP_CMP_STRING, len1);
+	bool case_sens = r->d[1] & 0x400;
+	uint32 i;
+	for (i=0; i<len1; i++) {
+		uint8 c1 = s1[i], c2 = s2[i];
+		if (!case_sens) {
+			if (c1 >= 'a' && c1 <= 'z') c1 -= 'a' - 'A';
+			if (c2 >= 'a' && c2 <= 'z') c2 -= 'a' - 'A';
+		}
+		if (c1 != c2)
+			break;
+	}
+	r->d[0] = i != len1;
+}
+
+
+/*
+ *  Print native trap statistics
+ */
+
+void EmulOpExit(void)
+{
+	if (!PrefsFindBool("memtrapstats"))
+		return;
+	printf("Native memory traps:\n");
+	for (int i=0; i<MEM_TRAP_NUM; i++)
+		printf(" %-16s %10u calls %14llu bytes\n", mem_trap_stats[i].name, mem_trap_stats[i].calls, (unsigned long long)mem_trap_stats[i].bytes);
+}
+
 /*
  *  Execute EMUL_OP opcode (called by 68k emulator or Illegal Instruction trap handler)
  */
@@ -90,6 +280,7 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 			}
 			bootflag = true;
 			D(bug("*** RESET ***\n"));
+			ATrapOSReturn = 0;	// The ROM's trap dispatcher runs until PatchAfterStartup()
 			TimerReset();
 			EtherReset();
 			AudioReset();
@@ -158,6 +349,7 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 					if (reg == 0x8a && !TwentyFourBitAddressing)
 						r->d[2] |= 0x05;	// 32bit mode is always enabled if possible
 					XPRAM[reg] = r->d[2];
+					XPRAMDirty = true;
 				}
 			} else {
 				// PRAM, RTC and other clock registers
@@ -169,6 +361,7 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 					} else {
 						D(bug("Write PRAM %02x<-%02lx\n", reg, r->d[2]));
 						XPRAM[reg] = r->d[2];
+						XPRAMDirty = true;
 					}
 				} else if (reg < 0x08 && is_read) {
 					uint32 t = TimerDateTime();
@@ -410,10 +603,19 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 					WriteMacInt16(r->a[7] + 6, SCSICmd(ReadMacInt16(r->a[7]), Mac2HostAddr(ReadMacInt32(r->a[7] + 2))));
 					stack = 6;
 					break;
-				case 4:		// SCSIComplete
-					WriteMacInt16(r->a[7] + 12, SCSIComplete(ReadMacInt32(r->a[7]), ReadMacInt32(r->a[7] + 4), ReadMacInt32(r->a[7] + 8)));
-					stack = 12;
+				case 4: {	// SCSIComplete
+					int16 err = SCSIComplete(ReadMacInt32(r->a[7]), ReadMacInt32(r->a[7] + 4), ReadMacInt32(r->a[7] + 8));
+					if (err == SCSI_COMPLETE_PENDING) {
+						// Command still running, call SCSIDispatch() again so interrupts are handled meanwhile
+						r->a[7] -= 6;
+						ret = SCSIDispatchPatch;
+						stack = 0;
+					} else {
+						WriteMacInt16(r->a[7] + 12, err);
+						stack = 12;
+					}
 					break;
+				}
 				case 5:		// SCSIRead
 				case 8:		// SCSIRBlind
 					WriteMacInt16(r->a[7] + 4, SCSIRead(ReadMacInt32(r->a[7])));
@@ -456,8 +658,11 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 			if (InterruptFlags & INTFLAG_60HZ) {
 				ClearInterruptFlag(INTFLAG_60HZ);
 
-				// Increment Ticks variable
-				WriteMacInt32(0x16a, ReadMacInt32(0x16a) + 1);
+				// Increment Ticks variable, catching up with ticks skipped while idle
+				int skipped = idle_take_skipped_ticks();
+				WriteMacInt32(0x16a, ReadMacInt32(0x16a) + 1 + skipped);
+				if (skipped)
+					WriteMacInt32(0x20c, TimerDateTime());
 
 				if (HasMacStarted()) {
 
@@ -484,6 +689,7 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 					SonyInterrupt();
 					DiskInterrupt();
 					CDROMInterrupt();
+					ExtFSInterrupt();
 				}
 			}
 
@@ -568,6 +774,18 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 			FlushCodeCache(Mac2HostAddr(r->a[0]), r->a[1]);
 			break;
 
+		case M68K_EMUL_OP_BLOCK_MOVE_NATIVE:	// BlockMove()/BlockMoveData() replacement
+			native_block_move(r);
+			break;
+
+		case M68K_EMUL_OP_MUNGER:			// Munger() replacement
+			native_munger(r);
+			break;
+
+		case M68K_EMUL_OP_CMP_STRING:		// CmpString() replacement
+			native_cmp_string(r);
+			break;
+
 		case M68K_EMUL_OP_DEBUGUTIL:
 		//	printf("DebugUtil d0=%08lx  a5=%08lx\n", r->d[0], r->a[5]);
 			r->d[0] = DebugUtil(r->d[0]);
@@ -575,11 +793,21 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 
 		case M68K_EMUL_OP_IDLE_TIME:	// SynchIdleTime() patch
 			// Sleep if no events pending
-			if (ReadMacInt32(0x14c) == 0)
-				idle_wait();
+			if (ReadMacInt32(0x14c) == 0) {
+				if (BenchActive)
+					BenchIdle();
+				else
+					idle_wait();
+			}
 			r->a[0] = ReadMacInt32(0x2b6);
 			break;
 
+		case M68K_EMUL_OP_BENCH_STOP:	// Benchmark milestone reached
+			D(bug("BenchStop d0 %08x\n", r->d[0]));
+			if (BenchActive)
+				BenchEmulOp(r->d[0]);
+			break;
+
 		case M68K_EMUL_OP_SUSPEND: {
 			printf("*** Suspend\n");
 			printf("d0 %08x d1 %08x d2 %08x d3 %08x\n"
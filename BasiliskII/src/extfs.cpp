@@ -42,6 +42,9 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #ifndef WIN32
 #include <unistd.h>
@@ -60,6 +63,7 @@
 #include "user_strings.h"
 #include "extfs.h"
 #include "extfs_defs.h"
+#include "snapshot.h"
 
 #ifdef WIN32
 # include "posix_emu.h"
@@ -302,6 +306,80 @@ static void get_path_for_fsitem(FSItem *p)
 }
 
 
+/*
+ *  Directory snapshots for indexed enumeration (visible entries sorted by
+ *  name, rebuilt when the modification time of the directory changes)
+ */
+
+struct dir_snapshot {
+	FSItem *dir;				// Directory (NULL = unused)
+	time_t mtime;				// Modification time of directory
+	time_t built;				// Time the snapshot was taken
+	std::vector<FSItem *> items;
+};
+
+const int NUM_DIR_SNAPSHOTS = 8;
+static dir_snapshot dir_snapshots[NUM_DIR_SNAPSHOTS];
+static int next_dir_snapshot = 0;
+
+static void invalidate_dir_snapshots(void)
+{
+	for (int i=0; i<NUM_DIR_SNAPSHOTS; i++) {
+		dir_snapshots[i].dir = NULL;
+		dir_snapshots[i].items.clear();
+	}
+}
+
+static bool fsitem_name_less(const FSItem *a, const FSItem *b)
+{
+	return strcmp(a->name, b->name) < 0;
+}
+
+// Get snapshot of directory, full_path must contain the path of the directory
+static const dir_snapshot *get_dir_snapshot(FSItem *dir)
+{
+	struct stat st;
+	if (extfs_stat(full_path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+
+	// Changes within the second the snapshot was taken don't show up in
+	// the modification time, so such a snapshot is never reused
+	dir_snapshot *s = NULL;
+	for (int i=0; i<NUM_DIR_SNAPSHOTS; i++) {
+		if (dir_snapshots[i].dir == dir) {
+			s = &dir_snapshots[i];
+			if (s->mtime == st.st_mtime && s->mtime < s->built)
+				return s;
+			break;
+		}
+	}
+	if (s == NULL) {
+		s = &dir_snapshots[next_dir_snapshot];
+		next_dir_snapshot = (next_dir_snapshot + 1) % NUM_DIR_SNAPSHOTS;
+	}
+
+	// Read directory
+	s->dir = NULL;
+	s->items.clear();
+	DIR *d = opendir(full_path);
+	if (d == NULL)
+		return NULL;
+	s->built = time(NULL);
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
+		s->items.push_back(find_fsitem(de->d_name, dir));
+	}
+	closedir(d);
+	std::sort(s->items.begin(), s->items.end(), fsitem_name_less);
+	s->dir = dir;
+	s->mtime = st.st_mtime;
+	D(bug(" directory snapshot of %s, %d entries\n", full_path, (int)s->items.size()));
+	return s;
+}
+
+
 /*
  *  Exchange parent CNIDs in all FSItems
  */
@@ -464,12 +542,120 @@ void ExtFSExit(void)
 		p = next;
 	}
 	first_fs_item = last_fs_item = NULL;
+	invalidate_dir_snapshots();
 
 	// System specific deinitialization
 	extfs_exit();
 }
 
 
+/*
+ *  Driver interrupt routine (1Hz) - write back cached metadata
+ */
+
+void ExtFSInterrupt(void)
+{
+	extfs_flush();
+}
+
+
+/*
+ *  Save/restore file system state for machine snapshots (the FSItem list
+ *  must survive, as CNIDs handed out to MacOS refer to it)
+ */
+
+void ExtFSSaveState(FILE *f)
+{
+	SnapshotPut32(f, fs_data);
+	SnapshotPut32(f, drive_number);
+	SnapshotPut32(f, next_cnid);
+
+	uint32 n = 0;
+	for (FSItem *p = first_fs_item; p; p = p->next)
+		n++;
+	SnapshotPut32(f, n);
+	for (FSItem *p = first_fs_item; p; p = p->next) {
+		uint32 len = strlen(p->name);
+		SnapshotPut32(f, p->id);
+		SnapshotPut32(f, p->parent_id);
+		SnapshotPut32(f, len);
+		SnapshotPutBlock(f, p->name, len);
+		SnapshotPutBlock(f, p->guest_name, 32);
+	}
+}
+
+bool ExtFSLoadState(FILE *f)
+{
+	uint32 data, drive, cnid, n;
+	if (!SnapshotGet32(f, data) || !SnapshotGet32(f, drive) || !SnapshotGet32(f, cnid) || !SnapshotGet32(f, n))
+		return false;
+
+	// Read items into a new list
+	FSItem *first = NULL, *last = NULL;
+	std::map<uint32, FSItem *> by_id;
+	bool ok = true;
+	for (uint32 i = 0; i < n && ok; i++) {
+		uint32 id, parent_id, len;
+		if (!SnapshotGet32(f, id) || !SnapshotGet32(f, parent_id) || !SnapshotGet32(f, len) || len >= MAX_PATH_LENGTH) {
+			ok = false;
+			break;
+		}
+		FSItem *p = new FSItem;
+		p->next = NULL;
+		p->id = id;
+		p->parent_id = parent_id;
+		p->parent = NULL;
+		p->name = new char[len + 1];
+		p->mtime = 0;
+		p->cache_dircount = 0;
+		if (last)
+			last->next = p;
+		else
+			first = p;
+		last = p;
+		ok = SnapshotGetBlock(f, p->name, len) && SnapshotGetBlock(f, p->guest_name, 32);
+		p->name[len] = 0;
+		p->guest_name[31] = 0;
+		by_id[id] = p;
+	}
+
+	// Resolve parent pointers
+	for (FSItem *p = first; p && ok; p = p->next) {
+		if (p->id == ROOT_PARENT_ID)
+			continue;
+		std::map<uint32, FSItem *>::const_iterator it = by_id.find(p->parent_id);
+		if (it == by_id.end())
+			ok = false;
+		else
+			p->parent = it->second;
+	}
+
+	if (!ok || first == NULL || first->id != ROOT_PARENT_ID) {
+		while (first) {
+			FSItem *next = first->next;
+			delete[] first->name;
+			delete first;
+			first = next;
+		}
+		return false;
+	}
+
+	// Replace current list
+	invalidate_dir_snapshots();
+	for (FSItem *p = first_fs_item, *next; p; p = next) {
+		next = p->next;
+		delete[] p->name;
+		delete p;
+	}
+	first_fs_item = first;
+	last_fs_item = last;
+	fs_data = data;
+	drive_number = drive;
+	next_cnid = cnid;
+	return true;
+}
+
+
 /*
  *  Install file system
  */
@@ -1212,7 +1398,7 @@ static int16 fs_set_vol(uint32 pb, bool hfs, uint32 vcb)
 
 		// Is it a directory?
 		struct stat st;
-		if (stat(full_path, &st))
+		if (extfs_stat(full_path, &st))
 			return dirNFErr;
 		if (!S_ISDIR(st.st_mode))
 			return dirNFErr;
@@ -1276,31 +1462,19 @@ static int16 fs_get_file_info(uint32 pb, bool hfs, uint32 dirID)
 		get_path_for_fsitem(p);
 
 		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
+		//!! suppress directories
+		const dir_snapshot *s = get_dir_snapshot(p);
+		if (s == NULL)
 			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-			//!! suppress directories
-		}
-		add_path_comp(de->d_name);
-
-		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		if (dir_index > (int)s->items.size())
+			return fnfErr;
+		fs_item = s->items[dir_index - 1];
+		add_path_comp(fs_item->name);
 	}
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st))
+	if (extfs_stat(full_path, &st))
 		return fnfErr;
 	if (S_ISDIR(st.st_mode))
 		return fnfErr;
@@ -1353,7 +1527,7 @@ static int16 fs_set_file_info(uint32 pb, bool hfs, uint32 dirID)
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st) < 0)
+	if (extfs_stat(full_path, &st) < 0)
 		return errno2oserr();
 	if (S_ISDIR(st.st_mode))
 		return fnfErr;
@@ -1400,31 +1574,19 @@ static int16 fs_get_cat_info(uint32 pb)
 		get_path_for_fsitem(p);
 
 		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
+		const dir_snapshot *s = get_dir_snapshot(p);
+		if (s == NULL)
 			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-		}
-		add_path_comp(de->d_name);
-
-		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		if (dir_index > (int)s->items.size())
+			return fnfErr;
+		fs_item = s->items[dir_index - 1];
+		add_path_comp(fs_item->name);
 	}
 	D(bug("  path %s\n", full_path));
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st) < 0)
+	if (extfs_stat(full_path, &st) < 0)
 		return errno2oserr();
 	if (dir_index == -1 && !S_ISDIR(st.st_mode))
 		return dirNFErr;
@@ -1506,7 +1668,7 @@ static int16 fs_set_cat_info(uint32 pb)
 
 	// Get stats
 	struct stat st;
-	if (stat(full_path, &st) < 0)
+	if (extfs_stat(full_path, &st) < 0)
 		return errno2oserr();
 
 	// Set Finder info
@@ -1958,6 +2120,7 @@ static int16 fs_create(uint32 pb, uint32 dirID)
 		return dupFNErr;
 
 	// Create file
+	invalidate_dir_snapshots();
 	int fd = creat(full_path, 0666);
 	if (fd < 0)
 		return errno2oserr();
@@ -1983,6 +2146,7 @@ static int16 fs_dir_create(uint32 pb)
 		return dupFNErr;
 
 	// Create directory
+	invalidate_dir_snapshots();
 	if (mkdir(full_path, 0777) < 0)
 		return errno2oserr();
 	else {
@@ -2003,6 +2167,7 @@ static int16 fs_delete(uint32 pb, uint32 dirID)
 		return result;
 
 	// Delete file
+	invalidate_dir_snapshots();
 	if (!extfs_remove(full_path))
 		return errno2oserr();
 	else
@@ -2038,6 +2203,7 @@ static int16 fs_rename(uint32 pb, uint32 dirID)
 
 	// Rename item
 	D(bug("  renaming %s -> %s\n", old_path, full_path));
+	invalidate_dir_snapshots();
 	if (!extfs_rename(old_path, full_path))
 		return errno2oserr();
 	else {
@@ -2082,6 +2248,7 @@ static int16 fs_cat_move(uint32 pb)
 
 	// Move item
 	D(bug("  moving %s -> %s\n", old_path, full_path));
+	invalidate_dir_snapshots();
 	if (!extfs_rename(old_path, full_path))
 		return errno2oserr();
 	else {
@@ -0,0 +1,45 @@
+/*
+ *  bench.h - Headless boot benchmark
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+extern bool BenchActive;		// Benchmark run in progress, check before calling the hooks
+
+extern void BenchInit(void);	// Called right after PrefsInit(), overrides display, audio and network prefs
+extern void BenchStart(void);	// Called when everything is initialized, starts the clock
+extern void BenchExit(void);	// Writes the report
+
+// Ends the run and quits the emulator (CPU thread only)
+extern void BenchStop(const char *reason);
+
+// Hooks called by the CPU thread
+extern void BenchInterrupt(void);			// Interrupt delivered to the guest
+extern void BenchIdle(void);				// SynchIdleTime() with an empty event queue, instead of idle_wait()
+extern void BenchEmulOp(uint32 result);		// Guest executed M68K_EMUL_OP_BENCH_STOP, result is its d0
+
+// Hooks called by the drivers
+extern uint64 BenchDiskRead, BenchDiskWritten;	// Bytes requested through Sys_read()/Sys_write()
+extern void BenchRefresh(uint64 usec, bool changed);	// One screen refresh took usec, changed if the frame buffer was modified
+
+// Implemented by the CPU glue
+extern uint64 BenchInstructionCount(void);
+
+#endif
@@ -33,6 +33,9 @@ extern void CDROMExit(void);
 
 extern void CDROMInterrupt(void);
 
+extern void CDROMSaveState(FILE *f);
+extern bool CDROMLoadState(FILE *f);
+
 extern bool CDROMMountVolume(void *fh);
 
 extern int16 CDROMOpen(uint32 pb, uint32 dce);
@@ -75,6 +75,7 @@ extern void Exit680x0(void);
 // 680x0 emulation functions
 struct M68kRegisters;
 extern void Start680x0(void);	// Reset and start 680x0
+extern void Resume680x0(void);	// Start 680x0 with state restored from snapshot
 
 extern "C" void Execute68k(uint32 addr, M68kRegisters *r);		// Execute 68k code from EMUL_OP routine
 extern "C" void Execute68kTrap(uint16 trap, M68kRegisters *r);	// Execute MacOS 68k trap from EMUL_OP routine
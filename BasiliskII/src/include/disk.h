@@ -33,6 +33,9 @@ extern void DiskExit(void);
 
 extern void DiskInterrupt(void);
 
+extern void DiskSaveState(FILE *f);
+extern bool DiskLoadState(FILE *f);
+
 extern bool DiskMountVolume(void *fh);
 
 extern int16 DiskOpen(uint32 pb, uint32 dce);
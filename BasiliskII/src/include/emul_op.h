@@ -91,10 +91,15 @@ enum {
 	M68K_EMUL_OP_DEBUGUTIL,
 	M68K_EMUL_OP_IDLE_TIME,
 	M68K_EMUL_OP_SUSPEND,
+	M68K_EMUL_OP_BLOCK_MOVE_NATIVE,	// 0x7139
+	M68K_EMUL_OP_MUNGER,
+	M68K_EMUL_OP_CMP_STRING,
+	M68K_EMUL_OP_BENCH_STOP,		// 0x713c, executed by benchmark test applications
 	M68K_EMUL_OP_MAX				// highest number
 };
 
 // Functions
 extern void EmulOp(uint16 opcode, struct M68kRegisters *r);	// Execute EMUL_OP opcode (called by 68k emulator or Line-F trap handler)
+extern void EmulOpExit(void);								// Print native trap statistics if requested
 
 #endif
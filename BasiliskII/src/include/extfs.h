@@ -26,13 +26,20 @@ extern void ExtFSExit(void);
 
 extern void InstallExtFS(void);
 
+extern void ExtFSSaveState(FILE *f);
+extern bool ExtFSLoadState(FILE *f);
+
 extern int16 ExtFSComm(uint16 message, uint32 paramBlock, uint32 globalsPtr);
 extern int16 ExtFSHFS(uint32 vcb, uint16 selectCode, uint32 paramBlock, uint32 globalsPtr, int16 fsid);
 
+extern void ExtFSInterrupt(void);
+
 // System specific and internal functions/data
 extern void extfs_init(void);
 extern void extfs_exit(void);
+extern void extfs_flush(void);
 extern void add_path_component(char *path, const char *component);
+extern int extfs_stat(const char *path, struct stat *st);
 extern void get_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir);
 extern void set_finfo(const char *path, uint32 finfo, uint32 fxinfo, bool is_dir);
 extern uint32 get_rfork_size(const char *path);
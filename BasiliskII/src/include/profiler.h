@@ -0,0 +1,54 @@
+/*
+ *  profiler.h - Sampling guest profiler
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Host handler classes for ProfilerHandler()
+enum {
+	PROFILER_EMUL_OP = 0x00000,		// 68k EMUL_OP opcode
+	PROFILER_NATIVE_OP = 0x10000,	// SheepShaver NATIVE_OP selector
+	PROFILER_HOST = 0x20000			// Host work done on the CPU thread (PROFILER_HOST_*)
+};
+
+enum {
+	PROFILER_HOST_EVENTS			// Transfer of window system events into the SDL queue
+};
+
+extern bool ProfilerActive;		// Only written by the CPU thread, check before calling the counting functions
+
+extern void ProfilerInit(void);
+extern void ProfilerExit(void);
+extern void ProfilerToggle(void);		// Async-signal safe, takes effect at the next sample
+
+// Implemented by the CPU glue, makes the CPU thread call ProfilerService() soon
+extern void ProfilerRequestSample(void);
+
+// Called by the CPU thread: pc is the current guest PC, callers holds return addresses, innermost first
+extern void ProfilerService(uint32 pc, const uint32 *callers, int num_callers);
+const int PROFILER_MAX_CALLERS = 32;
+
+// Event counters, only call these while ProfilerActive is set
+extern void ProfilerTrap(uint16 trap);
+extern void ProfilerInterrupt(int level);
+extern uint64 ProfilerClock(void);						// Nanoseconds
+extern void ProfilerHandler(uint32 id, uint64 start);	// Host handler that was entered at ProfilerClock() time start
+
+#endif
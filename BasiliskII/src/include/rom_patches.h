@@ -44,6 +44,15 @@ extern uint32 PutScrapPatch;
 // Mac address of GetScrap() patch
 extern uint32 GetScrapPatch;
 
+// Mac address of original CmpString() routine, used as fallback by the native one
+extern uint32 CmpStringROM;
+
+// Mac address of SCSIDispatch() replacement, called again while a SCSI command is running
+extern uint32 SCSIDispatchPatch;
+
+// Mac address of OS trap return code, enables native A-line dispatch in the CPU core if not 0
+extern uint32 ATrapOSReturn;
+
 // Flag: print ROM information in PatchROM()
 extern bool PrintROMInfo;
 
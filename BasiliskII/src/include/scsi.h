@@ -31,6 +31,9 @@ extern int16 SCSIComplete(uint32 timeout, uint32 message, uint32 stat);
 extern uint16 SCSIStat(void);
 extern int16 SCSIMgrBusy(void);
 
+// Returned by SCSIComplete() while the command is still running, SCSIComplete() must be called again
+const int16 SCSI_COMPLETE_PENDING = 0x7fff;
+
 // System specific and internal functions/data
 extern void SCSIInit(void);
 extern void SCSIExit(void);
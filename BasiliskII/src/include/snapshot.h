@@ -0,0 +1,59 @@
+/*
+ *  snapshot.h - Machine state snapshot and resume
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+
+extern bool SnapshotSave(const char *path);
+extern bool SnapshotLoad(const char *path);
+
+extern void SnapshotRequest(void);		// Not async-signal safe (takes the spcflags lock), snapshot is taken by the CPU thread
+extern void SnapshotService(void);		// Called by the CPU loop when SPCFLAG_SNAPSHOT is set
+
+// Section I/O for per-module state (integers are stored big-endian)
+static inline void SnapshotPut32(FILE *f, uint32 v)
+{
+	uint8 b[4] = {uint8(v >> 24), uint8(v >> 16), uint8(v >> 8), uint8(v)};
+	fwrite(b, 4, 1, f);
+}
+
+static inline bool SnapshotGet32(FILE *f, uint32 &v)
+{
+	uint8 b[4];
+	if (fread(b, 4, 1, f) != 1)
+		return false;
+	v = (b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+	return true;
+}
+
+static inline void SnapshotPutBlock(FILE *f, const void *p, size_t n)
+{
+	if (n)
+		fwrite(p, n, 1, f);
+}
+
+static inline bool SnapshotGetBlock(FILE *f, void *p, size_t n)
+{
+	return n == 0 || fread(p, n, 1, f) == 1;
+}
+
+#endif
@@ -35,6 +35,9 @@ extern void SonyExit(void);
 
 extern void SonyInterrupt(void);
 
+extern void SonySaveState(FILE *f);
+extern bool SonyLoadState(FILE *f);
+
 extern bool SonyMountVolume(void *fh);
 
 extern int16 SonyOpen(uint32 pb, uint32 dce);
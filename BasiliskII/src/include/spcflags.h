@@ -21,6 +21,8 @@ enum {
 	SPCFLAG_INT3		= 0x800,
 	SPCFLAG_INT5		= 0x1000,
 	SPCFLAG_SCC		= 0x2000,
+	SPCFLAG_SNAPSHOT	= 0x4000,
+	SPCFLAG_PROFILE		= 0x8000,
 	SPCFLAG_ALL			= SPCFLAG_STOP
 					| SPCFLAG_INT
 					| SPCFLAG_BRK
@@ -32,6 +34,8 @@ enum {
 					| SPCFLAG_INT5
 					| SPCFLAG_SCC
 					| SPCFLAG_MFP
+					| SPCFLAG_SNAPSHOT
+					| SPCFLAG_PROFILE
 };
 
 extern uae_u32 spcflags;
@@ -60,6 +60,7 @@ extern bool SysFormat(void *fh);
 extern bool SysIsReadOnly(void *fh);
 extern bool SysIsFixedDisk(void *fh);
 extern bool SysIsDiskInserted(void *fh);
+extern void SysFlushDisks(void);
 
 extern void SysPreventRemoval(void *fh);
 extern void SysAllowRemoval(void *fh);
@@ -34,6 +34,9 @@ extern void Microseconds(uint32 &hi, uint32 &lo);
 
 extern uint32 TimerDateTime(void);
 
+extern void TimerSaveState(FILE *f);
+extern bool TimerLoadState(FILE *f);
+
 // System specific and internal functions/data
 extern void timer_current_time(tm_time_t &t);
 extern void timer_add_time(tm_time_t &res, tm_time_t a, tm_time_t b);
@@ -46,4 +49,21 @@ extern int32 timer_host2mac_time(tm_time_t hosttime);
 extern void idle_wait(void);
 extern void idle_resume(void);
 
+// Tickless idle (60Hz and refresh threads)
+extern uint32 idle_period(void);
+extern bool idle_sleep(uint32 period, int32 max_usec);
+extern void idle_skip_ticks(int n);
+extern int idle_take_skipped_ticks(void);
+
+// Deterministic time mode ("icount" pref), guest clocks follow the executed instruction count
+extern uint32 ICountRate;						// Guest instructions per microsecond, 0 = host clock
+extern void ICountInit(void);
+extern void ICountService(void);				// Called by the CPU core at the instruction deadline
+extern void ICountIdle(void);					// Skip to the next tick or timer wakeup
+extern bool TimerCheckWakeup(tm_time_t &next);	// Trigger expired Time Manager task, get next wakeup
+
+// Implemented by the CPU glue and main_unix.cpp
+extern void ICountSetDeadline(uint64 insns);	// Call ICountService() when BenchInstructionCount() reaches insns
+extern void ICountTick(void);					// 60Hz tick
+
 #endif
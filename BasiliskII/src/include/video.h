@@ -179,6 +179,10 @@ public:
 	int16 driver_control(uint16 code, uint32 param, uint32 dce);
 	int16 driver_status(uint16 code, uint32 param);
 
+	// Save/restore state for machine snapshots
+	void save_state(FILE *f) const;
+	bool load_state(FILE *f);
+
 protected:
 	vector<video_mode> modes;                         // List of supported video modes
 	vector<video_mode>::const_iterator current_mode;  // Currently selected video mode
@@ -28,6 +28,7 @@ const int XPRAM_SIZE = 256;
 #endif
 
 extern uint8 XPRAM[XPRAM_SIZE];
+extern volatile bool XPRAMDirty;		// Set when the MacOS writes to XPRAM
 
 extern void XPRAMInit(const char *vmdir);
 extern void XPRAMExit(void);
@@ -35,6 +35,9 @@
 #include "clip.h"
 #include "adb.h"
 #include "rom_patches.h"
+#include "emul_op.h"
+#include "profiler.h"
+#include "bench.h"
 #include "user_strings.h"
 #include "prefs.h"
 #include "main.h"
@@ -176,6 +179,12 @@ bool InitAll(const char *vmdir)
 	mon_write_byte = mon_write_byte_b2;
 #endif
 
+	// Init guest profiler
+	ProfilerInit();
+
+	// Start benchmark clock
+	BenchStart();
+
 	return true;
 }
 
@@ -188,6 +197,9 @@ void CDROMOpenDone() {
 
 void ExitAll(void)
 {
+	// Write guest profile
+	ProfilerExit();
+
 #if ENABLE_MON
 	// Deinitialize mon
 	mon_exit();
@@ -199,6 +211,9 @@ void ExitAll(void)
 	// Exit video
 	VideoExit();
 
+	// Write benchmark report (the refresh thread has stopped now)
+	BenchExit();
+
 	// Exit audio
 	AudioExit();
 
@@ -227,6 +242,9 @@ void ExitAll(void)
 	CDROMExit();
 	DiskExit();
 	SonyExit();
+
+	// Print native trap statistics
+	EmulOpExit();
 }
 
 
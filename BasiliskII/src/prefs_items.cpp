@@ -49,6 +49,20 @@ prefs_desc common_prefs_items[] = {
 	{"udpport", TYPE_INT32, false,    "IP port number for tunneling"},
 	{"redir", TYPE_STRING, true,      "port forwarding for slirp"},
 	{"rom", TYPE_STRING, false,       "path of ROM file"},
+	{"romcache", TYPE_STRING, false,  "path of ROM patch offset cache file"},
+	{"snapshot", TYPE_STRING, false,  "path of machine snapshot file written on SIGUSR2"},
+	{"resume", TYPE_STRING, false,    "path of machine snapshot file to resume from"},
+	{"nomemtraps", TYPE_BOOLEAN, false, "don't replace BlockMove/Munger/CmpString with native code"},
+	{"memtrapstats", TYPE_BOOLEAN, false, "print native memory trap statistics on exit"},
+	{"nativetrapdispatch", TYPE_BOOLEAN, false, "dispatch A-line traps through the trap tables without the ROM's dispatcher"},
+	{"profile", TYPE_STRING, false,   "path prefix of guest profile output, enables profiling (SIGPROF toggles)"},
+	{"profilehz", TYPE_INT32, false,  "profiler sampling rate in Hz"},
+	{"bench", TYPE_STRING, false,     "path of benchmark report (\"-\" = stdout), enables headless benchmark mode"},
+	{"benchstop", TYPE_STRING, false, "benchmark end: \"finder\", \"emulop\" or number of instructions"},
+	{"benchtimeout", TYPE_INT32, false, "benchmark time limit in seconds (0 = none)"},
+	{"romshare", TYPE_BOOLEAN, false, "share the patched ROM with other instances"},
+	{"rammerge", TYPE_BOOLEAN, false, "let the host merge identical pages of Mac RAM"},
+	{"memstats", TYPE_BOOLEAN, false, "print host memory usage on exit"},
 	{"bootdrive", TYPE_INT32, false,  "boot drive number"},
 	{"bootdriver", TYPE_INT32, false, "boot driver number"},
 	{"ramsize", TYPE_INT32, false,    "size of Mac RAM in bytes"},
@@ -111,6 +125,14 @@ void AddPrefsDefaults(void)
 	PrefsAddBool("nosound", false);
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("nogui", false);
+	PrefsAddBool("nomemtraps", false);
+	PrefsAddBool("memtrapstats", false);
+	PrefsAddBool("nativetrapdispatch", false);
+	PrefsAddInt32("profilehz", 1000);
+	PrefsAddInt32("benchtimeout", 600);
+	PrefsAddBool("romshare", false);
+	PrefsAddBool("rammerge", false);
+	PrefsAddBool("memstats", false);
 	
 #if USE_JIT
 	// JIT compiler specific options
@@ -0,0 +1,366 @@
+/*
+ *  profiler.cpp - Sampling guest profiler
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  A sampler thread asks the CPU thread for a sample "profilehz" times per
+ *  second. The CPU thread records the guest PC together with the return
+ *  addresses it finds on the guest stack. A-line traps, EMUL_OPs/NATIVE_OPs
+ *  and interrupts are counted as they happen, host handlers are timed
+ *  inclusively (nested Execute68k() calls count towards their caller).
+ *
+ *  Profiling starts at boot if the "profile" pref is set and can be toggled
+ *  with SIGPROF. When it is stopped, or on exit, two files are written:
+ *
+ *    <profile>.flat.txt  PC histogram, trap, handler and interrupt counts
+ *    <profile>.folded    one "caller;...;pc count" line per distinct stack,
+ *                        the input format of flamegraph.pl and speedscope
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#if defined(PRECISE_TIMING_POSIX) || defined(PRECISE_TIMING_MACH)
+#include <pthread.h>
+#define PROFILER_THREAD 1
+#endif
+
+#include "prefs.h"
+#include "profiler.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+
+// Public state
+bool ProfilerActive = false;
+
+// Configuration
+static const char *output_prefix = NULL;	// Output path prefix, NULL = profiler disabled
+static int32 sample_hz = 1000;
+
+// Start/stop requests from the signal handler, handled by the CPU thread
+static volatile sig_atomic_t toggle_pending = 0;
+
+// Collected data
+typedef std::vector<uint32> call_stack;
+static std::map<uint32, uint32> pc_hist;			// PC -> samples
+static std::map<call_stack, uint32> stack_hist;		// Stack (outermost first) -> samples
+static uint32 num_samples = 0;
+static uint64 start_time = 0;
+
+static uint32 trap_count[0x1000];				// A-line traps by trap number
+
+struct handler_stat {
+	uint32 calls;
+	uint64 nsec;
+};
+static std::map<uint32, handler_stat> handler_hist;	// EMUL_OP/NATIVE_OP -> calls, time
+
+static uint32 irq_count[8];						// Interrupts by level
+
+#ifdef PROFILER_THREAD
+static pthread_t sampler_thread;
+static volatile bool sampler_quit = false;
+static bool sampler_thread_active = false;
+#endif
+
+static void reset_data(void);
+static void dump_data(void);
+
+
+/*
+ *  Clock
+ */
+
+uint64 ProfilerClock(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ *  Sampler thread
+ */
+
+#ifdef PROFILER_THREAD
+static void *sampler_func(void *arg)
+{
+	while (!sampler_quit) {
+		struct timespec ts;
+		if (ProfilerActive || toggle_pending) {
+			ts.tv_sec = 0;
+			ts.tv_nsec = 1000000000 / sample_hz;
+			ProfilerRequestSample();
+		} else {
+			ts.tv_sec = 0;
+			ts.tv_nsec = 100000000;
+		}
+		while (nanosleep(&ts, &ts) < 0 && errno == EINTR && !sampler_quit) ;
+	}
+	return NULL;
+}
+#endif
+
+
+/*
+ *  SIGPROF handler, toggles profiling
+ */
+
+#ifdef SIGPROF
+static void sigprof_handler(int sig)
+{
+	ProfilerToggle();
+}
+#endif
+
+void ProfilerToggle(void)
+{
+	toggle_pending = 1;
+}
+
+
+/*
+ *  Initialization
+ */
+
+void ProfilerInit(void)
+{
+	output_prefix = PrefsFindString("profile");
+	if (output_prefix == NULL)
+		return;
+	sample_hz = PrefsFindInt32("profilehz");
+	if (sample_hz <= 0 || sample_hz > 100000)
+		sample_hz = 1000;
+
+#ifdef PROFILER_THREAD
+	sampler_quit = false;
+	sampler_thread_active = (pthread_create(&sampler_thread, NULL, sampler_func, NULL) == 0);
+	if (!sampler_thread_active) {
+		printf("WARNING: Cannot start profiler thread, profiling disabled\n");
+		output_prefix = NULL;
+		return;
+	}
+#else
+	printf("WARNING: Profiling is not supported on this platform\n");
+	output_prefix = NULL;
+	return;
+#endif
+
+#ifdef SIGPROF
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = sigprof_handler;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGPROF, &sa, NULL);
+#endif
+
+	// Start profiling right away, SIGPROF stops and restarts it
+	reset_data();
+	ProfilerActive = true;
+	D(bug("Profiler started, %d Hz, output to %s.*\n", sample_hz, output_prefix));
+}
+
+
+/*
+ *  Deinitialization
+ */
+
+void ProfilerExit(void)
+{
+#ifdef PROFILER_THREAD
+	if (sampler_thread_active) {
+		sampler_quit = true;
+		pthread_join(sampler_thread, NULL);
+		sampler_thread_active = false;
+	}
+#endif
+#ifdef SIGPROF
+	if (output_prefix)
+		signal(SIGPROF, SIG_IGN);
+#endif
+	if (ProfilerActive) {
+		ProfilerActive = false;
+		dump_data();
+	}
+}
+
+
+/*
+ *  Take a sample (called by the CPU thread)
+ */
+
+void ProfilerService(uint32 pc, const uint32 *callers, int num_callers)
+{
+	if (toggle_pending) {
+		toggle_pending = 0;
+		if (output_prefix == NULL)
+			return;
+		if (ProfilerActive) {
+			ProfilerActive = false;
+			dump_data();
+		} else {
+			reset_data();
+			ProfilerActive = true;
+			printf("Profiler started\n");
+		}
+		return;
+	}
+	if (!ProfilerActive)
+		return;
+
+	num_samples++;
+	pc_hist[pc]++;
+
+	call_stack stack;
+	stack.reserve(num_callers + 1);
+	for (int i = num_callers - 1; i >= 0; i--)
+		stack.push_back(callers[i]);
+	stack.push_back(pc);
+	stack_hist[stack]++;
+}
+
+
+/*
+ *  Event counters
+ */
+
+void ProfilerTrap(uint16 trap)
+{
+	trap_count[trap & 0xfff]++;
+}
+
+void ProfilerInterrupt(int level)
+{
+	irq_count[level & 7]++;
+}
+
+void ProfilerHandler(uint32 id, uint64 start)
+{
+	handler_stat &s = handler_hist[id];
+	s.calls++;
+	s.nsec += ProfilerClock() - start;
+}
+
+
+/*
+ *  Reset collected data
+ */
+
+static void reset_data(void)
+{
+	pc_hist.clear();
+	stack_hist.clear();
+	handler_hist.clear();
+	memset(trap_count, 0, sizeof(trap_count));
+	memset(irq_count, 0, sizeof(irq_count));
+	num_samples = 0;
+	start_time = ProfilerClock();
+}
+
+
+/*
+ *  Write flat profile and folded stacks
+ */
+
+template <class T>
+static bool by_count_desc(const std::pair<T, uint32> &a, const std::pair<T, uint32> &b)
+{
+	return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
+
+static void dump_data(void)
+{
+	double seconds = (ProfilerClock() - start_time) * 1e-9;
+	char path[1024];
+
+	// Flat profile
+	snprintf(path, sizeof(path), "%s.flat.txt", output_prefix);
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		printf("WARNING: Cannot write profile to %s (%s)\n", path, strerror(errno));
+		return;
+	}
+	fprintf(f, "%u samples in %.3f s (%d Hz requested)\n", num_samples, seconds, sample_hz);
+
+	std::vector<std::pair<uint32, uint32> > pcs(pc_hist.begin(), pc_hist.end());
+	std::sort(pcs.begin(), pcs.end(), by_count_desc<uint32>);
+	fprintf(f, "\nGuest PCs:\n%8s %8s  %s\n", "%", "samples", "pc");
+	for (size_t i = 0; i < pcs.size() && i < 200; i++)
+		fprintf(f, "%7.2f%% %8u  %08x\n", 100.0 * pcs[i].second / num_samples, pcs[i].second, pcs[i].first);
+
+	std::vector<std::pair<uint32, uint32> > traps;
+	for (uint32 i = 0; i < 0x1000; i++)
+		if (trap_count[i])
+			traps.push_back(std::make_pair(0xa000 | i, trap_count[i]));
+	if (!traps.empty()) {
+		std::sort(traps.begin(), traps.end(), by_count_desc<uint32>);
+		fprintf(f, "\nA-line traps:\n%10s %10s  %s\n", "calls", "calls/s", "trap");
+		for (size_t i = 0; i < traps.size(); i++)
+			fprintf(f, "%10u %10.0f  %04X\n", traps[i].second, traps[i].second / seconds, traps[i].first);
+	}
+
+	if (!handler_hist.empty()) {
+		fprintf(f, "\nHost handlers:\n%10s %10s %10s  %s\n", "calls", "total ms", "avg us", "handler");
+		for (std::map<uint32, handler_stat>::const_iterator it = handler_hist.begin(); it != handler_hist.end(); ++it) {
+			const handler_stat &s = it->second;
+			if (it->first == (PROFILER_HOST | PROFILER_HOST_EVENTS)) {
+				fprintf(f, "%10u %10.3f %10.3f  HOST events\n", s.calls, s.nsec * 1e-6, s.nsec * 1e-3 / s.calls);
+				continue;
+			}
+			const char *kind = (it->first & PROFILER_NATIVE_OP) ? "NATIVE_OP" : "EMUL_OP";
+			fprintf(f, "%10u %10.3f %10.3f  %s %u\n", s.calls, s.nsec * 1e-6, s.nsec * 1e-3 / s.calls, kind, it->first & 0xffff);
+		}
+	}
+
+	fprintf(f, "\nInterrupts:\n%10s %10s  %s\n", "count", "per s", "level");
+	for (int i = 0; i < 8; i++)
+		if (irq_count[i])
+			fprintf(f, "%10u %10.0f  %d\n", irq_count[i], irq_count[i] / seconds, i);
+	fclose(f);
+
+	// Folded stacks
+	snprintf(path, sizeof(path), "%s.folded", output_prefix);
+	f = fopen(path, "w");
+	if (f == NULL) {
+		printf("WARNING: Cannot write profile to %s (%s)\n", path, strerror(errno));
+		return;
+	}
+	for (std::map<call_stack, uint32>::const_iterator it = stack_hist.begin(); it != stack_hist.end(); ++it) {
+		const call_stack &s = it->first;
+		for (size_t i = 0; i < s.size(); i++)
+			fprintf(f, "%s0x%08x", i ? ";" : "", s[i]);
+		fprintf(f, " %u\n", it->second);
+	}
+	fclose(f);
+
+	printf("Profiler stopped, %u samples written to %s.flat.txt and %s.folded\n", num_samples, output_prefix, output_prefix);
+}
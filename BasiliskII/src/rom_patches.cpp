@@ -19,6 +19,8 @@
  */
 
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include "sysdeps.h"
 #include "cpu_emulation.h"
@@ -47,6 +49,9 @@
 uint32 UniversalInfo;		// ROM offset of UniversalInfo
 uint32 PutScrapPatch = 0;	// Mac address of PutScrap() patch
 uint32 GetScrapPatch = 0;	// Mac address of GetScrap() patch
+uint32 CmpStringROM = 0;	// Mac address of original CmpString() routine
+uint32 SCSIDispatchPatch = 0;	// Mac address of SCSIDispatch() replacement
+uint32 ATrapOSReturn = 0;	// Mac address of OS trap return code for native A-line dispatch (0 = disabled)
 uint32 ROMBreakpoint = 0;	// ROM offset of breakpoint (0 = disabled, 0x2310 = CritError)
 bool PrintROMInfo = false;	// Flag: print ROM information in PatchROM()
 bool PatchHWBases = true;	// Flag: patch hardware base addresses
@@ -55,6 +60,10 @@ static uint32 sony_offset;		// ROM offset of .Sony driver
 static uint32 serd_offset;		// ROM offset of SERD resource (serial drivers)
 static uint32 microseconds_offset;	// ROM offset of Microseconds() replacement routine
 static uint32 debugutil_offset;		// ROM offset of DebugUtil() replacement routine
+static uint32 block_move_offset;	// ROM offsets of native memory trap routines (0 = not installed)
+static uint32 munger_offset;
+static uint32 cmp_string_offset;
+static uint32 atrap_os_return_offset;	// ROM offset of OS trap return code (0 = no native A-line dispatch)
 
 // Prototypes
 uint16 ROMVersion;
@@ -67,21 +76,160 @@ uint16 ROMVersion;
 #define LoWord(X) ((X) & 0xffff)
 
 
+/*
+ *  ROM patch offset cache
+ *
+ *  Results of find_rom_data() are remembered in a small table that is
+ *  saved to the file given by the "romcache" prefs item and reloaded on
+ *  the next launch, so we don't have to scan the ROM again. The table is
+ *  only used if ROM checksum, ROM size and the CPU/FPU configuration
+ *  (which influence the patches applied before each search) match, and
+ *  cached offsets are only used if the data is still found there.
+ */
+
+const uint32 ROM_CACHE_MAGIC = FOURCC('B','2','r','c');
+const uint32 ROM_CACHE_VERSION = 1;
+const int ROM_CACHE_MAX = 256;
+
+struct rom_cache_entry {
+	uint32 start, end;		// Search range
+	uint32 hash;			// Hash of search string
+	uint32 ofs;				// Found ROM offset (or 0)
+};
+
+static rom_cache_entry rom_cache[ROM_CACHE_MAX];
+static int rom_cache_num = 0;
+static bool rom_cache_dirty = false;
+
+static uint32 rom_cache_config(void)
+{
+	return (CPUType & 0xff) | (FPUType & 0xff) << 8 | (TwentyFourBitAddressing ? 0x10000 : 0) | (PatchHWBases ? 0x20000 : 0);
+}
+
+static uint32 rom_cache_hash(const uint8 *data, uint32 data_len)
+{
+	uint32 h = 0x811c9dc5;	// FNV-1a
+	for (uint32 i=0; i<data_len; i++)
+		h = (h ^ data[i]) * 0x01000193;
+	return h ^ data_len;
+}
+
+static void load_rom_cache(void)
+{
+	rom_cache_num = 0;
+	rom_cache_dirty = false;
+	const char *path = PrefsFindString("romcache");
+	if (path == NULL)
+		return;
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+		return;
+	uint32 header[6];
+	if (fread(header, sizeof(header), 1, f) == 1
+	 && ntohl(header[0]) == ROM_CACHE_MAGIC && ntohl(header[1]) == ROM_CACHE_VERSION
+	 && ntohl(header[2]) == ReadMacInt32(ROMBaseMac) && ntohl(header[3]) == ROMSize
+	 && ntohl(header[4]) == rom_cache_config() && ntohl(header[5]) <= ROM_CACHE_MAX) {
+		int num = ntohl(header[5]);
+		for (int i=0; i<num; i++) {
+			uint32 e[4];
+			if (fread(e, sizeof(e), 1, f) != 1)
+				break;
+			rom_cache_entry &c = rom_cache[rom_cache_num];
+			c.start = ntohl(e[0]);
+			c.end = ntohl(e[1]);
+			c.hash = ntohl(e[2]);
+			c.ofs = ntohl(e[3]);
+			if (c.ofs == 0 || (c.ofs >= c.start && c.ofs < c.end && c.ofs < ROMSize))
+				rom_cache_num++;
+			else
+				rom_cache_dirty = true;		// Drop entries pointing outside their search range
+		}
+		D(bug("%d ROM cache entries loaded from %s\n", rom_cache_num, path));
+	}
+	fclose(f);
+}
+
+static void save_rom_cache(void)
+{
+	const char *path = PrefsFindString("romcache");
+	if (path == NULL || !rom_cache_dirty)
+		return;
+
+	// Write to temporary file and rename it, so concurrent launches never see a partial file
+	char tmp_path[1024];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+	FILE *f = fopen(tmp_path, "wb");
+	if (f == NULL)
+		return;
+	uint32 header[6] = {
+		htonl(ROM_CACHE_MAGIC), htonl(ROM_CACHE_VERSION),
+		htonl(ReadMacInt32(ROMBaseMac)), htonl(ROMSize),
+		htonl(rom_cache_config()), htonl(rom_cache_num)
+	};
+	bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+	for (int i=0; ok && i<rom_cache_num; i++) {
+		const rom_cache_entry &c = rom_cache[i];
+		uint32 e[4] = {htonl(c.start), htonl(c.end), htonl(c.hash), htonl(c.ofs)};
+		ok = fwrite(e, sizeof(e), 1, f) == 1;
+	}
+	if (fclose(f) == 0 && ok && rename(tmp_path, path) == 0)
+		rom_cache_dirty = false;
+	else
+		unlink(tmp_path);
+}
+
+
 /*
  *  Search ROM for byte string, return ROM offset (or 0)
  */
 
-static uint32 find_rom_data(uint32 start, uint32 end, const uint8 *data, uint32 data_len)
+static uint32 scan_rom_data(uint32 start, uint32 end, const uint8 *data, uint32 data_len)
 {
-	uint32 ofs = start;
-	while (ofs < end) {
-		if (!memcmp((void *)(ROMBaseHost + ofs), data, data_len))
-			return ofs;
-		ofs++;
+	// Let memchr() skip ahead to candidate positions, it is vectorized by the C library
+	if (end > ROMSize - data_len + 1)
+		end = ROMSize - data_len + 1;
+	uint8 *p = ROMBaseHost + start, *last = ROMBaseHost + end;
+	while (p < last) {
+		p = (uint8 *)memchr(p, data[0], last - p);
+		if (p == NULL)
+			break;
+		if (!memcmp(p, data, data_len))
+			return p - ROMBaseHost;
+		p++;
 	}
 	return 0;
 }
 
+static uint32 find_rom_data(uint32 start, uint32 end, const uint8 *data, uint32 data_len)
+{
+	uint32 hash = rom_cache_hash(data, data_len);
+	int i;
+	for (i=0; i<rom_cache_num; i++) {
+		const rom_cache_entry &c = rom_cache[i];
+		if (c.start == start && c.end == end && c.hash == hash) {
+			// Only trust offsets inside the search range that still hold the data
+			// (the file may be damaged), "not found" is always checked by searching again
+			if (c.ofs != 0 && c.ofs >= start && c.ofs < end && data_len <= ROMSize && c.ofs <= ROMSize - data_len
+			 && !memcmp(ROMBaseHost + c.ofs, data, data_len))
+				return c.ofs;
+			break;	// Stale entry, search again and replace it
+		}
+	}
+
+	uint32 ofs = scan_rom_data(start, end, data, data_len);
+	if (i < ROM_CACHE_MAX && (i == rom_cache_num || rom_cache[i].ofs != ofs)) {
+		rom_cache_entry &c = rom_cache[i];
+		c.start = start;
+		c.end = end;
+		c.hash = hash;
+		c.ofs = ofs;
+		if (i == rom_cache_num)
+			rom_cache_num++;
+		rom_cache_dirty = true;
+	}
+	return ofs;
+}
+
 
 /*
  *  Search ROM resource by type/ID, return ROM offset of resource data
@@ -820,6 +968,28 @@ void PatchAfterStartup(void)
 	// Install external file system
 	InstallExtFS();
 #endif
+
+	// Install native memory traps over the ones patched in by the System
+	M68kRegisters r;
+	if (block_move_offset) {
+		r.a[0] = ROMBaseMac + block_move_offset;
+		r.d[0] = 0xa02e;
+		Execute68kTrap(0xa247, &r);		// SetOSTrapAddress()
+	}
+	if (cmp_string_offset) {
+		r.a[0] = ROMBaseMac + cmp_string_offset;
+		r.d[0] = 0xa03c;
+		Execute68kTrap(0xa247, &r);		// SetOSTrapAddress()
+	}
+	if (munger_offset) {
+		r.a[0] = ROMBaseMac + munger_offset;
+		r.d[0] = 0xa9e0;
+		Execute68kTrap(0xa647, &r);		// SetToolTrapAddress()
+	}
+
+	// Dispatch A-line traps natively from now on
+	if (atrap_os_return_offset)
+		ATrapOSReturn = ROMBaseMac + atrap_os_return_offset;
 }
 
 
@@ -957,6 +1127,7 @@ static bool patch_rom_classic(void)
 
 	// Replace SCSIDispatch()
 	wp = (uint16 *)(ROMBaseHost + 0x1a206);
+	SCSIDispatchPatch = ROMBaseMac + 0x1a206;
 	*wp++ = htons(M68K_EMUL_OP_SCSI_DISPATCH);
 	*wp++ = htons(0x2e49);		// move.l	a1,a7
 	*wp = htons(M68K_JMP_A0);
@@ -1595,8 +1766,48 @@ static bool patch_rom_32(void)
 	*wp++ = htons(M68K_EMUL_OP_DEBUGUTIL);
 	*wp = htons(M68K_RTS);
 
+	// The following stubs go to the unused space after the vCheckLoad() patch
+	// in the .Sony driver (the PrimeTime() routine is too short for them)
+	wp = (uint16 *)(ROMBaseHost + sony_offset + 0x380);
+
+	// Return path of natively dispatched OS traps (enabled in PatchAfterStartup()),
+	// does what the ROM's trap dispatcher does after the routine returns
+	atrap_os_return_offset = 0;
+	if (PrefsFindBool("nativetrapdispatch")) {
+		atrap_os_return_offset = (uint8 *)wp - ROMBaseHost;
+		*wp++ = htons(0x4cdf);		// movem.l	(sp)+,d1-d2/a0-a1
+		*wp++ = htons(0x0306);
+		*wp++ = htons(0x4a40);		// tst.w	d0
+		*wp++ = htons(M68K_RTS);
+		*wp++ = htons(0x4cdf);		// movem.l	(sp)+,d1-d2/a1	(trap word bit 8 set, A0 not saved)
+		*wp++ = htons(0x0206);
+		*wp++ = htons(0x4a40);		// tst.w	d0
+		*wp++ = htons(M68K_RTS);
+	}
+
+	// Native BlockMove(), Munger() and CmpString() (installed in PatchAfterStartup())
+	block_move_offset = munger_offset = cmp_string_offset = 0;
+	if (!PrefsFindBool("nomemtraps")) {
+		cmp_string_offset = (uint8 *)wp - ROMBaseHost;
+		*wp++ = htons(M68K_EMUL_OP_CMP_STRING);	// falls back to the ROM routine for non-ASCII strings
+		*wp = htons(M68K_RTS);
+		CmpStringROM = ROMBaseMac + find_rom_trap(0xa03c);
+
+		block_move_offset = find_rom_trap(0xa02e);
+		wp = (uint16 *)(ROMBaseHost + block_move_offset);
+		*wp++ = htons(M68K_EMUL_OP_BLOCK_MOVE_NATIVE);
+		*wp = htons(M68K_RTS);
+
+		munger_offset = find_rom_trap(0xa9e0);
+		wp = (uint16 *)(ROMBaseHost + munger_offset);
+		*wp++ = htons(M68K_EMUL_OP_MUNGER);
+		*wp++ = htons(M68K_RTD);
+		*wp = htons(24);
+	}
+
 	// Replace SCSIDispatch()
 	wp = (uint16 *)(ROMBaseHost + find_rom_trap(0xa815));
+	SCSIDispatchPatch = ROMBaseMac + find_rom_trap(0xa815);
 	*wp++ = htons(M68K_EMUL_OP_SCSI_DISPATCH);
 	*wp++ = htons(0x2e49);		// move.l	a1,a7
 	*wp = htons(M68K_JMP_A0);
@@ -1666,6 +1877,7 @@ bool PatchROM(void)
 		print_rom_info();
 
 	// Patch ROM depending on version
+	load_rom_cache();
 	switch (ROMVersion) {
 		case ROM_VERSION_CLASSIC:
 			if (!patch_rom_classic())
@@ -1678,6 +1890,7 @@ bool PatchROM(void)
 		default:
 			return false;
 	}
+	save_rom_cache();
 
 	// Install breakpoint
 	if (ROMBreakpoint) {
@@ -44,10 +44,18 @@
 
 static uint32 find_rsrc_data(const uint8 *rsrc, uint32 max, const uint8 *search, uint32 search_len, uint32 ofs = 0)
 {
-	while (ofs < max - search_len) {
-		if (!memcmp(rsrc + ofs, search, search_len))
-			return ofs;
-		ofs++;
+	if (max <= search_len)
+		return 0;
+
+	// Let memchr() skip ahead to candidate positions, it is vectorized by the C library
+	const uint8 *p = rsrc + ofs, *last = rsrc + max - search_len;
+	while (p < last) {
+		p = (const uint8 *)memchr(p, search[0], last - p);
+		if (p == NULL)
+			break;
+		if (!memcmp(p, search, search_len))
+			return p - rsrc;
+		p++;
 	}
 	return 0;
 }
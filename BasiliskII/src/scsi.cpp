@@ -36,6 +36,14 @@
 #define DEBUG 0
 #include "debug.h"
 
+// Commands run on a worker thread while the Mac polls SCSIComplete()
+#ifdef HAVE_PTHREADS
+#define USE_SCSI_THREAD 1
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
 
 // Error codes
 enum {
@@ -67,7 +75,8 @@ enum {
 	PH_FREE,		// Bus free
 	PH_ARBITRATED,	// Bus arbitrated (after SCSIGet())
 	PH_SELECTED,	// Target selected (after SCSISelect())
-	PH_TRANSFER		// Command sent (after SCSICmd())
+	PH_TRANSFER,	// Command sent (after SCSICmd())
+	PH_COMPLETING	// Command running on the worker thread (after first SCSIComplete())
 };
 
 // Global variables
@@ -82,6 +91,18 @@ static uint8 *sg_ptr[SG_TABLE_SIZE];	// Scatter/gather table data pointer (host
 static uint32 sg_len[SG_TABLE_SIZE];	// Scatter/gather table data length
 static uint32 sg_total_length;			// Total data length
 
+#ifdef USE_SCSI_THREAD
+static pthread_t cmd_thread;			// Worker thread executing the current command
+static pthread_mutex_t cmd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cmd_cond = PTHREAD_COND_INITIALIZER;
+static bool cmd_done;					// Flag: command finished (protected by cmd_lock)
+static uint32 cmd_timeout;				// Timeout passed to SCSIComplete()
+static uint16 cmd_stat;					// SCSI status of finished command
+static bool cmd_success;				// Result of scsi_send_cmd()
+
+const long CMD_POLL_NSEC = 2000000;		// Time SCSIComplete() waits before letting the Mac run again
+#endif
+
 
 /*
  *  Execute TIB, constructing S/G table
@@ -163,6 +184,52 @@ static int16 exec_tib(uint32 tib)
 }
 
 
+/*
+ *  Worker thread running one command, the S/G table is not touched by
+ *  the emulator until the command is finished
+ */
+
+#ifdef USE_SCSI_THREAD
+static void *cmd_func(void *arg)
+{
+	uint16 scsi_stat = 0;
+	bool success = scsi_send_cmd(sg_total_length, reading, sg_index, sg_ptr, sg_len, &scsi_stat, cmd_timeout);
+
+	pthread_mutex_lock(&cmd_lock);
+	cmd_stat = scsi_stat;
+	cmd_success = success;
+	cmd_done = true;
+	pthread_cond_signal(&cmd_cond);
+	pthread_mutex_unlock(&cmd_lock);
+	return NULL;
+}
+
+// Wait for the worker thread, returns false if the command is still running after nsec nanoseconds (0 = wait forever)
+static bool wait_cmd(long nsec)
+{
+	pthread_mutex_lock(&cmd_lock);
+	if (nsec) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += nsec;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (!cmd_done && pthread_cond_timedwait(&cmd_cond, &cmd_lock, &deadline) != ETIMEDOUT) ;
+	} else {
+		while (!cmd_done)
+			pthread_cond_wait(&cmd_cond, &cmd_lock);
+	}
+	bool done = cmd_done;
+	pthread_mutex_unlock(&cmd_lock);
+	if (done)
+		pthread_join(cmd_thread, NULL);
+	return done;
+}
+#endif
+
+
 /*
  *  Reset SCSI bus
  */
@@ -171,6 +238,12 @@ int16 SCSIReset(void)
 {
 	D(bug("SCSIReset\n"));
 
+#ifdef USE_SCSI_THREAD
+	// A command can't be aborted, let it finish
+	if (phase == PH_COMPLETING)
+		wait_cmd(0);
+#endif
+
 	phase = PH_FREE;
 	fake_status = 0x0000;	// Bus free
 	sg_index = 0;
@@ -305,18 +378,40 @@ int16 SCSIWrite(uint32 tib)
 
 /*
  *  Wait for command completion (we're actually doing everything in here...)
+ *  With threads, the command is started on the first call and
+ *  SCSI_COMPLETE_PENDING is returned until it has finished. The EMUL_OP
+ *  then re-enters SCSIDispatch(), so the caller stays in SCSIComplete() and
+ *  the Mac only gets to run interrupt handlers between the polls
  */
 
 int16 SCSIComplete(uint32 timeout, uint32 message, uint32 stat)
 {
 	D(bug("SCSIComplete wait %d, msg %08lx, stat %08lx\n", timeout, message, stat));
 	WriteMacInt16(message, 0);
-	if (phase != PH_TRANSFER)
-		return scPhaseErr;
 
-	// Send command, process S/G table
 	uint16 scsi_stat = 0;
-	bool success = scsi_send_cmd(sg_total_length, reading, sg_index, sg_ptr, sg_len, &scsi_stat, timeout);
+	bool success;
+#ifdef USE_SCSI_THREAD
+	if (phase == PH_TRANSFER) {
+		cmd_done = false;
+		cmd_timeout = timeout;
+		if (pthread_create(&cmd_thread, NULL, cmd_func, NULL) == 0)
+			phase = PH_COMPLETING;
+	}
+	if (phase == PH_COMPLETING) {
+		if (!wait_cmd(CMD_POLL_NSEC))
+			return SCSI_COMPLETE_PENDING;
+		scsi_stat = cmd_stat;
+		success = cmd_success;
+	} else
+#endif
+	{
+		if (phase != PH_TRANSFER)
+			return scPhaseErr;
+
+		// Send command, process S/G table
+		success = scsi_send_cmd(sg_total_length, reading, sg_index, sg_ptr, sg_len, &scsi_stat, timeout);
+	}
 	WriteMacInt16(stat, scsi_stat);
 
 	// Complete command
@@ -38,9 +38,78 @@
  * This routine is very heavily used in the network
  * code and should be modified for each CPU to be as fast as possible.
  * 
+ * Compilers vectorize the 16-bit loop below by themselves, and in
+ * cksum_bench that beats hand-written SSE2 code. Only AVX2 (picked at
+ * run-time) is faster, for longer data. It relies on the one's complement
+ * sum being independent of byte order and of the order in which the
+ * 16-bit words are added.
+ *
  * XXX Since we will never span more than 1 mbuf, we can optimise this
  */
 
+#if !defined(WORDS_BIGENDIAN) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CKSUM_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if CKSUM_AVX2
+/* Shorter data is faster with the 16-bit loop */
+#define CKSUM_AVX2_MIN 768
+
+/*
+ * Two 16-bit words are added to each 32-bit lane per iteration,
+ * so the lanes are widened every CKSUM_BLOCK iterations
+ */
+#define CKSUM_BLOCK 16384
+
+static int cksum_use_avx2 = -1;		/* -1 = not checked yet */
+
+static __attribute__((target("avx2"))) int cksum_avx2(const u_int8_t *p, int len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc64 = zero;
+	u_int64_t s[4], sum;
+	u_int16_t w;
+
+	while (len >= 32) {
+		__m256i acc32 = zero;
+		int n = len / 32;
+		if (n > CKSUM_BLOCK)
+			n = CKSUM_BLOCK;
+		len -= n * 32;
+		while (n--) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)p);
+			acc32 = _mm256_add_epi32(acc32, _mm256_unpacklo_epi16(v, zero));
+			acc32 = _mm256_add_epi32(acc32, _mm256_unpackhi_epi16(v, zero));
+			p += 32;
+		}
+		acc64 = _mm256_add_epi64(acc64, _mm256_unpacklo_epi32(acc32, zero));
+		acc64 = _mm256_add_epi64(acc64, _mm256_unpackhi_epi32(acc32, zero));
+	}
+	_mm256_storeu_si256((__m256i *)s, acc64);
+	sum = s[0] + s[1] + s[2] + s[3];
+	while (len >= 2) {
+		memcpy(&w, p, 2);
+		sum += w;
+		p += 2;
+		len -= 2;
+	}
+	if (len) {
+		/* Odd byte, the standard pads it with a zero byte */
+		u_int8_t c[2] = {*p, 0};
+		memcpy(&w, c, 2);
+		sum += w;
+	}
+
+	/* Fold to 16 bits with end-around carry */
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 32) + (sum & 0xffffffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum = (sum >> 16) + (sum & 0xffff);
+	return (~sum & 0xffff);
+}
+#endif
+
 #define ADDCARRY(x)  (x > 65535 ? x -= 65535 : x)
 #define REDUCE {l_util.l = sum; sum = l_util.s[0] + l_util.s[1]; ADDCARRY(sum);}
 
@@ -60,6 +129,22 @@ int cksum(struct mbuf *m, int len)
 		u_int32_t l;
 	} l_util;
 	
+#if CKSUM_AVX2
+	if (cksum_use_avx2 < 0) {
+		__builtin_cpu_init();
+		cksum_use_avx2 = __builtin_cpu_supports("avx2");
+	}
+	if (cksum_use_avx2 && len >= CKSUM_AVX2_MIN && m->m_len >= CKSUM_AVX2_MIN) {
+#ifdef DEBUG
+		if (len > m->m_len) {
+			DEBUG_ERROR((dfd, "cksum: out of data\n"));
+			DEBUG_ERROR((dfd, " len = %d\n", len - m->m_len));
+		}
+#endif
+		return cksum_avx2(mtod(m, const u_int8_t *), len < m->m_len ? len : m->m_len);
+	}
+#endif
+
 	if (m->m_len == 0)
 	   goto cont;
 	w = mtod(m, u_int16_t *);
@@ -13,6 +13,11 @@
  * could hold, an external malloced buffer is pointed to
  * by m_ext (and the data pointers) and M_EXT is set in
  * the flags
+ *
+ * To keep malloc() off the data path, mbufs are carved out of
+ * slabs of MBUF_SLAB_COUNT which are never given back, and M_EXT
+ * buffers come from pools of power-of-two sized clusters.  Both are
+ * preallocated by m_init() and only grow when a pool runs dry.
  */
 
 #include <stdlib.h>
@@ -22,16 +27,38 @@ struct	mbuf *mbutl;
 char	*mclrefcnt;
 int mbuf_alloced = 0;
 struct mbuf m_freelist, m_usedlist;
-int mbuf_thresh = 30;
 int mbuf_max = 0;
 int msize;
 
+#define MBUF_SLAB_COUNT	64	/* mbufs allocated at once */
+
+#define MCL_MINSIZE	4096	/* Smallest cluster */
+#define MCL_NCLASSES	5	/* Cluster sizes 4K..64K */
+
+static int mslab_stride;	/* msize rounded up to keep mbufs aligned */
+static char *mcl_free[MCL_NCLASSES];	/* Free clusters, linked through their first word */
+static const int mcl_prealloc[MCL_NCLASSES] = { 8, 4, 2, 1, 1 };
+
+static int m_slab_grow _P((void));
+static char *mcl_get _P((int *));
+static void mcl_put _P((char *, int));
+
 void
 m_init()
 {
+	int i, j;
+
 	m_freelist.m_next = m_freelist.m_prev = &m_freelist;
 	m_usedlist.m_next = m_usedlist.m_prev = &m_usedlist;
 	msize_init();
+
+	m_slab_grow();
+	for (i = 0; i < MCL_NCLASSES; i++)
+		for (j = 0; j < mcl_prealloc[i]; j++) {
+			char *p = (char *)malloc(MCL_MINSIZE << i);
+			if (p)
+				mcl_put(p, MCL_MINSIZE << i);
+		}
 }
 
 void
@@ -43,40 +70,105 @@ msize_init()
 	 */
 	msize = (if_mtu>if_mru?if_mtu:if_mru) + 
 			if_maxlinkhdr + sizeof(struct m_hdr ) + 6;
+	mslab_stride = (msize + 15) & ~15;
+}
+
+/*
+ * Add a slab of mbufs to the free list
+ */
+static int
+m_slab_grow()
+{
+	char *slab;
+	int i;
+
+	DEBUG_CALL("m_slab_grow");
+
+	slab = (char *)malloc(mslab_stride * MBUF_SLAB_COUNT);
+	if (slab == NULL)
+		return 0;
+	for (i = 0; i < MBUF_SLAB_COUNT; i++) {
+		struct mbuf *m = (struct mbuf *)(slab + i * mslab_stride);
+		m->m_flags = M_FREELIST;
+		insque(m,&m_freelist);
+	}
+	mbuf_alloced += MBUF_SLAB_COUNT;
+	if (mbuf_alloced > mbuf_max)
+		mbuf_max = mbuf_alloced;
+	return 1;
+}
+
+/*
+ * Size class of a cluster, MCL_NCLASSES if it's too large for the pools
+ */
+static int
+mcl_class(size)
+	int size;
+{
+	int c = 0;
+
+	while (c < MCL_NCLASSES && (MCL_MINSIZE << c) < size)
+		c++;
+	return c;
+}
+
+/*
+ * Get a cluster of at least *size bytes, *size is set to its actual size
+ */
+static char *
+mcl_get(size)
+	int *size;
+{
+	int c = mcl_class(*size);
+	char *p;
+
+	if (c == MCL_NCLASSES)
+		return (char *)malloc(*size);
+	*size = MCL_MINSIZE << c;
+	p = mcl_free[c];
+	if (p == NULL)
+		return (char *)malloc(*size);
+	mcl_free[c] = *(char **)p;
+	return p;
+}
+
+/*
+ * Return a cluster of the given size to its pool
+ */
+static void
+mcl_put(p, size)
+	char *p;
+	int size;
+{
+	int c = mcl_class(size);
+
+	if (c == MCL_NCLASSES || (MCL_MINSIZE << c) != size) {
+		free(p);
+		return;
+	}
+	*(char **)p = mcl_free[c];
+	mcl_free[c] = p;
 }
 
 /*
  * Get an mbuf from the free list, if there are none
- * malloc one
- * 
- * Because fragmentation can occur if we alloc new mbufs and
- * free old mbufs, we mark all mbufs above mbuf_thresh as M_DOFREE,
- * which tells m_free to actually free() it
+ * allocate another slab
  */
 struct mbuf *
 m_get()
 {
-	register struct mbuf *m;
-	int flags = 0;
+	register struct mbuf *m = NULL;
 	
 	DEBUG_CALL("m_get");
 	
-	if (m_freelist.m_next == &m_freelist) {
-		m = (struct mbuf *)malloc(msize);
-		if (m == NULL) goto end_error;
-		mbuf_alloced++;
-		if (mbuf_alloced > mbuf_thresh)
-			flags = M_DOFREE;
-		if (mbuf_alloced > mbuf_max)
-			mbuf_max = mbuf_alloced;
-	} else {
-		m = m_freelist.m_next;
-		remque(m);
-	}
+	if (m_freelist.m_next == &m_freelist && !m_slab_grow())
+		goto end_error;
+	m = m_freelist.m_next;
+	remque(m);
 	
 	/* Insert it in the used list */
 	insque(m,&m_usedlist);
-	m->m_flags = (flags | M_USEDLIST);
+	m->m_flags = M_USEDLIST;
 	
 	/* Initialise it */
 	m->m_size = msize - sizeof(struct m_hdr);
@@ -102,17 +194,14 @@ m_free(m)
 	if (m->m_flags & M_USEDLIST)
 	   remque(m);
 	
-	/* If it's M_EXT, free() it */
+	/* If it's M_EXT, return the cluster */
 	if (m->m_flags & M_EXT)
-	   free(m->m_ext);
+	   mcl_put(m->m_ext, m->m_size);
 
 	/*
-	 * Either free() it or put it on the free list
+	 * Put it back on the free list
 	 */
-	if (m->m_flags & M_DOFREE) {
-		free(m);
-		mbuf_alloced--;
-	} else if ((m->m_flags & M_FREELIST) == 0) {
+	if ((m->m_flags & M_FREELIST) == 0) {
 		insque(m,&m_freelist);
 		m->m_flags = M_FREELIST; /* Clobber other flags */
 	}
@@ -153,16 +242,20 @@ m_inc(m, size)
         if(m->m_size>size) return;
 
         if (m->m_flags & M_EXT) {
+	  char *dat;
          datasize = m->m_data - m->m_ext;
-	  m->m_ext = (char *)realloc(m->m_ext,size);
-/*		if (m->m_ext == NULL)
+	  dat = mcl_get(&size);
+/*		if (dat == NULL)
  *			return (struct mbuf *)NULL;
  */		
+	  memcpy(dat, m->m_ext, m->m_size);
+	  mcl_put(m->m_ext, m->m_size);
+	  m->m_ext = dat;
          m->m_data = m->m_ext + datasize;
         } else {
 	  char *dat;
 	  datasize = m->m_data - m->m_dat;
-	  dat = (char *)malloc(size);
+	  dat = mcl_get(&size);
 /*		if (dat == NULL)
  *			return (struct mbuf *)NULL;
  */
@@ -0,0 +1,415 @@
+/*
+ *  snapshot.cpp - Machine state snapshot and resume
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  A snapshot file consists of a header followed by tagged sections:
+ *
+ *    CPU    680x0 registers
+ *    XPRM   XPRAM contents
+ *    ROM    patched ROM image
+ *    TIME   Time Manager tasks
+ *    SONY, DISK, CDRM   driver state
+ *    EXTF   ExtFS CNID table
+ *    VIDO   display state and frame buffer
+ *    RAM    page bitmap, followed by the non-zero RAM pages
+ *
+ *  The RAM pages start at a page-aligned file offset, so resuming maps them
+ *  copy-on-write instead of reading the whole RAM. Pages that are entirely
+ *  zero are not stored. Host side state (open files on the ExtFS volume,
+ *  Ethernet, serial and audio) is not saved, and the disk images must not
+ *  change between snapshot and resume.
+ */
+
+#include "sysdeps.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "cpu_emulation.h"
+#include "main.h"
+#include "macos_util.h"
+#include "prefs.h"
+#include "xpram.h"
+#include "timer.h"
+#include "sony.h"
+#include "disk.h"
+#include "cdrom.h"
+#include "extfs.h"
+#include "video.h"
+#include "vm_alloc.h"
+#include "spcflags.h"
+#include "snapshot.h"
+#include "Tiny68020.h"
+
+#define DEBUG 0
+#include "debug.h"
+
+extern Tiny68020 tiny68020;
+
+#if USE_SCRATCHMEM_SUBTERFUGE
+extern uint8 *ScratchMem;
+#endif
+
+
+const uint32 SNAPSHOT_MAGIC = FOURCC('B','2','s','s');
+const uint32 SNAPSHOT_VERSION = 1;
+
+
+/*
+ *  Mac addresses that are baked into RAM contents and must not move
+ */
+
+static uint32 scratch_mem_base(void)
+{
+#if USE_SCRATCHMEM_SUBTERFUGE
+	return Host2MacAddr(ScratchMem);
+#else
+	return 0;
+#endif
+}
+
+
+/*
+ *  Section tags
+ */
+
+static void put_tag(FILE *f, uint32 tag)
+{
+	SnapshotPut32(f, tag);
+}
+
+static bool get_tag(FILE *f, uint32 tag)
+{
+	uint32 v;
+	if (!SnapshotGet32(f, v))
+		return false;
+	if (v != tag) {
+		printf("WARNING: Snapshot section %08x expected, found %08x\n", tag, v);
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ *  CPU state
+ */
+
+static void save_cpu(FILE *f)
+{
+	Tiny68020::State s;
+	tiny68020.GetState(s);
+	for (int i=0; i<8; i++)
+		SnapshotPut32(f, s.d[i]);
+	for (int i=0; i<8; i++)
+		SnapshotPut32(f, s.a[i]);
+	for (int i=0; i<16; i++)
+		SnapshotPut32(f, s.cr[i]);
+	SnapshotPut32(f, s.pc);
+	SnapshotPut32(f, s.trace_pc);
+	SnapshotPut32(f, s.sr);
+}
+
+static bool load_cpu(FILE *f)
+{
+	Tiny68020::State s;
+	uint32 sr;
+	for (int i=0; i<8; i++)
+		if (!SnapshotGet32(f, s.d[i]))
+			return false;
+	for (int i=0; i<8; i++)
+		if (!SnapshotGet32(f, s.a[i]))
+			return false;
+	for (int i=0; i<16; i++)
+		if (!SnapshotGet32(f, s.cr[i]))
+			return false;
+	if (!SnapshotGet32(f, s.pc) || !SnapshotGet32(f, s.trace_pc) || !SnapshotGet32(f, sr))
+		return false;
+	s.sr = sr;
+	tiny68020.SetState(s);
+	return true;
+}
+
+
+/*
+ *  Display state
+ */
+
+static void save_video(FILE *f)
+{
+	SnapshotPut32(f, VideoMonitors.size());
+	vector<monitor_desc *>::const_iterator i, end = VideoMonitors.end();
+	for (i = VideoMonitors.begin(); i != end; ++i)
+		(*i)->save_state(f);
+}
+
+static bool load_video(FILE *f)
+{
+	uint32 n;
+	if (!SnapshotGet32(f, n) || n != VideoMonitors.size())
+		return false;
+	vector<monitor_desc *>::const_iterator i, end = VideoMonitors.end();
+	for (i = VideoMonitors.begin(); i != end; ++i)
+		if (!(*i)->load_state(f))
+			return false;
+	return true;
+}
+
+
+/*
+ *  RAM contents
+ */
+
+static bool is_zero_page(const uint8 *p, uint32 size)
+{
+	const uint32 *q = (const uint32 *)p;
+	for (uint32 i=0; i<size/4; i++)
+		if (q[i])
+			return false;
+	return true;
+}
+
+static void pad_to(FILE *f, uint32 align)
+{
+	long pos = ftell(f);
+	while (pos % align) {
+		fputc(0, f);
+		pos++;
+	}
+}
+
+static void save_ram(FILE *f)
+{
+	const uint32 page_size = vm_get_page_size();
+	const uint32 num_pages = RAMSize / page_size;
+	vector<uint8> bitmap((num_pages + 7) / 8, 0);
+	for (uint32 i=0; i<num_pages; i++)
+		if (!is_zero_page(RAMBaseHost + i * page_size, page_size))
+			bitmap[i / 8] |= 0x80 >> (i & 7);
+
+	SnapshotPut32(f, page_size);
+	SnapshotPut32(f, num_pages);
+	SnapshotPutBlock(f, &bitmap[0], bitmap.size());
+	pad_to(f, page_size);
+	for (uint32 i=0; i<num_pages; i++)
+		if (bitmap[i / 8] & (0x80 >> (i & 7)))
+			SnapshotPutBlock(f, RAMBaseHost + i * page_size, page_size);
+}
+
+static bool read_pages(int fd, uint8 *p, uint32 size, off_t offset)
+{
+	while (size) {
+		ssize_t actual = pread(fd, p, size, offset);
+		if (actual <= 0)
+			return false;
+		p += actual;
+		size -= actual;
+		offset += actual;
+	}
+	return true;
+}
+
+static bool load_ram(FILE *f)
+{
+	uint32 page_size, num_pages;
+	if (!SnapshotGet32(f, page_size) || !SnapshotGet32(f, num_pages))
+		return false;
+	if (page_size == 0 || page_size % 4 || num_pages * page_size != RAMSize)
+		return false;
+	vector<uint8> bitmap((num_pages + 7) / 8);
+	if (!SnapshotGetBlock(f, &bitmap[0], bitmap.size()))
+		return false;
+	off_t data = ftell(f);
+	data = (data + page_size - 1) / page_size * page_size;
+
+	// Pages can be mapped from the file if the page size matches ours
+	int fd = fileno(f);
+	bool can_map = page_size == (uint32)vm_get_page_size() && ((uintptr)RAMBaseHost % page_size) == 0;
+
+	uint32 i = 0, mapped = 0;
+	while (i < num_pages) {
+		bool present = bitmap[i / 8] & (0x80 >> (i & 7));
+		uint32 j = i + 1;
+		while (j < num_pages && (bool)(bitmap[j / 8] & (0x80 >> (j & 7))) == present)
+			j++;
+		uint8 *p = RAMBaseHost + i * page_size;
+		uint32 size = (j - i) * page_size;
+		if (present) {
+			if (can_map && vm_map_file_fixed(p, size, fd, data) == 0)
+				mapped += j - i;
+			else if (!read_pages(fd, p, size, data))
+				return false;
+			data += size;
+		} else {
+			// Only clear pages that were touched since startup
+			for (uint32 k=0; k<size; k+=page_size)
+				if (!is_zero_page(p + k, page_size))
+					memset(p + k, 0, page_size);
+		}
+		i = j;
+	}
+	D(bug("%d of %d RAM pages mapped from snapshot\n", mapped, num_pages));
+	return true;
+}
+
+
+/*
+ *  Write snapshot to file
+ *  (must be called by the CPU thread between two instructions)
+ */
+
+bool SnapshotSave(const char *path)
+{
+	char tmp_path[1024];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+	FILE *f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		printf("WARNING: Cannot create snapshot file %s (%s)\n", tmp_path, strerror(errno));
+		return false;
+	}
+
+	SnapshotPut32(f, SNAPSHOT_MAGIC);
+	SnapshotPut32(f, SNAPSHOT_VERSION);
+	SnapshotPut32(f, RAMSize);
+	SnapshotPut32(f, ROMSize);
+	SnapshotPut32(f, ReadMacInt32(ROMBaseMac));
+	SnapshotPut32(f, ROMBaseMac);
+	SnapshotPut32(f, scratch_mem_base());
+
+	put_tag(f, FOURCC('C','P','U',' '));
+	save_cpu(f);
+	put_tag(f, FOURCC('X','P','R','M'));
+	SnapshotPutBlock(f, XPRAM, XPRAM_SIZE);
+	put_tag(f, FOURCC('R','O','M',' '));
+	SnapshotPutBlock(f, ROMBaseHost, ROMSize);
+	put_tag(f, FOURCC('T','I','M','E'));
+	TimerSaveState(f);
+	put_tag(f, FOURCC('S','O','N','Y'));
+	SonySaveState(f);
+	put_tag(f, FOURCC('D','I','S','K'));
+	DiskSaveState(f);
+	put_tag(f, FOURCC('C','D','R','M'));
+	CDROMSaveState(f);
+	put_tag(f, FOURCC('E','X','T','F'));
+	ExtFSSaveState(f);
+	put_tag(f, FOURCC('V','I','D','O'));
+	save_video(f);
+	put_tag(f, FOURCC('R','A','M',' '));
+	save_ram(f);
+
+	bool ok = !ferror(f);
+	if (fclose(f) == 0 && ok && rename(tmp_path, path) == 0) {
+		D(bug("Snapshot written to %s\n", path));
+		return true;
+	}
+	printf("WARNING: Cannot write snapshot file %s (%s)\n", path, strerror(errno));
+	unlink(tmp_path);
+	return false;
+}
+
+
+/*
+ *  Restore machine state from snapshot file
+ *  (called after InitAll(), before the 680x0 emulation is started; returns
+ *  false if the snapshot doesn't match this configuration, the emulator
+ *  should then boot normally)
+ */
+
+bool SnapshotLoad(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		printf("WARNING: Cannot open snapshot file %s (%s)\n", path, strerror(errno));
+		return false;
+	}
+
+	uint32 magic, version, ram_size, rom_size, rom_checksum, rom_base, scratch_base;
+	if (!SnapshotGet32(f, magic) || !SnapshotGet32(f, version)
+	 || !SnapshotGet32(f, ram_size) || !SnapshotGet32(f, rom_size) || !SnapshotGet32(f, rom_checksum)
+	 || !SnapshotGet32(f, rom_base) || !SnapshotGet32(f, scratch_base)
+	 || magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+		printf("WARNING: %s is not a snapshot file\n", path);
+		fclose(f);
+		return false;
+	}
+	if (ram_size != RAMSize || rom_size != ROMSize || rom_checksum != ReadMacInt32(ROMBaseMac)) {
+		printf("WARNING: Snapshot %s was taken with a different RAM size or ROM\n", path);
+		fclose(f);
+		return false;
+	}
+	if (rom_base != ROMBaseMac || scratch_base != scratch_mem_base()) {
+		printf("WARNING: Snapshot %s was taken with a different memory layout\n", path);
+		fclose(f);
+		return false;
+	}
+
+	// From here on, the machine state is overwritten and we can't go back
+	bool ok = get_tag(f, FOURCC('C','P','U',' ')) && load_cpu(f)
+	       && get_tag(f, FOURCC('X','P','R','M')) && SnapshotGetBlock(f, XPRAM, XPRAM_SIZE)
+	       && get_tag(f, FOURCC('R','O','M',' ')) && SnapshotGetBlock(f, ROMBaseHost, ROMSize)
+	       && get_tag(f, FOURCC('T','I','M','E')) && TimerLoadState(f)
+	       && get_tag(f, FOURCC('S','O','N','Y')) && SonyLoadState(f)
+	       && get_tag(f, FOURCC('D','I','S','K')) && DiskLoadState(f)
+	       && get_tag(f, FOURCC('C','D','R','M')) && CDROMLoadState(f)
+	       && get_tag(f, FOURCC('E','X','T','F')) && ExtFSLoadState(f)
+	       && get_tag(f, FOURCC('V','I','D','O')) && load_video(f)
+	       && get_tag(f, FOURCC('R','A','M',' ')) && load_ram(f);
+	fclose(f);
+	XPRAMDirty = true;
+	if (!ok) {
+		char str[1024];
+		snprintf(str, sizeof(str), "Cannot resume from snapshot file %s.", path);
+		ErrorAlert(str);
+		QuitEmulator();
+	}
+
+	FlushCodeCache(ROMBaseHost, ROMSize);
+	D(bug("Resumed from snapshot %s\n", path));
+	return true;
+}
+
+
+/*
+ *  Ask the CPU thread to take a snapshot at the next instruction boundary
+ */
+
+void SnapshotRequest(void)
+{
+	SPCFLAGS_SET(SPCFLAG_SNAPSHOT);
+	idle_resume();
+}
+
+
+/*
+ *  Take requested snapshot (called by the CPU loop)
+ */
+
+void SnapshotService(void)
+{
+	const char *path = PrefsFindString("snapshot");
+	if (path == NULL) {
+		printf("WARNING: No snapshot file specified\n");
+		return;
+	}
+	if (SnapshotSave(path))
+		printf("Snapshot saved to %s\n", path);
+}
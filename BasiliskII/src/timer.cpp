@@ -23,6 +23,7 @@
 #include "macos_util.h"
 #include "main.h"
 #include "cpu_emulation.h"
+#include "snapshot.h"
 
 #ifdef PRECISE_TIMING_POSIX
 #include <pthread.h>
@@ -233,6 +234,8 @@ static void timer_thread_kill(void)
 // Suspend timer thread
 static void timer_thread_suspend(void)
 {
+	if (!timer_thread_active)
+		return;
 	pthread_mutex_lock(&suspend_count_lock);
 	if (suspend_count == 0) {
 		suspend_count ++;
@@ -245,6 +248,8 @@ static void timer_thread_suspend(void)
 // Resume timer thread
 static void timer_thread_resume(void)
 {
+	if (!timer_thread_active)
+		return;
 	pthread_mutex_lock(&suspend_count_lock);
 	assert(suspend_count > 0);
 	if (suspend_count == 1) {
@@ -279,7 +284,9 @@ void TimerInit(void)
 	pthread_create(&pthread, NULL, &timer_func, NULL);
 #endif
 #ifdef PRECISE_TIMING_POSIX
-	timer_thread_active = timer_thread_init();
+	// No timer thread in deterministic time mode, the CPU thread checks the wakeup time
+	if (ICountRate == 0)
+		timer_thread_active = timer_thread_init();
 #endif
 #endif
 }
@@ -330,6 +337,63 @@ void TimerReset(void)
 }
 
 
+/*
+ *  Save/restore installed timer tasks for machine snapshots
+ *  (wakeup times are stored relative to the time of the snapshot)
+ */
+
+void TimerSaveState(FILE *f)
+{
+	uint32 n = 0;
+	for (TMDesc *d = tmDescList; d; d = d->next)
+		n++;
+	SnapshotPut32(f, n);
+
+	tm_time_t now;
+	timer_current_time(now);
+	for (TMDesc *d = tmDescList; d; d = d->next) {
+		int32 remaining = 0;
+		if (timer_cmp_time(d->wakeup, now) > 0) {
+			tm_time_t delta;
+			timer_sub_time(delta, d->wakeup, now);
+			remaining = timer_host2mac_time(delta);
+		}
+		SnapshotPut32(f, d->task);
+		SnapshotPut32(f, remaining);
+	}
+}
+
+bool TimerLoadState(FILE *f)
+{
+	TimerReset();
+
+	uint32 n;
+	if (!SnapshotGet32(f, n))
+		return false;
+
+	tm_time_t now;
+	timer_current_time(now);
+	TMDesc **link = &tmDescList;
+	for (uint32 i = 0; i < n; i++) {
+		uint32 task, remaining;
+		if (!SnapshotGet32(f, task) || !SnapshotGet32(f, remaining))
+			return false;
+		TMDesc *desc = new TMDesc;
+		tm_time_t delay;
+		timer_mac2host_time(delay, int32(remaining));
+		timer_add_time(desc->wakeup, now, delay);
+		desc->task = task;
+		desc->next = NULL;
+		*link = desc;
+		link = &desc->next;
+	}
+
+	// Let TimerInterrupt() run expired tasks and reprogram the timer thread
+	SetInterruptFlag(INTFLAG_TIMER);
+	return true;
+}
+
+
 /*
  *  Insert timer task
  */
@@ -523,6 +587,8 @@ int16 PrimeTime(uint32 tm, int32 time)
 	assert(suspend_count == 0);
 #endif
 #endif
+	if (ICountRate)
+		ICountService();
 	return 0;
 }
 
@@ -671,5 +737,36 @@ void TimerInterrupt(void)
 	timer_thread_resume();
 	assert(suspend_count == 0);
 #endif
+#endif
+	if (ICountRate)
+		ICountService();
+}
+
+
+/*
+ *  Deterministic time mode: the CPU thread triggers the timer interrupt instead of the
+ *  timer thread, returns the next wakeup time (false = no task pending)
+ */
+
+bool TimerCheckWakeup(tm_time_t &next)
+{
+#ifdef PRECISE_TIMING_POSIX
+	tm_time_t now;
+	timer_current_time(now);
+	pthread_mutex_lock(&wakeup_time_lock);
+	bool pending = timer_cmp_time(wakeup_time, wakeup_time_max) != 0;
+	bool expired = pending && timer_cmp_time(wakeup_time, now) <= 0;
+	if (expired)
+		wakeup_time = wakeup_time_max;
+	next = wakeup_time;
+	pthread_mutex_unlock(&wakeup_time_lock);
+	if (expired) {
+		SetInterruptFlag(INTFLAG_TIMER);
+		TriggerInterrupt();
+	}
+	return pending && !expired;
+#else
+	// Tasks are checked on every 60Hz tick
+	return false;
 #endif
 }
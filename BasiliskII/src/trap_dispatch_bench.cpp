@@ -0,0 +1,250 @@
+/*
+ *  trap_dispatch_bench.cpp - A-line trap dispatch microbenchmark, compares
+ *                            native dispatch against a 68k trap dispatcher
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  A loop of four traps (Toolbox, Toolbox auto-pop, OS, OS with bit 8 set)
+ *  runs once through a 68k dispatcher with the same register and stack
+ *  conventions as the ROM's, and once with native dispatch. Both runs must
+ *  end in the same machine state.
+ */
+
+// Pull in the whole CPU core, the glue it needs is stubbed out below
+#include "Tiny68020.cpp"
+
+#include <vector>
+#include <sys/time.h>
+
+// Glue
+uae_u32 spcflags;
+B2_mutex *spcflags_lock = NULL;
+void B2_lock_mutex(B2_mutex *mutex) {}
+void B2_unlock_mutex(B2_mutex *mutex) {}
+int quit_program = 0;
+bool ProfilerActive = false;
+void ProfilerTrap(uint16 trap) {}
+int m68k_do_specialties(void) { spcflags = 0; return 1; }
+void m68k_execute(void) {}
+void m68k_emulop(uint32_t op) { spcflags = 1; }		// End of test program
+void m68k_emulop_return(void) {}
+void ICountService(void) {}
+
+// Memory layout
+const uint32 MEM_SIZE = 0x500000;
+uint32 ROMBaseMac = 0x400000;
+uint32 ROMSize = 0x10000;
+uint32 ATrapOSReturn = 0;
+
+const uint32 DISPATCHER = 0x400000;			// 68k trap dispatcher
+const uint32 OS_RETURN = 0x400200;			// OS trap return code (same as in rom_patches.cpp)
+const uint32 TOOL_ROUTINE = 0x2000;			// Trap implementations
+const uint32 TOOL_AUTOPOP_ROUTINE = 0x2100;
+const uint32 OS_ROUTINE = 0x2200;
+const uint32 OS_NOA0_ROUTINE = 0x2300;
+const uint32 PROGRAM = 0x3000;				// Test loop
+const uint32 STACK = 0x10000;
+
+static uint8 *mem;
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+// Minimal assembler: words at an address, forward byte branches
+class code {
+public:
+	code(uint32 adr) : pc(adr) {}
+	code &w(uint16 v) { mem[pc] = v >> 8; mem[pc + 1] = v; pc += 2; return *this; }
+	code &l(uint32 v) { return w(v >> 16).w(v); }
+	uint32 here(void) const { return pc; }
+	uint32 branch(uint16 op) { w(op); return pc - 2; }	// Bcc.s, resolve with bind()
+	void bind(uint32 br) { mem[br + 1] = pc - (br + 2); }
+private:
+	uint32 pc;
+};
+
+static void write32(uint32 adr, uint32 v)
+{
+	mem[adr] = v >> 24; mem[adr + 1] = v >> 16; mem[adr + 2] = v >> 8; mem[adr + 3] = v;
+}
+
+// Trap dispatcher with the ROM's conventions, entered with a format 0 frame
+static void build_dispatcher(void)
+{
+	code c(DISPATCHER);
+	c.w(0x2f0a);					// move.l	a2,-(sp)
+	c.w(0x2f02);					// move.l	d2,-(sp)
+	c.w(0x246f).w(10);				// movea.l	10(sp),a2		trap PC
+	c.w(0x341a);					// move.w	(a2)+,d2		trap word
+	c.w(0x0802).w(11);				// btst		#11,d2
+	uint32 to_os = c.branch(0x6700);	// beq.s	os
+
+	// Toolbox trap, replace the frame by the return address
+	c.w(0x2f4a).w(12);				// move.l	a2,12(sp)
+	c.w(0x0802).w(10);				// btst		#10,d2
+	uint32 to_autopop = c.branch(0x6600);	// bne.s	autopop
+	c.w(0x0242).w(0x3ff);			// andi.w	#$3ff,d2
+	c.w(0xe54a);					// lsl.w	#2,d2
+	c.w(0x45f8).w(0xe00);			// lea		$e00,a2
+	c.w(0x2f72).w(0x2000).w(8);		// move.l	(a2,d2.w),8(sp)
+	c.w(0x241f);					// move.l	(sp)+,d2
+	c.w(0x245f);					// movea.l	(sp)+,a2
+	c.w(0x4e75);					// rts
+	c.bind(to_autopop);
+	c.w(0x0242).w(0x3ff);			// andi.w	#$3ff,d2
+	c.w(0xe54a);					// lsl.w	#2,d2
+	c.w(0x45f8).w(0xe00);			// lea		$e00,a2
+	c.w(0x2f72).w(0x2000).w(12);	// move.l	(a2,d2.w),12(sp)
+	c.w(0x241f);					// move.l	(sp)+,d2
+	c.w(0x245f);					// movea.l	(sp)+,a2
+	c.w(0x588f);					// addq.l	#4,sp
+	c.w(0x4e75);					// rts
+
+	// OS trap, save registers and call through the return code
+	c.bind(to_os);
+	c.w(0x0802).w(8);				// btst		#8,d2
+	uint32 to_noa0 = c.branch(0x6600);	// bne.s	noa0
+	c.w(0x2f4a).w(12);				// move.l	a2,12(sp)
+	c.w(0x2f49).w(8);				// move.l	a1,8(sp)
+	c.w(0x246f).w(4);				// movea.l	4(sp),a2
+	c.w(0x2f48).w(4);				// move.l	a0,4(sp)
+	c.w(0x2f01);					// move.l	d1,-(sp)
+	c.w(0x3202);					// move.w	d2,d1
+	c.w(0x0242).w(0xff);			// andi.w	#$ff,d2
+	c.w(0xe54a);					// lsl.w	#2,d2
+	c.w(0x43f8).w(0x400);			// lea		$400,a1
+	c.w(0x2271).w(0x2000);			// movea.l	(a1,d2.w),a1
+	c.w(0x242f).w(4);				// move.l	4(sp),d2
+	c.w(0x4879).l(OS_RETURN);		// pea		OS_RETURN
+	c.w(0x2f09);					// move.l	a1,-(sp)
+	c.w(0x226f).w(20);				// movea.l	20(sp),a1
+	c.w(0x4e75);					// rts
+	c.bind(to_noa0);
+	c.w(0x2f4a).w(12);				// move.l	a2,12(sp)
+	c.w(0x2f49).w(8);				// move.l	a1,8(sp)
+	c.w(0x246f).w(4);				// movea.l	4(sp),a2
+	c.w(0x2f57).w(4);				// move.l	(sp),4(sp)
+	c.w(0x2e81);					// move.l	d1,(sp)
+	c.w(0x3202);					// move.w	d2,d1
+	c.w(0x0242).w(0xff);			// andi.w	#$ff,d2
+	c.w(0xe54a);					// lsl.w	#2,d2
+	c.w(0x43f8).w(0x400);			// lea		$400,a1
+	c.w(0x2271).w(0x2000);			// movea.l	(a1,d2.w),a1
+	c.w(0x242f).w(4);				// move.l	4(sp),d2
+	c.w(0x4879).l(OS_RETURN + 8);	// pea		OS_RETURN+8
+	c.w(0x2f09);					// move.l	a1,-(sp)
+	c.w(0x226f).w(16);				// movea.l	16(sp),a1
+	c.w(0x4e75);					// rts
+
+	// Return code, as installed by patch_rom_32()
+	code r(OS_RETURN);
+	r.w(0x4cdf).w(0x0306);			// movem.l	(sp)+,d1-d2/a0-a1
+	r.w(0x4a40);					// tst.w	d0
+	r.w(0x4e75);					// rts
+	r.w(0x4cdf).w(0x0206);			// movem.l	(sp)+,d1-d2/a1
+	r.w(0x4a40);					// tst.w	d0
+	r.w(0x4e75);					// rts
+}
+
+static void build_program(void)
+{
+	write32(0x28, DISPATCHER);				// A-line vector
+	write32(0xe00 + 1 * 4, TOOL_ROUTINE);
+	write32(0xe00 + 4 * 4, TOOL_AUTOPOP_ROUTINE);
+	write32(0x400 + 2 * 4, OS_ROUTINE);
+	write32(0x400 + 3 * 4, OS_NOA0_ROUTINE);
+
+	code(TOOL_ROUTINE).w(0x5283).w(0x4e75);				// addq.l #1,d3; rts
+	code(TOOL_AUTOPOP_ROUTINE).w(0x5286).w(0x4e75);		// addq.l #1,d6; rts
+	code(OS_ROUTINE)
+		.w(0xd881)					// add.l	d1,d4		sees the trap word
+		.w(0x74ff)					// moveq	#-1,d2		restored by the dispatcher
+		.w(0x2242)					// movea.l	d2,a1
+		.w(0x7000)					// moveq	#0,d0
+		.w(0x4e75);					// rts
+	code(OS_NOA0_ROUTINE)
+		.w(0x5285)					// addq.l	#1,d5
+		.w(0x2045)					// movea.l	d5,a0		returned in A0
+		.w(0x7001)					// moveq	#1,d0
+		.w(0x4e75);					// rts
+
+	code c(PROGRAM);
+	uint32 loop = c.here();
+	c.w(0xa801);					// Toolbox trap 1
+	c.w(0xa002);					// OS trap 2
+	c.w(0xa103);					// OS trap 3, A0 not saved
+	uint32 to_glue = c.branch(0x6100);	// bsr.s	glue
+	c.w(0x5387);					// subq.l	#1,d7
+	c.w(0x6600 | ((loop - (c.here() + 2)) & 0xff));	// bne.s	loop
+	c.w(0x7101);					// EMUL_OP, ends Execute()
+	c.bind(to_glue);
+	c.w(0xac04);					// Toolbox trap 4, auto-pop
+}
+
+static double run(Tiny68020 *cpu, uint32 iterations, bool native, Tiny68020::State &s, uint64 &insns)
+{
+	ATrapOSReturn = native ? OS_RETURN : 0;
+	memset(&s, 0, sizeof(s));
+	s.d[1] = 0x12340000;
+	s.d[7] = iterations;
+	s.a[7] = STACK;
+	s.pc = PROGRAM;
+	s.sr = 0x2700;
+	cpu->SetState(s);
+	uint64 start_insns = cpu->GetInsnCount();
+	double start = now();
+	cpu->Execute();
+	double t = now() - start;
+	insns = cpu->GetInsnCount() - start_insns;
+	cpu->GetState(s);
+	return t;
+}
+
+int main(int argc, char **argv)
+{
+	uint32 iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+	mem = new uint8[MEM_SIZE];
+	memset(mem, 0, MEM_SIZE);
+	build_dispatcher();
+	build_program();
+
+	Tiny68020 *cpu = new Tiny68020;
+	cpu->SetMemoryPtr(mem);
+
+	Tiny68020::State rom_state, native_state;
+	uint64 rom_insns, native_insns;
+	double rom_time = run(cpu, iterations, false, rom_state, rom_insns);
+	double native_time = run(cpu, iterations, true, native_state, native_insns);
+
+	bool same = memcmp(rom_state.d, native_state.d, sizeof(rom_state.d)) == 0
+	         && memcmp(rom_state.a, native_state.a, sizeof(rom_state.a)) == 0
+	         && rom_state.pc == native_state.pc && rom_state.sr == native_state.sr
+	         && rom_state.d[3] == iterations && rom_state.d[6] == iterations && rom_state.d[5] == iterations;
+
+	uint32 traps = iterations * 4;
+	printf("%-10s %12s %12s %10s\n", "dispatch", "insns/trap", "ns/trap", "Mtraps/s");
+	printf("%-10s %12.1f %12.1f %10.2f\n", "68k", double(rom_insns) / traps, rom_time * 1e9 / traps, traps / rom_time * 1e-6);
+	printf("%-10s %12.1f %12.1f %10.2f\n", "native", double(native_insns) / traps, native_time * 1e9 / traps, traps / native_time * 1e-6);
+	printf("speedup %.2fx, final state %s\n", rom_time / native_time, same ? "identical" : "DIFFERENT");
+	return same ? 0 : 1;
+}
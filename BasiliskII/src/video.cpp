@@ -28,6 +28,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "sysdeps.h"
 #include "cpu_emulation.h"
@@ -36,6 +37,7 @@
 #include "slot_rom.h"
 #include "video.h"
 #include "video_defs.h"
+#include "snapshot.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -448,6 +450,79 @@ void monitor_desc::switch_mode(vector<video_mode>::const_iterator it, uint32 par
 }
 
 
+/*
+ *  Save/restore display state and frame buffer contents for machine snapshots
+ */
+
+void monitor_desc::save_state(FILE *f) const
+{
+	SnapshotPut32(f, current_apple_mode);
+	SnapshotPut32(f, current_id);
+	SnapshotPut32(f, preferred_apple_mode);
+	SnapshotPut32(f, preferred_id);
+	SnapshotPut32(f, luminance_mapping);
+	SnapshotPut32(f, interrupts_enabled);
+	SnapshotPut32(f, dm_present);
+	SnapshotPut32(f, gamma_table);
+	SnapshotPut32(f, alloc_gamma_table_size);
+	SnapshotPut32(f, slot_param);
+	SnapshotPut32(f, mac_frame_base);
+	SnapshotPutBlock(f, palette, sizeof(palette));
+
+	uint32 size = current_mode->bytes_per_row * current_mode->y;
+	SnapshotPut32(f, size);
+	SnapshotPutBlock(f, Mac2HostAddr(mac_frame_base), size);
+}
+
+bool monitor_desc::load_state(FILE *f)
+{
+	uint32 apple_mode, id, pref_apple_mode, pref_id, lum, irq, dm, gamma, gamma_size, param, frame_base, size;
+	if (!SnapshotGet32(f, apple_mode) || !SnapshotGet32(f, id)
+	 || !SnapshotGet32(f, pref_apple_mode) || !SnapshotGet32(f, pref_id)
+	 || !SnapshotGet32(f, lum) || !SnapshotGet32(f, irq) || !SnapshotGet32(f, dm)
+	 || !SnapshotGet32(f, gamma) || !SnapshotGet32(f, gamma_size)
+	 || !SnapshotGet32(f, param) || !SnapshotGet32(f, frame_base))
+		return false;
+	uint8 pal[256 * 3];
+	if (!SnapshotGetBlock(f, pal, sizeof(pal)) || !SnapshotGet32(f, size))
+		return false;
+
+	vector<video_mode>::const_iterator it = find_mode(apple_mode, id);
+	if (it == invalid_mode() || it->bytes_per_row * it->y != size) {
+		printf("WARNING: Snapshot video mode %02x (resolution %02x) not available\n", apple_mode, id);
+		return false;
+	}
+
+	// Switch the host display to the saved mode
+	current_mode = it;
+	switch_to_current_mode();
+	if (mac_frame_base != frame_base) {
+		printf("WARNING: Snapshot frame buffer at %08x, now at %08x\n", frame_base, mac_frame_base);
+		return false;
+	}
+
+	current_apple_mode = apple_mode;
+	current_id = id;
+	preferred_apple_mode = pref_apple_mode;
+	preferred_id = pref_id;
+	luminance_mapping = lum != 0;
+	interrupts_enabled = irq != 0;
+	dm_present = dm != 0;
+	gamma_table = gamma;
+	alloc_gamma_table_size = gamma_size;
+	slot_param = param;
+
+	// Reload color table (in direct modes the palette holds the gamma ramp)
+	memcpy(palette, pal, sizeof(palette));
+	if (IsDirectMode(*current_mode))
+		set_gamma(palette, current_mode->depth == VDEPTH_16BIT ? 32 : 256);
+	else
+		set_palette(palette, 256);
+
+	return SnapshotGetBlock(f, Mac2HostAddr(mac_frame_base), size);
+}
+
+
 /*
  *  Driver Open() routine
  */
@@ -31,6 +31,7 @@
 
 // Extended parameter RAM
 uint8 XPRAM[XPRAM_SIZE];
+volatile bool XPRAMDirty;
 
 
 /*
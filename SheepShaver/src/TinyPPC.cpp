@@ -277,6 +277,7 @@ void TinyPPC::Reset() {
 	memset(gpr, 0, sizeof(gpr));
 	memset(fpr, 0, sizeof(fpr));
 	lr = ctr = cr = xer = fpscr = reserve_adr = 0;
+	fprf_pending = false;
 	reserve = false;
 	// SheepShaver
 	extern u32 ROMBase, KernelDataAddr;
@@ -470,21 +471,17 @@ template<int M> void TinyPPC::farith(u32 op) {
 	if constexpr ((M & 0xf0) == 0x00) { // fcmpo/fcmpu
 		double a = frA(op).f, b = frB(op).f;
 		u32 c = std::fpclassify(a) == FP_NAN || std::fpclassify(b) == FP_NAN ? MSB >> 3 : cmp3(a, b);
+		sync_fprf();
 		fpscr = (fpscr & ~0xf000) | c >> 16;
 		update_cr(op, c);
 		return;
 	}
 	if constexpr ((M & 8) != 0) v = -v; // fn*
 	if constexpr ((M & 4) != 0) v = (float)v; // *s
-	if constexpr (!(M & 2)) {
-		fpscr &= ~0x1f000;
-		switch (std::fpclassify(v)) {
-			case FP_ZERO:		fpscr |= std::signbit(v) ? 0x12000 : 0x2000; break;
-			case FP_SUBNORMAL:	fpscr |= 0x10000 | (v < 0 ? 0x8000 : 0x4000); break;
-			case FP_NAN:		fpscr |= 0x11000; break;
-			case FP_INFINITE:	fpscr |= 0x1000 | (v < 0 ? 0x8000 : 0x4000); break;
-			case FP_NORMAL:		fpscr |= v < 0 ? 0x8000 : 0x4000; break;
-		}
+	if constexpr (!(M & 2)) { // FPRF is derived from the result when FPSCR is read
+		fprf_v = v;
+		fprf_pending = true;
+		if constexpr (!TINYPPC_LAZY_FPRF) sync_fprf();
 	}
 	if constexpr (M & 1) update_cr1();
 	stD(op, FPR { .f = v });
@@ -526,6 +523,7 @@ template<int M> void TinyPPC::mtfs(u32 op) {
 	if constexpr ((M & 0x30) == 0x10) m = digitmask.m[op >> 17 & 0xff], x = (u32)frB(op).i;
 	if constexpr ((M & 0x30) == 0x20) s = (op >> 23 & 7) << 2, m = MSD >> s, x = op << 16 >> s;
 	m &= ~(3 << 29);
+	sync_fprf();
 	if constexpr ((M & 4) != 0) fpscr &= ~m;
 	if constexpr ((M & 2) != 0) fpscr |= x & m;
 	if constexpr (M & 1) update_cr1();
@@ -548,8 +546,8 @@ void TinyPPC::mfspr(u32 op) {
 
 void TinyPPC::mftb(u32 op) {
 	switch (op & 0x1ff800) {
-		case pr(268): stD(op, u32(25 * GetTicks_usec())); return;	// SheepShaver
-		case pr(269): stD(op, 25 * GetTicks_usec() >> 32); return;	// SheepShaver
+		case pr(268): stD(op, u32(25 * GuestTicks_usec())); return;	// SheepShaver
+		case pr(269): stD(op, 25 * GuestTicks_usec() >> 32); return;	// SheepShaver
 	}
 }
 
@@ -563,12 +561,14 @@ void TinyPPC::mtspr(u32 op) {
 
 void TinyPPC::Execute() {
 	extern bool check_spcflags(TinyPPC *);
+	extern void ICountService(); // SheepShaver
 	do {
 #if TINYPPC_TRACE
 		tracep->pc = pc;
 		tracep->index = 0;
 #endif
 		Insn::exec1(this, fetch4());
+		if (++insn_count >= insn_deadline) { insn_deadline = ~0ULL; ICountService(); } // SheepShaver
 #if TINYPPC_TRACE
 		tracep->cr = cr;
 #if TINYPPC_TRACE > 1
@@ -643,6 +643,7 @@ void TinyPPC::undef(u32 op) {
 // ---- for SheepShaver
 
 void TinyPPC::Interrupt() {
+	sync_fprf();
 	RegTmp r;
 	memcpy(r.gpr, gpr, sizeof(gpr));
 	memcpy(r.fpr, fpr, sizeof(fpr));
@@ -662,6 +663,7 @@ void TinyPPC::Interrupt() {
 	cr = r.cr;
 	xer = r.xer;
 	fpscr = r.fpscr;
+	fprf_pending = false; // r.fpscr has the FPRF of the interrupted code
 }
 
 void TinyPPC::sheep(u32 op) {
@@ -4,9 +4,14 @@
 
 #include <cstdint>
 #include <cstring>
+#include <cmath>
 
 #define TINYPPC_TRACE		0
 
+#ifndef TINYPPC_LAZY_FPRF
+#define TINYPPC_LAZY_FPRF	1	// 0: classify every FP result at once (reference for tinyppc_fp_bench)
+#endif
+
 #if TINYPPC_TRACE
 #define TINYPPC_TRACE_LOG(adr, data, type) \
 	if (tracep->index < ACSMAX) tracep->acs[tracep->index++] = { adr, data, type }
@@ -33,6 +38,9 @@ public:
 	void SetMemoryPtr(u8 *p) { m = p; }
 	void Reset();
 	u32 GetPC() const { return pc; }
+	u32 GetGPR(int n) const { return gpr[n]; } // SheepShaver
+	u64 GetInsnCount() const { return insn_count; } // SheepShaver
+	void SetInsnDeadline(u64 n) { insn_deadline = n; } // SheepShaver
 	void Execute();
 	void Interrupt();
 	void StopTrace();
@@ -68,6 +76,19 @@ private:
 	void update_cr1() {
 		cr = (cr & ~(MSD >> 4)) | (fpscr & MSD) >> 4;
 	}
+	void sync_fprf() {
+		if (!fprf_pending) return;
+		fprf_pending = false;
+		double v = fprf_v;
+		fpscr &= ~0x1f000;
+		switch (std::fpclassify(v)) {
+			case FP_ZERO:		fpscr |= std::signbit(v) ? 0x12000 : 0x2000; break;
+			case FP_SUBNORMAL:	fpscr |= 0x10000 | (v < 0 ? 0x8000 : 0x4000); break;
+			case FP_NAN:		fpscr |= 0x11000; break;
+			case FP_INFINITE:	fpscr |= 0x1000 | (v < 0 ? 0x8000 : 0x4000); break;
+			case FP_NORMAL:		fpscr |= v < 0 ? 0x8000 : 0x4000; break;
+		}
+	}
 	void update_cr(u32 op, u32 v) {
 		int s = (op >> 23 & 7) << 2;
 		cr = (cr & ~(MSD >> s)) | (v & MSD) >> s;
@@ -195,11 +216,13 @@ private:
 	template<int M> void farith(u32 op);
 	void mcrf(u32 op) { update_cr(op, cr << ((op >> 18 & 7) << 2)); }
 	void mcrfs(u32 op) {
+		sync_fprf();
 		u32 s = (op >> 18 & 7) << 2;
 		update_cr(op, fpscr << s);
 		fpscr &= ~(MSD >> s) | 0x6007f0ff;
 	}
 	template<int M> void mffs(u32 op) {
+		sync_fprf();
 		stD(op, FPR { .i = fpscr });
 		if constexpr (M) update_cr1();
 	}
@@ -223,5 +246,9 @@ private:
 	u32 gpr[32];
 	FPR fpr[32];
 	u32 pc, lr, ctr, cr, xer, fpscr, reserve_adr;
+	double fprf_v; // result of the last FP operation, FPRF is stale while fprf_pending
+	bool fprf_pending;
+	u64 insn_count = 0; // SheepShaver
+	u64 insn_deadline = 0; // SheepShaver: ICountService() is called when insn_count reaches it
 	bool reserve;
 };
@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/cowdisk.cpp
\ No newline at end of file
@@ -103,6 +103,7 @@
 #include "emul_op.h"
 #include "xlowmem.h"
 #include "xpram.h"
+#include "persist_unix.h"
 #include "timer.h"
 #include "adb.h"
 #include "video.h"
@@ -113,6 +114,7 @@
 #include "vm_alloc.h"
 #include "sigsegv.h"
 #include "rpc.h"
+#include "bench.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -128,6 +130,7 @@
 
 #ifndef USE_SDL_VIDEO
 #include <X11/Xlib.h>
+#include "video_headless.h"
 #endif
 
 #ifdef ENABLE_GTK
@@ -217,11 +220,7 @@ static bool dr_emulator_area_mapped = false;// Flag: Mac DR Emulator mmap()ped
 static KernelData *kernel_data;				// Pointer to Kernel Data
 static EmulatorData *emulator_data;
 
-static uint8 last_xpram[XPRAM_SIZE];		// Buffer for monitoring XPRAM changes
 
-static bool nvram_thread_active = false;	// Flag: NVRAM watchdog installed
-static volatile bool nvram_thread_cancel;	// Flag: Cancel NVRAM thread
-static pthread_t nvram_thread;				// NVRAM watchdog
 static bool tick_thread_active = false;		// Flag: MacOS thread installed
 static volatile bool tick_thread_cancel;	// Flag: Cancel 60Hz thread
 static pthread_t tick_thread;				// 60Hz thread
@@ -257,7 +256,6 @@ static bool kernel_data_init(void);
 static bool shm_map_address(int kernel_area, uint32 addr);
 static void Quit(void);
 static void *emul_func(void *arg);
-static void *nvram_func(void *arg);
 static void *tick_func(void *arg);
 #if EMULATED_PPC
 extern void emul_ppc(uint32 start);
@@ -707,7 +705,13 @@ static bool init_sdl()
 	setenv("SDL_HAS3BUTTONMOUSE", "1", true);
 #endif
 
-	if (SDL_Init(sdl_flags) == -1) {
+	int sdl_err = -1;
+#if defined(USE_SDL_VIDEO) && !SDL_VERSION_ATLEAST(2,0,0) && !defined(__MACOSX__)
+	// SDL 1.2 can read X11 events in a thread of its own, SDL_PumpEvents() on the
+	// CPU thread is then a no-op (not supported by all video drivers, so retry without)
+	sdl_err = SDL_Init(sdl_flags | SDL_INIT_EVENTTHREAD);
+#endif
+	if (sdl_err == -1 && SDL_Init(sdl_flags) == -1) {
 		char str[256];
 		sprintf(str, "Could not initialize SDL: %s.\n", SDL_GetError());
 		ErrorAlert(str);
@@ -875,19 +879,28 @@ int main(int argc, char **argv)
 		}
 	}
 
+	// Benchmark mode overrides some prefs
+	BenchInit();
+
+	// Derive guest time from the instruction count?
+	ICountInit();
+
 #ifndef USE_SDL_VIDEO
-	// Open display
-	x_display = XOpenDisplay(x_display_name);
-	if (x_display == NULL) {
-		char str[256];
-		sprintf(str, GetString(STR_NO_XSERVER_ERR), XDisplayName(x_display_name));
-		ErrorAlert(str);
-		goto quit;
+	// Open display (not needed by the headless display driver)
+	if (!VideoHeadless()) {
+		x_display = XOpenDisplay(x_display_name);
+		if (x_display == NULL) {
+			char str[256];
+			sprintf(str, GetString(STR_NO_XSERVER_ERR), XDisplayName(x_display_name));
+			ErrorAlert(str);
+			goto quit;
+		}
 	}
 
 #if defined(ENABLE_XF86_DGA) && !defined(ENABLE_MON)
 	// Fork out, so we can return from fullscreen mode when things get ugly
-	XF86DGAForkApp(DefaultScreen(x_display));
+	if (x_display)
+		XF86DGAForkApp(DefaultScreen(x_display));
 #endif
 #endif
 
@@ -1077,18 +1090,23 @@ int main(int argc, char **argv)
 #if !EMULATED_PPC
 	flush_icache_range(ROMBase, ROMBase + ROM_AREA_SIZE);
 #endif
+	if (PrefsFindBool("romshare") && vm_share_fixed(ROMBaseHost, ROM_AREA_SIZE, "SheepShaver-rom") < 0)
+		printf("WARNING: Cannot share ROM with other instances\n");
 	vm_protect(ROMBaseHost, ROM_AREA_SIZE, VM_PAGE_READ | VM_PAGE_EXECUTE);
 
-	// Start 60Hz thread
-	tick_thread_cancel = false;
-	tick_thread_active = (pthread_create(&tick_thread, NULL, tick_func, NULL) == 0);
-	D(bug("Tick thread installed (%ld)\n", tick_thread));
+	// Let the host merge identical RAM pages of several instances
+	if (PrefsFindBool("rammerge") && vm_set_mergeable(RAMBaseHost, RAMSize) < 0)
+		printf("WARNING: Cannot enable page merging for Mac RAM: %s\n", strerror(errno));
+
+	// Start 60Hz thread (the CPU thread ticks in deterministic time mode)
+	if (ICountRate == 0) {
+		tick_thread_cancel = false;
+		tick_thread_active = (pthread_create(&tick_thread, NULL, tick_func, NULL) == 0);
+		D(bug("Tick thread installed (%ld)\n", tick_thread));
+	}
 
-	// Start NVRAM watchdog thread
-	memcpy(last_xpram, XPRAM, XPRAM_SIZE);
-	nvram_thread_cancel = false;
-	nvram_thread_active = (pthread_create(&nvram_thread, NULL, nvram_func, NULL) == 0);
-	D(bug("NVRAM thread installed (%ld)\n", nvram_thread));
+	// Start writing back NVRAM changes
+	PersistInit();
 
 #if !EMULATED_PPC
 	// Install SIGILL handler
@@ -1150,12 +1168,8 @@ static void Quit(void)
 		pthread_join(tick_thread, NULL);
 	}
 
-	// Stop NVRAM watchdog thread
-	if (nvram_thread_active) {
-		nvram_thread_cancel = true;
-		pthread_cancel(nvram_thread);
-		pthread_join(nvram_thread, NULL);
-	}
+	// Write back NVRAM and prefs changes
+	PersistExit();
 
 #if !EMULATED_PPC
 	// Uninstall SIGSEGV and SIGBUS handlers
@@ -1181,6 +1195,11 @@ static void Quit(void)
 	// Deinitialize everything
 	ExitAll();
 
+	// Print host memory usage, PSS counts shared pages only partially
+	unsigned long rss_kb, pss_kb;
+	if (PrefsFindBool("memstats") && vm_get_rss(&rss_kb, &pss_kb) == 0)
+		printf("Memory: RSS %lu KB, PSS %lu KB, %lu KB shared with other processes\n", rss_kb, pss_kb, rss_kb - pss_kb);
+
 	// Delete SheepShaver globals
 	SheepMem::Exit();
 
@@ -1402,39 +1421,47 @@ void MakeExecutable(int dummy, uint32 start, uint32 length)
 
 
 /*
- *  NVRAM watchdog thread (saves NVRAM every minute)
+ *  60Hz thread (really 60.15Hz)
  */
 
-static void nvram_watchdog(void)
+static int tick_counter = 0;
+
+static void one_tick(void)
 {
-	if (memcmp(last_xpram, XPRAM, XPRAM_SIZE)) {
-		memcpy(last_xpram, XPRAM, XPRAM_SIZE);
-		SaveXPRAM();
+	// Pseudo Mac 1Hz interrupt, update local time
+	if (++tick_counter > 60) {
+		tick_counter = 0;
+		WriteMacInt32(0x20c, TimerDateTime());
 	}
-}
 
-static void *nvram_func(void *arg)
-{
-	while (!nvram_thread_cancel) {
-		for (int i=0; i<60 && !nvram_thread_cancel; i++)
-			Delay_usec(999999);		// Only wait 1 second so we quit promptly when nvram_thread_cancel becomes true
-		nvram_watchdog();
+	// Trigger 60Hz interrupt
+	if (ReadMacInt32(XLM_IRQ_NEST) == 0) {
+		SetInterruptFlag(INTFLAG_VIA);
+		TriggerInterrupt();
 	}
-	return NULL;
 }
 
-
-/*
- *  60Hz thread (really 60.15Hz)
- */
+// Deterministic time mode, called by the CPU thread
+void ICountTick(void)
+{
+	one_tick();
+}
 
 static void *tick_func(void *arg)
 {
-	int tick_counter = 0;
 	uint64 start = GetTicks_usec();
 	int64 ticks = 0;
 	uint64 next = start;
 
+	// Ticks are suspended while the Mac is idle, the Time Manager thread wakes it up in time
+	// (not with SDL, whose input events are only read on the tick)
+#if PRECISE_TIMING && !defined(USE_SDL_VIDEO)
+	int32 idle_limit = PrefsFindInt32("ticklessidle") * 1000;
+#else
+	int32 idle_limit = 0;
+#endif
+
+	int64 skipped_total = 0;
 	while (!tick_thread_cancel) {
 
 		// Wait
@@ -1444,23 +1471,24 @@ static void *tick_func(void *arg)
 			Delay_usec(delay);
 		else if (delay < -16625)
 			next = GetTicks_usec();
-		ticks++;
 
-		// Pseudo Mac 1Hz interrupt, update local time
-		if (++tick_counter > 60) {
-			tick_counter = 0;
-			WriteMacInt32(0x20c, TimerDateTime());
+		// Checked after the delay, the interrupt of the last tick woke up the emulator thread
+		if (idle_sleep(0, idle_limit)) {
+			int64 skipped = (int64)(GetTicks_usec() - next) / 16625;
+			if (skipped > 0) {
+				next += skipped * 16625;
+				skipped_total += skipped;
+				tick_counter += skipped;
+				idle_skip_ticks(skipped);
+			}
 		}
 
-		// Trigger 60Hz interrupt
-		if (ReadMacInt32(XLM_IRQ_NEST) == 0) {
-			SetInterruptFlag(INTFLAG_VIA);
-			TriggerInterrupt();
-		}
+		ticks++;
+		one_tick();
 	}
 
 	D(uint64 end = GetTicks_usec());
-	D(bug("%lld ticks in %lld usec = %f ticks/sec\n", ticks, end - start, ticks * 1000000.0 / (end - start)));
+	D(bug("%lld ticks in %lld usec = %f ticks/sec, %lld skipped while idle\n", ticks, end - start, ticks * 1000000.0 / (end - start), skipped_total));
 	return NULL;
 }
 
@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/persist_unix.cpp
\ No newline at end of file
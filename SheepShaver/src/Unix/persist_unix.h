@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/persist_unix.h
\ No newline at end of file
@@ -1363,6 +1363,7 @@ static void read_settings(void)
  */
 
 uint8 XPRAM[XPRAM_SIZE];
+volatile bool XPRAMDirty;
 void MountVolume(void *fh) { }
 void FileDiskLayout(loff_t size, uint8 *data, loff_t &start_byte, loff_t &real_size) { }
 
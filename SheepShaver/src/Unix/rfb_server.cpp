@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/rfb_server.cpp
\ No newline at end of file
@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/rfb_server.h
\ No newline at end of file
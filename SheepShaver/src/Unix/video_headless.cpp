@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/video_headless.cpp
\ No newline at end of file
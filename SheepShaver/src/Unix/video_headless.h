@@ -0,0 +1 @@
+../../../BasiliskII/src/Unix/video_headless.h
\ No newline at end of file
@@ -66,6 +66,8 @@
 #include "video.h"
 #include "video_defs.h"
 #include "video_blit.h"
+#include "video_headless.h"
+#include "rfb_server.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -95,6 +97,7 @@ static sem_t thread_resume_req;
 static bool local_X11;						// Flag: X server running on local machine?
 static bool has_dga = false;				// Flag: Video DGA capable
 static bool has_vidmode = false;			// Flag: VidMode extension available
+static bool headless = false;				// Flag: No display, video_headless.cpp does the work
 
 #ifdef ENABLE_VOSF
 static bool use_vosf = true;				// Flag: VOSF enabled
@@ -1389,6 +1392,10 @@ static bool has_mode(int x, int y)
 
 bool VideoInit(void)
 {
+	headless = VideoHeadless();
+	if (headless)
+		return HeadlessVideoInit();
+
 #ifdef ENABLE_VOSF
 	// Zero the mainBuffer structure
 	mainBuffer.dirtyPages = NULL;
@@ -1707,6 +1714,11 @@ bool VideoInit(void)
 
 void VideoExit(void)
 {
+	if (headless) {
+		HeadlessVideoExit();
+		return;
+	}
+
 	// Stop redraw thread
 	if (redraw_thread_active) {
 		redraw_thread_cancel = true;
@@ -2011,6 +2023,13 @@ static int kc_decode(KeySym ks)
 	return -1;
 }
 
+// Used by the RFB server, whose key events carry X keysyms
+int KeysymToADB(uint32 keysym)
+{
+	int code = kc_decode(keysym);
+	return code >= 0 ? code : -1;
+}
+
 static int event2keycode(XKeyEvent &ev, bool key_down)
 {
 	KeySym ks;
@@ -2185,8 +2204,10 @@ void VideoVBL(void)
 
 	// Temporarily give up frame buffer lock (this is the point where
 	// we are suspended when the user presses Ctrl-Tab)
-	UNLOCK_FRAME_BUFFER;
-	LOCK_FRAME_BUFFER;
+	if (!headless) {
+		UNLOCK_FRAME_BUFFER;
+		LOCK_FRAME_BUFFER;
+	}
 
 	// Execute video VBL
 	if (private_data != NULL && private_data->interruptsEnabled)
@@ -2200,6 +2221,9 @@ void VideoVBL(void)
 
 int16 video_mode_change(VidLocals *csSave, uint32 ParamPtr)
 {
+	if (headless)
+		return headless_video_mode_change(csSave, ParamPtr);
+
 	/* return if no mode change */
 	if ((csSave->saveData == ReadMacInt32(ParamPtr + csData)) &&
 	    (csSave->saveMode == ReadMacInt16(ParamPtr + csMode))) return noErr;
@@ -2252,6 +2276,11 @@ int16 video_mode_change(VidLocals *csSave, uint32 ParamPtr)
 
 void video_set_palette(void)
 {
+	if (headless) {
+		HeadlessVideoSetPalette();
+		return;
+	}
+
 	LOCK_PALETTE;
 
 	// Convert colors to XColor array
@@ -2307,7 +2336,7 @@ void video_set_gamma(int n_colors)
 
 bool video_can_change_cursor(void)
 {
-	return hw_mac_cursor_accl && (display_type != DIS_SCREEN);
+	return hw_mac_cursor_accl && !headless && (display_type != DIS_SCREEN);
 }
 
 
@@ -2619,6 +2648,9 @@ static void *redraw_func(void *arg)
 
 void video_set_dirty_area(int x, int y, int w, int h)
 {
+	if (headless)
+		return;
+
 	VideoInfo const & mode = VModes[cur_mode];
 	const int screen_width = VIDEO_MODE_X;
 	const int screen_height = VIDEO_MODE_Y;
@@ -0,0 +1 @@
+../../BasiliskII/src/bench.cpp
\ No newline at end of file
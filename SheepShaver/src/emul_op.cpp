@@ -46,6 +46,7 @@
 #include "user_strings.h"
 #include "emul_op.h"
 #include "thunks.h"
+#include "bench.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -79,6 +80,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 				len &= 0x7fff;
 				for (uint32 i=0; i<len; i++)
 					XPRAM[((ofs + i) & 0xff) + 0x1300] = *adr++;
+				XPRAMDirty = true;
 			} else {
 				for (uint32 i=0; i<len; i++)
 					*adr++ = XPRAM[((ofs + i) & 0xff) + 0x1300];
@@ -92,6 +94,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 
 		case OP_XPRAM3:				// Write to XPRam
 			XPRAM[(r->d[1] & 0xff) + 0x1300] = r->d[2];
+			XPRAMDirty = true;
 			break;
 
 		case OP_NVRAM1: {			// Read from NVRAM
@@ -121,6 +124,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 
 		case OP_NVRAM2:				// Write to NVRAM
 			XPRAM[r->d[0] & 0x1fff] = r->d[1];
+			XPRAMDirty = true;
 			break;
 
 		case OP_NVRAM3:				// Read/write from/to NVRAM
@@ -128,6 +132,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 				r->d[0] = XPRAM[(r->d[4] + 0x1300) & 0x1fff];
 			} else {
 				XPRAM[(r->d[4] + 0x1300) & 0x1fff] = r->d[5];
+				XPRAMDirty = true;
 				r->d[0] = 0;
 			}
 			break;
@@ -308,6 +313,21 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 			if (HasMacStarted()) {
 				if (InterruptFlags & INTFLAG_VIA) {
 					ClearInterruptFlag(INTFLAG_VIA);
+
+					// Catch up with ticks skipped while idle (with REAL_ADDRESSING, GCC
+					// takes the low memory writes for writes through a null pointer)
+					int skipped = idle_take_skipped_ticks();
+					if (skipped) {
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wstringop-overflow"
+#endif
+						WriteMacInt32(0x16a, ReadMacInt32(0x16a) + skipped);
+						WriteMacInt32(0x20c, TimerDateTime());
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+					}
 #if !PRECISE_TIMING
 					TimerInterrupt();
 #endif
@@ -319,6 +339,7 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 						SonyInterrupt();
 						DiskInterrupt();
 						CDROMInterrupt();
+						ExtFSInterrupt();
 					}
 
 					r->d[0] = 1;		// Flag: 68k interrupt routine executes VBLTasks etc.
@@ -371,10 +392,19 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 					WriteMacInt16(r->a[7] + 6, SCSICmd(ReadMacInt16(r->a[7]), Mac2HostAddr(ReadMacInt32(r->a[7] + 2))));
 					stack = 6;
 					break;
-				case 4:		// SCSIComplete
-					WriteMacInt16(r->a[7] + 12, SCSIComplete(ReadMacInt32(r->a[7]), ReadMacInt32(r->a[7] + 4), ReadMacInt32(r->a[7] + 8)));
-					stack = 12;
+				case 4: {	// SCSIComplete
+					int16 err = SCSIComplete(ReadMacInt32(r->a[7]), ReadMacInt32(r->a[7] + 4), ReadMacInt32(r->a[7] + 8));
+					if (err == SCSI_COMPLETE_PENDING) {
+						// Command still running, call SCSIDispatch() again so interrupts are handled meanwhile
+						r->a[7] -= 6;
+						ret = SCSIDispatchPatch;
+						stack = 0;
+					} else {
+						WriteMacInt16(r->a[7] + 12, err);
+						stack = 12;
+					}
 					break;
+				}
 				case 5:		// SCSIRead
 				case 8:		// SCSIRBlind
 					WriteMacInt16(r->a[7] + 4, SCSIRead(ReadMacInt32(r->a[7])));
@@ -479,18 +509,32 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 
 		case OP_IDLE_TIME:
 			// Sleep if no events pending
-			if (ReadMacInt32(0x14c) == 0)
-				idle_wait();
+			if (ReadMacInt32(0x14c) == 0) {
+				if (BenchActive)
+					BenchIdle();
+				else
+					idle_wait();
+			}
 			r->a[0] = ReadMacInt32(0x2b6);
 			break;
 
 		case OP_IDLE_TIME_2:
 			// Sleep if no events pending
-			if (ReadMacInt32(0x14c) == 0)
-				idle_wait();
+			if (ReadMacInt32(0x14c) == 0) {
+				if (BenchActive)
+					BenchIdle();
+				else
+					idle_wait();
+			}
 			r->d[0] = (uint32)-2;
 			break;
 
+		case OP_BENCH_STOP:			// Benchmark milestone reached
+			D(bug("BenchStop d0 %08x\n", r->d[0]));
+			if (BenchActive)
+				BenchEmulOp(r->d[0]);
+			break;
+
 		default:
 			printf("FATAL: EMUL_OP called with bogus selector %08x\n", selector);
 			QuitEmulator();
@@ -131,6 +131,7 @@ struct DLPIStream {
 	nw_uint32 group_sap[kGroupSAPMapSize];	// Map of bound group SAPs
 	uint8 snap[k8022SNAPLength];			// SNAP bound to this stream
 	nw_multicast_node_p multicast_list;		// List of enabled multicast addresses
+	nw_DLPIStream_p next_open;				// Next stream in open_stream_list
 };
 
 // Hack to make DLPIStream list initialization early to NULL (do we really need this?)
@@ -150,6 +151,9 @@ enum {
 static nw_DLPIStream_p dlpi_stream_list;
 static DLPIStreamInit dlpi_stream_init(&dlpi_stream_list);
 
+// Same list, maintained here so received packets are distributed without calling mi_next_ptr()
+static DLPIStream *open_stream_list = NULL;
+
 // Are we open?
 bool ether_driver_opened = false;
 
@@ -171,6 +175,7 @@ int32 num_rx_no_mem = 0;
 int32 num_rx_dropped = 0;
 int32 num_rx_stream_not_ready = 0;
 int32 num_rx_no_unitdata_mem = 0;
+int32 num_rx_recycled = 0;
 
 
 // Function pointers of imported functions
@@ -305,6 +310,7 @@ static void DLPI_subs_unbind(DLPIStream *the_stream, queue_t *q, mblk_t *mp);
 static void DLPI_enable_multi(DLPIStream *the_stream, queue_t *q, mblk_t *mp);
 static void DLPI_disable_multi(DLPIStream *the_stream, queue_t *q, mblk_t *mp);
 static void DLPI_unit_data(DLPIStream *the_stream, queue_t *q, mblk_t *mp);
+static void rx_free_spares(void);
 
 
 /*
@@ -399,6 +405,7 @@ static uint8 InitStreamModuleImpl(void *theID)
 #ifndef USE_ETHER_FULL_DRIVER
 	// Initialize stream list (which might be leftover)
 	dlpi_stream_list = NULL;
+	open_stream_list = NULL;
 
 	// Ask add-on for ethernet hardware address
 	AO_get_ethernet_address(Host2MacAddr(hardware_address));
@@ -445,6 +452,9 @@ static void TerminateStreamModuleImpl(void)
 	// This happens sometimes. I don't know why.
 	if (dlpi_stream_list != NULL)
 		printf("FATAL: TerminateStreamModule() called, but streams still open\n");
+
+	// Release spare receive buffers
+	rx_free_spares();
 #endif
 
 	// Sorry, we're closed
@@ -494,6 +504,8 @@ int ether_open(queue_t *rdq, void *dev, int flag, int sflag, void *creds)
 	the_stream->framing_8022 = false;
 	the_stream->raw_mode = false;
 	the_stream->multicast_list = NULL;
+	the_stream->next_open = open_stream_list;
+	open_stream_list = the_stream;
 	return 0;
 }
 
@@ -526,6 +538,17 @@ int ether_close(queue_t *rdq, int flag, void *creds)
 	}
 	the_stream->multicast_list = NULL;
 
+	// Remove it from our list of open streams
+	if (open_stream_list == the_stream)
+		open_stream_list = the_stream->next_open;
+	else {
+		for (DLPIStream *p = open_stream_list; p != NULL; p = p->next_open)
+			if (p->next_open == the_stream) {
+				p->next_open = the_stream->next_open;
+				break;
+			}
+	}
+
 	// Delete the DLPIStream
 	return mi_close_comm((DLPIStream **)&dlpi_stream_list, rdq);
 }
@@ -1062,6 +1085,45 @@ static void handle_received_packet(DLPIStream *the_stream, mblk_t *mp, uint16 pa
 }
 
 
+/*
+ *  Receive buffers: packets that no stream wanted are kept as spares for
+ *  the next ones, saving a freemsg() and an allocb() call into Mac OS
+ */
+
+static const int kRxSpareCount = 8;					// Maximum number of spare buffers
+static const uint32 kRxBufferSize = 1514;			// Minimum size of receive buffers (maximum frame size)
+static mblk_t *rx_spares[kRxSpareCount];
+static int num_rx_spares = 0;
+
+static mblk_t *rx_alloc(uint32 size)
+{
+	if (size <= kRxBufferSize && num_rx_spares > 0) {
+		mblk_t *mp = rx_spares[--num_rx_spares];
+		mp->b_rptr = mp->b_datap->db_base;
+		mp->b_wptr = mp->b_datap->db_base;
+		num_rx_recycled++;
+		return mp;
+	}
+	return allocb(size < kRxBufferSize ? kRxBufferSize : size, 0);
+}
+
+static void rx_free(mblk_t *mp)
+{
+	datab *dp = mp->b_datap;
+	if (num_rx_spares < kRxSpareCount && mp->b_cont == NULL && dp->db_ref == 1 && dp->db_type == M_DATA
+	 && (uint32)(dp->db_lim - dp->db_base) >= kRxBufferSize)
+		rx_spares[num_rx_spares++] = mp;
+	else
+		freemsg(mp);
+}
+
+static void rx_free_spares(void)
+{
+	while (num_rx_spares > 0)
+		freemsg(rx_spares[--num_rx_spares]);
+}
+
+
 /*
  *  Packet received, distribute it to the streams that want it
  */
@@ -1087,7 +1149,7 @@ void ether_packet_received(mblk_t *mp)
 	DLPIStream *the_stream, *found_stream = NULL;
 	uint16 found_packetType = 0;
 	int32 found_destAddressType = 0;
-	for (the_stream = dlpi_stream_list; the_stream != NULL; the_stream = mi_next_ptr(the_stream)) {
+	for (the_stream = open_stream_list; the_stream != NULL; the_stream = the_stream->next_open) {
 
 		// Don't send to unbound streams
 		if (the_stream->dlpi_state == DL_UNBOUND)
@@ -1140,7 +1202,7 @@ type_found:
 	if (found_stream)
 		handle_received_packet(found_stream, mp, found_packetType, found_destAddressType);
 	else {
-		freemsg(mp);	// Nobody wants it *snief*
+		rx_free(mp);	// Nobody wants it *snief*
 		num_rx_dropped++;
 	}
 }
@@ -1156,7 +1218,7 @@ void ether_dispatch_packet(uint32 p, uint32 size)
 	// Wrap packet in message block
 	num_rx_packets++;
 	mblk_t *mp;
-	if ((mp = allocb(size, 0)) != NULL) {
+	if ((mp = rx_alloc(size)) != NULL) {
 		D(bug(" packet data at %p\n", (void *)mp->b_rptr));
 		Mac2Host_memcpy(mp->b_rptr, p, size);
 		mp->b_wptr += size;
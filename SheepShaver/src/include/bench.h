@@ -0,0 +1 @@
+../../../BasiliskII/src/include/bench.h
\ No newline at end of file
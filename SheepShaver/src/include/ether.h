@@ -97,5 +97,6 @@ extern int32 num_rx_no_mem;
 extern int32 num_rx_dropped;
 extern int32 num_rx_stream_not_ready;
 extern int32 num_rx_no_unitdata_mem;
+extern int32 num_rx_recycled;
 
 #endif
@@ -0,0 +1 @@
+../../../BasiliskII/src/include/profiler.h
\ No newline at end of file
@@ -32,6 +32,9 @@ enum {
 };
 extern int ROMType;
 
+// Mac address of SCSIDispatch() replacement, called again while a SCSI command is running
+extern uint32 SCSIDispatchPatch;
+
 extern bool DecodeROM(uint8 *data, uint32 size);
 extern bool PatchROM(void);
 extern void InstallDrivers(void);
@@ -47,6 +47,8 @@
 #include "vm_alloc.h"
 #include "sigsegv.h"
 #include "thunks.h"
+#include "profiler.h"
+#include "bench.h"
 
 #define DEBUG 0
 #include "debug.h"
@@ -261,6 +263,12 @@ bool InitAll(const char *vmdir)
 	mon_write_byte = sheepshaver_write_byte;
 #endif
 
+	// Init guest profiler
+	ProfilerInit();
+
+	// Start benchmark clock
+	BenchStart();
+
 	return true;
 }
 
@@ -282,6 +290,9 @@ void CDROMOpenDone() {
 
 void ExitAll(void)
 {
+	// Write guest profile
+	ProfilerExit();
+
 #if ENABLE_MON
 	// Deinitialize mon
 	mon_exit();
@@ -311,6 +322,9 @@ void ExitAll(void)
 	// Exit video
 	VideoExit();
 
+	// Write benchmark report (the refresh thread has stopped now)
+	BenchExit();
+
 	// Exit external file system
 	ExtFSExit();
 
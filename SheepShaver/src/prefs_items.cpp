@@ -57,6 +57,14 @@ prefs_desc common_prefs_items[] = {
 	{"ignoreillegal", TYPE_BOOLEAN, false, "ignore illegal instructions"},
 	{"jit", TYPE_BOOLEAN, false,        "enable JIT compiler"},
 	{"jit68k", TYPE_BOOLEAN, false,     "enable 68k DR emulator"},
+	{"profile", TYPE_STRING, false,     "path prefix of guest profile output, enables profiling (SIGPROF toggles)"},
+	{"profilehz", TYPE_INT32, false,    "profiler sampling rate in Hz"},
+	{"bench", TYPE_STRING, false,       "path of benchmark report (\"-\" = stdout), enables headless benchmark mode"},
+	{"benchstop", TYPE_STRING, false,   "benchmark end: \"finder\", \"emulop\" or number of instructions"},
+	{"benchtimeout", TYPE_INT32, false, "benchmark time limit in seconds (0 = none)"},
+	{"romshare", TYPE_BOOLEAN, false,   "share the patched ROM with other instances"},
+	{"rammerge", TYPE_BOOLEAN, false,   "let the host merge identical pages of Mac RAM"},
+	{"memstats", TYPE_BOOLEAN, false,   "print host memory usage on exit"},
 	{"keyboardtype", TYPE_INT32, false, "hardware keyboard type"},
 	{"hardcursor", TYPE_BOOLEAN, false, "hardware mouse cursor"},
 	{"hotkey", TYPE_INT32, false,       "hotkey modifier"},
@@ -97,6 +105,11 @@ void AddPrefsDefaults(void)
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("ignoresegv", true);
 	PrefsAddBool("ignoreillegal", true);
+	PrefsAddInt32("profilehz", 1000);
+	PrefsAddInt32("benchtimeout", 600);
+	PrefsAddBool("romshare", false);
+	PrefsAddBool("rammerge", false);
+	PrefsAddBool("memstats", false);
 
 #if USE_JIT
 	// JIT compiler specific options
@@ -0,0 +1 @@
+../../BasiliskII/src/profiler.cpp
\ No newline at end of file
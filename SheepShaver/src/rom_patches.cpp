@@ -67,6 +67,7 @@ const uint32 ADDR_MAP_PATCH_SPACE = 0x2fd140;
 
 // Global variables
 int ROMType;				// ROM type
+uint32 SCSIDispatchPatch = 0;	// Mac address of SCSIDispatch() replacement
 static uint32 sony_offset;	// Offset of .Sony driver resource
 
 // Prototypes
@@ -2064,6 +2065,7 @@ static bool patch_68k(void)
 	*wp++ = htons(M68K_RTS);
 	*wp++ = htons(M68K_EMUL_OP_SCSI_ATOMIC);
 	*wp++ = htons(M68K_RTS);
+	SCSIDispatchPatch = ROMBase + base + 22;
 	*wp++ = htons(M68K_EMUL_OP_SCSI_DISPATCH);
 	*wp = htons(0x4ed0);			// jmp		(a0)
 	wp = (uint16 *)(ROMBaseHost + base + 0x20);
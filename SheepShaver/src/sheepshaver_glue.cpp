@@ -30,6 +30,8 @@
 #include "ppc-bitfields.hpp"
 #include "ppc-cpu.hpp"
 #include "thunks.h"
+#include "profiler.h"
+#include "bench.h"
 
 // Used for NativeOp trampolines
 #include "video.h"
@@ -100,6 +102,27 @@ void powerpc_cpu::Reset() {
 uint32 spcflags_mask;
 spinlock_t spcflags_lock;
 
+// Profiler sampling, the call chain is taken from the r1 back chain
+void ProfilerRequestSample(void)
+{
+	spcflags_set(SPCFLAG_CPU_PROFILE);
+}
+
+static void profile_sample(TinyPPC *tinyppc)
+{
+	uint32 callers[PROFILER_MAX_CALLERS];
+	int n = 0;
+	uint32 sp = tinyppc->GetGPR(1);
+	while (n < PROFILER_MAX_CALLERS && sp >= RAMBase && sp < RAMBase + RAMSize - 4) {
+		uint32 next = ReadMacInt32(sp);
+		if (next <= sp || next >= RAMBase + RAMSize - 12)
+			break;
+		callers[n++] = ReadMacInt32(next + 8);	// Saved LR
+		sp = next;
+	}
+	ProfilerService(tinyppc->GetPC(), callers, n);
+}
+
 bool check_spcflags(TinyPPC *tinyppc)
 {
 	if (spcflags_test(SPCFLAG_CPU_EXEC_RETURN)) {
@@ -111,6 +134,10 @@ bool check_spcflags(TinyPPC *tinyppc)
 		static bool processing_interrupt = false;
 		if (!processing_interrupt) {
 			processing_interrupt = true;
+			if (ProfilerActive)
+				ProfilerInterrupt(1);
+			if (BenchActive)
+				BenchInterrupt();
 			tinyppc->Interrupt();
 			processing_interrupt = false;
 		}
@@ -119,6 +146,10 @@ bool check_spcflags(TinyPPC *tinyppc)
 		spcflags_clear(SPCFLAG_CPU_TRIGGER_INTERRUPT);
 		spcflags_set(SPCFLAG_CPU_HANDLE_INTERRUPT);
 	}
+	if (spcflags_test(SPCFLAG_CPU_PROFILE)) {
+		spcflags_clear(SPCFLAG_CPU_PROFILE);
+		profile_sample(tinyppc);
+	}
 	return true;
 }
 
@@ -219,7 +250,12 @@ void sheepshaver_cpu::execute_emul_op(uint32 emul_op)
 	r68.a[7] = gpr(1);
 	uint32 saved_cr = get_cr() & 0xff9fffff; // mask_operand::compute(11, 8)
 	uint32 saved_xer = get_xer();
-	EmulOp(&r68, gpr(24), emul_op);
+	if (ProfilerActive) {
+		uint64 start = ProfilerClock();
+		EmulOp(&r68, gpr(24), emul_op);
+		ProfilerHandler(PROFILER_EMUL_OP | emul_op, start);
+	} else
+		EmulOp(&r68, gpr(24), emul_op);
 	set_cr(saved_cr);
 	set_xer(saved_xer);
 	for (int i = 0; i < 8; i++)
@@ -519,6 +555,21 @@ void execute_sheep(uint32 opcode) {
 	ppc_cpu->execute_sheep(opcode);
 }
 
+// Executed instructions, for the benchmark and the deterministic time mode
+uint64 BenchInstructionCount(void)
+{
+	return ppc_cpu ? ppc_cpu->tinyppc.GetInsnCount() : 0;
+}
+
+// The CPU stops when it executed the remaining instructions
+void ICountSetDeadline(uint64 insns)
+{
+	uint64 now = BenchInstructionCount();
+	uint64 left = insns > now ? insns - now : 0;
+	if (ppc_cpu)
+		ppc_cpu->tinyppc.SetInsnDeadline(ppc_cpu->tinyppc.GetInsnCount() + left);
+}
+
 void FlushCodeCache(uintptr start, uintptr end)
 {
 	D(bug("FlushCodeCache(%08x, %08x)\n", start, end));
@@ -684,8 +735,15 @@ void TriggerInterrupt(void)
 void HandleInterrupt(RegTmp *r)
 {
 #ifdef USE_SDL_VIDEO
-	// We must fill in the events queue in the same thread that did call SDL_SetVideoMode()
-	SDL_PumpEvents();
+	// We must fill in the events queue in the same thread that did call SDL_SetVideoMode(),
+	// once per 60Hz tick is enough (the events are handled by the redraw thread, and with
+	// the SDL 1.2 event thread there is nothing to pump at all)
+	if (InterruptFlags & INTFLAG_VIA) {
+		const uint64 profiler_start = ProfilerActive ? ProfilerClock() : 0;
+		SDL_PumpEvents();
+		if (profiler_start && ProfilerActive)
+			ProfilerHandler(PROFILER_HOST | PROFILER_HOST_EVENTS, profiler_start);
+	}
 #endif
 
 	// Do nothing if interrupts are disabled
@@ -779,6 +837,7 @@ void sheepshaver_cpu::execute_native_op(uint32 selector)
 	native_exec_count++;
 	const clock_t native_exec_start = clock();
 #endif
+	const uint64 profiler_start = ProfilerActive ? ProfilerClock() : 0;
 
 	switch (selector) {
 	case NATIVE_PATCH_NAME_REGISTRY:
@@ -897,6 +956,9 @@ void sheepshaver_cpu::execute_native_op(uint32 selector)
 		break;
 	}
 
+	if (profiler_start && ProfilerActive)
+		ProfilerHandler(PROFILER_NATIVE_OP | selector, profiler_start);
+
 #if EMUL_TIME_STATS
 	native_exec_time += (clock() - native_exec_start);
 #endif
@@ -0,0 +1,279 @@
+/*
+ *  tinyppc_fp_bench.cpp - TinyPPC floating-point microbenchmark and FPRF
+ *                         conformance test
+ *
+ *  SheepShaver (C) 1997-2008 Christian Bauer and Marc Hellwig
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ *  The conformance part runs a random sequence of FP operations on special
+ *  values (zeros, subnormals, infinities, NaN) with mffs reads and interrupts
+ *  in between, and checks every FPSCR read against the eager semantics: FPRF
+ *  is the class of the last FPRF-setting result, interrupt handlers are
+ *  transparent. The benchmark part times a loop of arithmetic operations.
+ *  Build with -DTINYPPC_LAZY_FPRF=0 for the eager reference numbers.
+ */
+
+// Pull in the whole CPU core, the glue it needs is stubbed out below
+#include "TinyPPC.cpp"
+
+#include <vector>
+#include <sys/time.h>
+
+// Memory layout
+const uint32 MEM_SIZE = 0x200000;
+const uint32 PROGRAM = 0x1000;				// Test sequence or benchmark loop
+const uint32 HANDLER = 0x80000;				// Interrupt handler
+const uint32 SOURCES = 0x90000;				// f0..f15 (r1)
+const uint32 RESULTS = 0xa0000;				// Stored results (r2)
+const uint32 FPSCRS = 0x100000;				// Stored mffs values (r3)
+
+const int NUM_SOURCES = 16;					// f0..f15 are operands, f16..f29 results
+const uint32 SHEEP_STOP = 6 << 26;			// Return from Execute()
+const uint32 SHEEP_INTERRUPT = 6 << 26 | 1;	// Run HANDLER as an interrupt
+
+static uint8 *mem;
+static TinyPPC *cpu;
+
+// Glue
+uint32 ROMBase, KernelDataAddr;
+uint32 spcflags_mask;
+spinlock_t spcflags_lock;
+bool check_spcflags(TinyPPC *) { spcflags_mask = 0; return false; }
+void ICountService() {}
+uint64 GuestTicks_usec() { return 0; }
+
+class sheepshaver_cpu {
+public:
+	static uint32 &pc(TinyPPC *p) { return p->pc; }
+	static uint32 &gpr(TinyPPC *p, int n) { return p->gpr[n]; }
+};
+
+static void run(uint32 pc)
+{
+	sheepshaver_cpu::pc(cpu) = pc;
+	cpu->Execute();
+}
+
+void execute_sheep(uint32 op)
+{
+	sheepshaver_cpu::pc(cpu) += 4;
+	if (op == SHEEP_INTERRUPT)
+		cpu->Interrupt();
+	else
+		spcflags_mask |= SPCFLAG_CPU_EXEC_RETURN;
+}
+
+void HandleInterrupt(RegTmp *r)
+{
+	run(HANDLER);
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static void put32(uint32 adr, uint32 v) { uint32 b = __builtin_bswap32(v); memcpy(mem + adr, &b, 4); }
+static uint32 get32(uint32 adr) { uint32 b; memcpy(&b, mem + adr, 4); return __builtin_bswap32(b); }
+static void putd(uint32 adr, double d) { uint64 b; memcpy(&b, &d, 8); b = __builtin_bswap64(b); memcpy(mem + adr, &b, 8); }
+static double getd(uint32 adr) { uint64 b; memcpy(&b, mem + adr, 8); b = __builtin_bswap64(b); double d; memcpy(&d, &b, 8); return d; }
+
+// Minimal assembler
+class code {
+public:
+	code(uint32 adr) : pc(adr) {}
+	code &l(uint32 v) { put32(pc, v); pc += 4; return *this; }
+	code &a_form(int op, int xo, int d, int a, int b, int c) { return l(op << 26 | d << 21 | a << 16 | b << 11 | c << 6 | xo << 1); }
+	code &x_form(int xo, int d, int a, int b) { return l(63 << 26 | d << 21 | a << 16 | b << 11 | xo << 1); }
+	code &lfd(int d, int a, int16 ofs) { return l(50 << 26 | d << 21 | a << 16 | uint16(ofs)); }
+	code &stfd(int s, int a, int16 ofs) { return l(54 << 26 | s << 21 | a << 16 | uint16(ofs)); }
+	code &addi(int d, int a, int16 v) { return l(14 << 26 | d << 21 | a << 16 | uint16(v)); }
+	code &mtctr(int s) { return l(31 << 26 | s << 21 | 9 << 16 | 467 << 1); }
+	code &bdnz(uint32 target) { return l(16 << 26 | 16 << 21 | ((target - pc) & 0xfffc)); }
+	uint32 here(void) const { return pc; }
+private:
+	uint32 pc;
+};
+
+/*
+ *  FPRF conformance
+ */
+
+// A-form (primary, xo, FPRF set, uses A/B/C) and X-form operations
+struct fp_op {
+	const char *name;
+	int primary, xo;
+	bool x_form, sets_fprf;
+};
+
+static const fp_op ops[] = {
+	{"fadd", 63, 21, false, true}, {"fadds", 59, 21, false, true},
+	{"fsub", 63, 20, false, true}, {"fsubs", 59, 20, false, true},
+	{"fmul", 63, 25, false, true}, {"fmuls", 59, 25, false, true},
+	{"fdiv", 63, 18, false, true}, {"fdivs", 59, 18, false, true},
+	{"fmadd", 63, 29, false, true}, {"fmsub", 63, 28, false, true},
+	{"fnmadd", 63, 31, false, true}, {"fnmsub", 59, 30, false, true},
+	{"fsqrt", 63, 22, false, true}, {"fres", 63, 24, false, true},
+	{"frsqrte", 63, 26, false, true}, {"fsel", 63, 23, false, false},
+	{"frsp", 63, 12, true, true}, {"fmr", 63, 72, true, false},
+	{"fneg", 63, 40, true, false}, {"fabs", 63, 264, true, false},
+	{"fnabs", 63, 136, true, false}, {"fctiw", 63, 14, true, false},
+	{"fcmpu", 63, 0, true, false}, {"fcmpo", 63, 32, true, false},
+};
+const int NUM_OPS = sizeof(ops) / sizeof(ops[0]);
+
+static const double sources[NUM_SOURCES] = {
+	0.0, -0.0, 1.5, -1.5, 4.9e-324, -4.9e-324, 2.2e-308, -2.2e-308,
+	HUGE_VAL, -HUGE_VAL, NAN, 1e300, -1e300, 0.5, 1.0, 3.0e-39,
+};
+
+static uint32 fprf(double v)
+{
+	switch (std::fpclassify(v)) {
+		case FP_ZERO:		return std::signbit(v) ? 0x12000 : 0x2000;
+		case FP_SUBNORMAL:	return 0x10000 | (v < 0 ? 0x8000 : 0x4000);
+		case FP_NAN:		return 0x11000;
+		case FP_INFINITE:	return 0x1000 | (v < 0 ? 0x8000 : 0x4000);
+		default:			return v < 0 ? 0x8000 : 0x4000;
+	}
+}
+
+static uint32 fpcc(double a, double b)
+{
+	if (std::isnan(a) || std::isnan(b)) return 0x1000;
+	return a < b ? 0x8000 : a > b ? 0x4000 : 0x2000;
+}
+
+static bool conformance(int steps)
+{
+	// Interrupt handler clobbers FPRF and f30
+	code h(HANDLER);
+	h.a_form(63, 18, 30, 3, 0, 0)	// fdiv f30,f3,f0 -> -inf
+	 .l(SHEEP_STOP);
+
+	for (int i = 0; i < NUM_SOURCES; i++)
+		putd(SOURCES + i * 8, sources[i]);
+
+	struct step { int op, d, a, b, c; bool mffs, interrupt; };
+	std::vector<step> seq;
+	srand(42);
+	code p(PROGRAM);
+	for (int i = 0; i < NUM_SOURCES; i++)
+		p.lfd(i, 1, i * 8);
+	for (int i = 0; i < steps; i++) {
+		step s = {rand() % NUM_OPS, 16 + rand() % 14, rand() % NUM_SOURCES, rand() % NUM_SOURCES, rand() % NUM_SOURCES, rand() % 3 == 0, rand() % 4 == 0};
+		const fp_op &o = ops[s.op];
+		if (o.x_form) {
+			if (o.xo == 0 || o.xo == 32)	// fcmp crfD = d & 7
+				p.x_form(o.xo, (s.d & 7) << 2, s.a, s.b);
+			else
+				p.x_form(o.xo, s.d, 0, s.b);
+		} else
+			p.a_form(o.primary, o.xo, s.d, s.a, s.b, s.c);
+		p.stfd(s.d, 2, 0).addi(2, 2, 8);
+		if (s.interrupt)
+			p.l(SHEEP_INTERRUPT);
+		if (s.mffs)
+			p.x_form(583, 31, 0, 0).stfd(31, 3, 0);
+		p.addi(3, 3, 8);
+		seq.push_back(s);
+	}
+	p.l(SHEEP_STOP);
+
+	cpu->Reset();
+	sheepshaver_cpu::gpr(cpu, 1) = SOURCES;
+	sheepshaver_cpu::gpr(cpu, 2) = RESULTS;
+	sheepshaver_cpu::gpr(cpu, 3) = FPSCRS;
+	run(PROGRAM);
+
+	// Replay against the eager semantics
+	uint32 fpscr = 0;
+	int checks = 0, errors = 0;
+	for (int i = 0; i < steps; i++) {
+		const step &s = seq[i];
+		const fp_op &o = ops[s.op];
+		if (o.xo == 0 || o.xo == 32)
+			fpscr = (fpscr & ~0xf000) | fpcc(sources[s.a], sources[s.b]);
+		else if (o.sets_fprf)
+			fpscr = (fpscr & ~0x1f000) | fprf(getd(RESULTS + i * 8));
+		if (s.mffs) {
+			uint32 got = get32(FPSCRS + i * 8 + 4);
+			checks++;
+			if (got != fpscr) {
+				if (errors++ < 10)
+					printf("step %d (%s%s): FPSCR %08x, expected %08x\n", i, o.name, s.interrupt ? " + interrupt" : "", got, fpscr);
+			}
+		}
+	}
+	printf("FPRF conformance: %d checks, %d mismatches\n", checks, errors);
+	return errors == 0;
+}
+
+/*
+ *  Benchmark
+ */
+
+static void benchmark(uint32 iterations)
+{
+	static const double values[] = {1.000001, 0.999999, 0.5, 0.25};
+	for (int i = 0; i < 4; i++)
+		putd(SOURCES + i * 8, values[i]);
+
+	// f4 = f0 * f1 + f2 etc., all results stay normal
+	code p(PROGRAM);
+	for (int i = 0; i < 4; i++)
+		p.lfd(i, 1, i * 8);
+	p.lfd(4, 1, 0).lfd(5, 1, 8).mtctr(5);
+	uint32 loop = p.here();
+	p.a_form(63, 25, 6, 4, 0, 1)	// fmul f6,f4,f1
+	 .a_form(63, 29, 7, 6, 2, 3)	// fmadd f7,f6,f3,f2
+	 .a_form(63, 21, 8, 7, 3, 0)	// fadd f8,f7,f3
+	 .a_form(63, 20, 9, 8, 2, 0)	// fsub f9,f8,f2
+	 .a_form(59, 25, 10, 9, 0, 1)	// fmuls f10,f9,f1
+	 .a_form(63, 28, 11, 10, 3, 2)	// fmsub f11,f10,f2,f3
+	 .a_form(63, 18, 12, 11, 0, 0)	// fdiv f12,f11,f0
+	 .a_form(63, 21, 5, 12, 3, 0)	// fadd f5,f12,f3
+	 .bdnz(loop)
+	 .l(SHEEP_STOP);
+
+	cpu->Reset();
+	sheepshaver_cpu::gpr(cpu, 1) = SOURCES;
+	sheepshaver_cpu::gpr(cpu, 5) = iterations;
+	uint64 start_insns = cpu->GetInsnCount();
+	double start = now();
+	run(PROGRAM);
+	double t = now() - start;
+	uint64 insns = cpu->GetInsnCount() - start_insns;
+	printf("%s FPRF: %llu insns in %.3f s, %.1f Minsns/s, %.2f ns/FP op\n", TINYPPC_LAZY_FPRF ? "lazy" : "eager",
+	       (unsigned long long)insns, t, insns / t * 1e-6, t * 1e9 / (iterations * 8.0));
+}
+
+int main(int argc, char **argv)
+{
+	uint32 iterations = argc > 1 ? atoi(argv[1]) : 10000000;
+	mem = new uint8[MEM_SIZE];
+	memset(mem, 0, MEM_SIZE);
+	cpu = new TinyPPC;
+	cpu->SetMemoryPtr(mem);
+
+	bool ok = conformance(20000);
+	benchmark(iterations);
+	return ok ? 0 : 1;
+}